@@ -0,0 +1,45 @@
+#ifndef HAIRCODEC_H
+#define HAIRCODEC_H
+
+#include "Math.h"
+#include "HairTypes.h"
+#include <stdint.h>
+#include <vector>
+
+namespace HairSimulation
+{
+    // Compresses frames of strand positions, for caches or for streaming the
+    // simulation to another process. Roots are predicted from the previous frame,
+    // the other vertices from the previous vertex and the previous frame, and the
+    // residuals are Rice coded. Frames are split into chunks of strands that are
+    // coded independently on several threads.
+    //
+    // The encoder and the decoder keep the last frame, so an encoder and a decoder
+    // stay in sync as long as every frame since the last keyframe is decoded in order.
+    class HairCodec
+    {
+    public:
+        HairCodec(uint32_t strandsCount, uint32_t verticesPerStrand, const HairCodecSettings& settings);
+        void Encode(const Vector4* positions, bool keyframe, std::vector<uint8_t>& data);
+        void Decode(const uint8_t* data, size_t size, Vector4* positions);
+        void Reset();
+
+        static constexpr uint32_t ChunkStrands = 256;
+
+    private:
+        uint32_t strandsCount;
+        uint32_t verticesPerStrand;
+        float quantizationStep;
+        uint32_t threadsCount;
+        bool hasPrevious;
+        std::vector<int32_t> roots;
+        std::vector<int16_t> offsets;
+        std::vector<uint8_t> movable;
+        std::vector<std::vector<uint8_t>> chunks;
+
+        void EncodeChunk(const Vector4* positions, bool keyframe, uint32_t chunk);
+        void DecodeChunk(const uint8_t* data, size_t size, bool keyframe, uint32_t chunk, Vector4* positions);
+    };
+}
+
+#endif
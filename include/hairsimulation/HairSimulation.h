@@ -5,29 +5,86 @@
 #include "Math.h"
 #include "HairTypes.h"
 #include <stdint.h>
+#include <stddef.h>
 
 namespace HairSimulation
 {
     class HairRenderer;
     class HairModel;
     class HairInstance;
+    class HairDistanceField;
+    class HairCache;
+    class HairModelLoad;
+    class ModelLoader;
+    class CommandQueue;
+    class BufferPool;
+    class MemoryTracker;
 
     class HairSimulationSystem
     {
     public:
-        HairSimulationSystem();
+        HairSimulationSystem(const char* programCachePath = nullptr);
         HairSimulationSystem(const HairSimulationSystem&) = delete;
-        HairModel* LoadModel(const char* path) const;
+        HairModel* LoadModel(const char* path, const HairLoadSettings& settings = HairLoadSettings()) const;
+        HairModelLoad* LoadModelAsync(const char* path, const HairLoadSettings& settings = HairLoadSettings()) const;
+        void UpdateModelLoads(uint32_t uploadBudget = 2 * 1024 * 1024) const;
+        HairModel* TakeLoadedModel(HairModelLoad* load) const;
+        void CancelModelLoad(HairModelLoad* load) const;
         void DestroyModel(HairModel* model) const;
+        uint32_t GetStrandIndex(const HairModel* model, uint32_t fileStrandIndex) const;
+        uint32_t GetFileStrandIndex(const HairModel* model, uint32_t strandIndex) const;
+        void AttachToScalp(HairModel* model, const HairMeshDescriptor& scalp) const;
         HairInstance* CreateInstance(const HairModel* model) const;
         void UpdateInstanceSettings(HairInstance* instance, const HairConfig& settings) const;
+        void SetScalpVertices(HairInstance* instance, uint32_t vertexBufferID) const;
         void DestroyInstance(HairInstance* instance) const;
         void SimulateHair(HairInstance* instance, float timeStep = 1.0f / 60.0f) const;
+        HairInstance* QueueCreateInstance(const HairModel* model) const;
+        void QueueUpdateInstanceSettings(HairInstance* instance, const HairConfig& settings) const;
+        void QueueSimulateHair(HairInstance* instance, float timeStep = 1.0f / 60.0f) const;
+        void QueueDestroyInstance(HairInstance* instance) const;
+        uint32_t ExecuteQueuedCommands() const;
+        HairInstanceStatus GetInstanceStatus(const HairInstance* instance) const;
+        const char* GetInstanceError(const HairInstance* instance) const;
+        void BeginCacheRecording(HairInstance* instance, const char* path, const HairCodecSettings* codec = nullptr) const;
+        void EndCacheRecording(HairInstance* instance) const;
+        HairCache* OpenCache(const char* path) const;
+        void CloseCache(HairCache* cache) const;
+        uint32_t GetCacheFramesCount(const HairCache* cache) const;
+        void GetCacheLayout(const HairCache* cache, uint32_t& strandsCount, uint32_t& verticesPerStrand) const;
+        void GetCacheFrame(const HairCache* cache, uint32_t frame, Vector4* positions) const;
+        void PlayCacheFrame(HairInstance* instance, const HairCache* cache, uint32_t frame) const;
         void RenderHair(const HairInstance* instance, const Matrix4& viewMatrix, const Matrix4& projectionMatrix) const;
+        void RenderHair(const HairInstance* instance, const HairRenderPass* passes, uint32_t passesCount) const;
+        void RenderHairMultiView(const HairInstance* instance, const HairRenderPass* views, uint32_t viewsCount) const;
+        void SetOcclusionDepth(uint32_t depthTextureID, uint32_t width, uint32_t height) const;
+        void SetLights(const HairLight* lights, uint32_t lightsCount) const;
+        void SetColliders(HairInstance* instance, const HairCollider* colliders, uint32_t collidersCount) const;
+        void UpdateColliderTransforms(HairInstance* instance, const Matrix4* transforms, uint32_t transformsCount) const;
+        HairDistanceField* BakeDistanceField(const HairMeshDescriptor& mesh, const HairDistanceFieldSettings& settings) const;
+        void DestroyDistanceField(HairDistanceField* field) const;
+        void SetDistanceField(HairInstance* instance, const HairDistanceField* field, const Matrix4& transform) const;
+        HairStatistics GetStatistics(const HairInstance* instance) const;
+        void SetMemoryBudget(uint64_t bytes) const;
+        HairMemoryUsage GetMemoryUsage() const;
+        HairMemoryUsage GetMemoryUsage(const HairModel* model) const;
+        HairMemoryUsage GetMemoryUsage(const HairInstance* instance) const;
         ~HairSimulationSystem();
 
     private:
+        void InitializeInstance(HairInstance* instance, const HairModel* model) const;
+        void ReleaseInstanceResources(HairInstance* instance) const;
+
+        // models and instances are sub-allocated from a few large buffers
+        static constexpr size_t ModelArenaSize = 64 * 1024 * 1024;
+        static constexpr size_t InstanceArenaSize = 32 * 1024 * 1024;
+
         HairRenderer* hairRenderer;
+        MemoryTracker* memoryTracker;
+        BufferPool* modelBufferPool;
+        BufferPool* instanceBufferPool;
+        ModelLoader* modelLoader;
+        CommandQueue* commandQueue;
     };
 }
 
@@ -13,25 +13,88 @@ namespace HairSimulation
         uint32_t strandsCount;
     };
 
+    // Closed triangle mesh, three indices per triangle.
+    struct HairMeshDescriptor
+    {
+        const Vector3* vertices;
+        uint32_t verticesCount;
+        const uint32_t* indices;
+        uint32_t trianglesCount;
+    };
+
+    // Compact storage keeps the rest data of the simulation in about half the
+    // memory: packed rest positions with a movability bitmask, one rest length per
+    // vertex and half precision reference vectors and rotations. Spatial reordering
+    // sorts strands and root triangles by the Morton code of their roots so that
+    // neighbouring strands share cache lines, GetStrandIndex maps the strand
+    // indices of the file to the reordered ones.
+    struct HairLoadSettings
+    {
+        bool compactStorage;
+        bool spatialReorder;
+
+
+        HairLoadSettings() :
+            compactStorage(false),
+            spatialReorder(false)
+        {
+        }
+    };
+
+    // Instances returned by QueueCreateInstance stay pending until their creation
+    // has been executed. Any failed queued command leaves the handle for
+    // DestroyInstance only.
+    enum class HairInstanceStatus
+    {
+        Pending,
+        Ready,
+        Failed
+    };
+
+    enum class HairRenderPipeline
+    {
+        Tessellation,
+        Compute
+    };
+
     struct HairConfig
     {
         bool renderHair;
         bool renderStrands;
         bool renderRoot;
+        HairRenderPipeline renderPipeline;
+        bool followerCache;
+        bool frustumCulling;
+        bool occlusionCulling;
         Matrix4 modelMatrix;
         Vector3 windVecs;
         float globalConstraint;
         float localConstraint;
         float friction;
+        bool hairInteraction;
+        float interactionFriction;
+        float volumePreservation;
+        float collisionMargin;
+        float guideRatio;
         float tesselationFactor;
+        bool adaptiveTessellation;
+        float tessellationPixelError;
+        uint32_t tessellationBudget;
         float rootWidth;
         float tipWidth;
         float thinningStart;
         float density;
+        bool areaWeightedDensity;
+        uint32_t hairBudget;
+        bool renderLOD;
+        float lodFullDetailSize;
+        float lodMinDetail;
         float ambientStrength;
         float diffuseStrength;
         float specularStrength;
         float specularPow;
+        bool selfShadowing;
+        float selfShadowStrength;
         Vector4 color;
 
 
@@ -39,25 +102,189 @@ namespace HairSimulation
             renderHair(true),
             renderStrands(false),
             renderRoot(false),
+            renderPipeline(HairRenderPipeline::Tessellation),
+            followerCache(false),
+            frustumCulling(true),
+            occlusionCulling(false),
             windVecs(0, 0, 0),
             globalConstraint(0.002f),
             localConstraint(0.01f),
             friction(0.05f),
+            hairInteraction(false),
+            interactionFriction(0.1f),
+            volumePreservation(0.05f),
+            collisionMargin(0.0f),
+            guideRatio(1.0f),
             tesselationFactor(4.0f),
+            adaptiveTessellation(false),
+            tessellationPixelError(0.5f),
+            tessellationBudget(0),
             rootWidth(0.002f),
             tipWidth(0.0005f),
             thinningStart(0.5f),
             density(64.0f),
+            areaWeightedDensity(false),
+            hairBudget(0),
+            renderLOD(false),
+            lodFullDetailSize(0.25f),
+            lodMinDetail(0.1f),
             ambientStrength(0.5f),
             diffuseStrength(0.5f),
             specularStrength(0.5f),
             specularPow(50.0f),
+            selfShadowing(false),
+            selfShadowStrength(0.05f),
             color(0.95f, 0.9f, 0.625f, 1.0f)
 
         {
             modelMatrix.SetIdentity();
         }
     };
+
+    // Point light, a radius of 0 lights the whole scene without falloff.
+    struct HairLight
+    {
+        Vector3 position;
+        float radius;
+        Vector4 color;
+
+
+        HairLight() :
+            position(0, 0, 0),
+            radius(0.0f),
+            color(1.0f, 1.0f, 1.0f, 1.0f)
+        {
+        }
+    };
+
+    // Resolution is the voxel count along the longest side of the mesh bounds,
+    // padding and bandWidth are in voxels. Distances are exact inside the band
+    // around the surface and clamped outside of it. When cachePath is set a
+    // previous bake of the same mesh and settings is loaded from that file, or
+    // the new bake is written to it.
+    struct HairDistanceFieldSettings
+    {
+        uint32_t resolution;
+        uint32_t padding;
+        float bandWidth;
+        uint32_t threadsCount;
+        const char* cachePath;
+
+
+        HairDistanceFieldSettings() :
+            resolution(64),
+            padding(4),
+            bandWidth(6.0f),
+            threadsCount(0),
+            cachePath(nullptr)
+        {
+        }
+    };
+
+    // Positions are quantized to quantizationStep relative to the root of their
+    // strand, offsets beyond 32767 steps are clamped. When recording a cache a step
+    // of 0 is derived from the longest strand. Every keyframeInterval-th frame of a
+    // cache is a keyframe that decodes without the frames before it.
+    struct HairCodecSettings
+    {
+        float quantizationStep;
+        uint32_t keyframeInterval;
+        uint32_t threadsCount;
+
+
+        HairCodecSettings() :
+            quantizationStep(0.0f),
+            keyframeInterval(30),
+            threadsCount(0)
+        {
+        }
+    };
+
+    // One view of a multi-pass render. When viewportWidth is 0 the pass draws into
+    // the currently bound framebuffer and viewport. RenderHairMultiView draws all
+    // views into the bound framebuffer, view i goes to viewport i and layer i.
+    struct HairRenderPass
+    {
+        Matrix4 viewMatrix;
+        Matrix4 projectionMatrix;
+        uint32_t framebufferID;
+        int32_t viewportX;
+        int32_t viewportY;
+        int32_t viewportWidth;
+        int32_t viewportHeight;
+
+
+        HairRenderPass() :
+            framebufferID(0),
+            viewportX(0),
+            viewportY(0),
+            viewportWidth(0),
+            viewportHeight(0)
+        {
+            viewMatrix.SetIdentity();
+            projectionMatrix.SetIdentity();
+        }
+    };
+
+    enum class HairColliderType
+    {
+        Sphere,
+        Capsule
+    };
+
+    // Sphere or capsule the strands are kept out of. The shape is given in collider
+    // space, transform places it in the space of the hair model and the instance
+    // model matrix is applied on top, so colliders follow the character.
+    struct HairCollider
+    {
+        HairColliderType type;
+        Vector3 start;
+        Vector3 end;
+        float radius;
+        Matrix4 transform;
+
+
+        HairCollider() :
+            type(HairColliderType::Sphere),
+            start(0, 0, 0),
+            end(0, 0, 0),
+            radius(0.0f)
+        {
+            transform.SetIdentity();
+        }
+    };
+
+    // Bytes of GPU memory by kind of data. Rest data is everything a model shares
+    // between its instances, dynamic data the positions and render caches of an
+    // instance, index data the triangle and scalp indices. Staging counts the
+    // upload and read back buffers, it is not part of the budget.
+    struct HairMemoryUsage
+    {
+        uint64_t restData;
+        uint64_t dynamicData;
+        uint64_t indexData;
+        uint64_t debugData;
+        uint64_t staging;
+
+
+        HairMemoryUsage() :
+            restData(0),
+            dynamicData(0),
+            indexData(0),
+            debugData(0),
+            staging(0)
+        {
+        }
+    };
+
+    struct HairStatistics
+    {
+        uint32_t trianglesCount;
+        uint32_t visibleTrianglesCount;
+        float simulationTime;
+        float renderTime;
+        float selfShadowTime;
+    };
 }
 
 #endif
\ No newline at end of file
@@ -1,6 +1,8 @@
 #ifndef MATH_H
 #define MATH_H
 
+#include <stddef.h>
+
 namespace HairSimulation
 {
     constexpr float PI = 3.1415926535f;
@@ -143,6 +145,7 @@ namespace HairSimulation
         static Matrix4 RotateZ(float angle);
 
         Matrix4 EuclidianInversed() const;
+        Matrix4 Inversed() const;
         
         Matrix4 operator*(const Matrix4& other) const;
         Vector4 operator*(const Vector4& v) const;
@@ -203,6 +206,17 @@ namespace HairSimulation
 		Vector3 operator*(const Vector3& v) const;
 		Quaternion operator*(const Quaternion& other) const;
 	};
+
+    // Batch versions of the operators above, meant for whole strand buffers.
+    // Data is processed in SoA blocks with the widest SIMD instruction set the
+    // CPU supports, detected once at runtime. Input and output may alias.
+    // TransformPoints takes column major matrices, as uploaded to the shaders,
+    // the same way TransformPoint does.
+    void TransformPoints(const Matrix4& matrix, const Vector4* points, Vector4* result, size_t count);
+    void RotateVectors(const Quaternion* rotations, const Vector3* vectors, Vector3* result, size_t count);
+    void NormalizeVectors(const Vector3* vectors, Vector3* result, size_t count);
+    void RotationsBetween(const Vector3* from, const Vector3* to, Quaternion* result, size_t count);
+    const char* GetMathInstructionSet();
 }
 
 #endif
\ No newline at end of file
@@ -1,5 +1,8 @@
 #include "App.h"
+#include "CodecBenchmark.h"
 #include <iostream>
+#include <algorithm>
+#include <stdio.h>
 
 #include <imgui.h>
 #include <imgui_impl_glfw.h>
@@ -19,7 +22,7 @@ App::App(int screenWidth, int screenHeight) :
     window = glfwCreateWindow(screenWidth, screenHeight, "Hair Simulation", nullptr, nullptr);
     glfwMakeContextCurrent(window);
     
-    hairSystem = new HairSimulation::HairSimulationSystem();
+    hairSystem = new HairSimulation::HairSimulationSystem("HairSimulationPrograms.bin");
 
     IMGUI_CHECKVERSION();
     ImGui::CreateContext();
@@ -39,6 +42,9 @@ App::App(int screenWidth, int screenHeight) :
     hairConfig.friction = 0.05f;
     hairConfig.globalConstraint = 0.002f;
     hairConfig.localConstraint = 0.01f;
+    hairConfig.guideRatio = 1.0f;
+    hairConfig.renderLOD = true;
+    hairConfig.adaptiveTessellation = true;
 
     hairModel = hairSystem->LoadModel("data/hair.hgl");
     hairInstance = hairSystem->CreateInstance(hairModel);
@@ -67,15 +73,33 @@ void App::Run()
 
         ImVec2 configurationWindowSize;
         configurationWindowSize.x = 450;
-        configurationWindowSize.y = 130;
+        configurationWindowSize.y = 345;
 
         ImGui::SetNextWindowPos(configurationWindowPosition);
         ImGui::SetNextWindowSizeConstraints(configurationWindowSize, configurationWindowSize);
         ImGui::Begin("Configuration", 0, ImGuiWindowFlags_NoResize | ImGuiWindowFlags_NoMove | ImGuiWindowFlags_NoSavedSettings);
         ImGui::SliderFloat("Hair Strand Density", &hairConfig.density, 16.0f, 64.0f);
+        ImGui::Checkbox("Area Weighted Density", &hairConfig.areaWeightedDensity);
         ImGui::SliderFloat("Wind Strength", &windMagnitude, 0.0f, 15.0f);
+        ImGui::SliderFloat("Simulated Guide Ratio", &hairConfig.guideRatio, 0.0625f, 1.0f);
         ImGui::Checkbox("Show Initial Hair Strands", &hairConfig.renderStrands);
         ImGui::Checkbox("Show Root Triangles", &hairConfig.renderRoot);
+
+        auto statistics = hairSystem->GetStatistics(hairInstance);
+        float culledFraction = 1.0f - (float)statistics.visibleTrianglesCount / (std::max)(statistics.trianglesCount, 1u);
+        ImGui::Text("Culled Root Triangles: %.1f%%", culledFraction * 100.0f);
+
+        bool computePipeline = hairConfig.renderPipeline == HairSimulation::HairRenderPipeline::Compute;
+        ImGui::Checkbox("Compute Expanded Hair Geometry", &computePipeline);
+        hairConfig.renderPipeline = computePipeline ? HairSimulation::HairRenderPipeline::Compute : HairSimulation::HairRenderPipeline::Tessellation;
+        ImGui::Checkbox("Cache Follower Strands", &hairConfig.followerCache);
+        ImGui::Checkbox("Adaptive Tessellation", &hairConfig.adaptiveTessellation);
+        ImGui::Checkbox("Self-Shadowing", &hairConfig.selfShadowing);
+        ImGui::Checkbox("Hair Interaction", &hairConfig.hairInteraction);
+        ImGui::Text("GPU Simulation: %.3f ms, Render: %.3f ms, Shadow: %.3f ms", statistics.simulationTime, statistics.renderTime, statistics.selfShadowTime);
+
+        auto memory = hairSystem->GetMemoryUsage();
+        ImGui::Text("GPU Memory: %.1f MB rest, %.1f MB dynamic, %.1f MB staging", memory.restData / 1048576.0, memory.dynamicData / 1048576.0, memory.staging / 1048576.0);
         ImGui::End();
         ImGui::Render();
 
@@ -106,6 +130,38 @@ void App::Run()
     }
 }
 
+// Simulates the sample groom in the wind with the head turning, records it to
+// an uncompressed cache and runs the codec on the recorded and on generated frames.
+void App::RunCodecBenchmark(uint32_t framesCount)
+{
+    const char* cachePath = "codec_benchmark.cache";
+
+    hairConfig.windVecs = HairSimulation::Vector3(5.0f, 0.0f, 0.0f);
+    hairSystem->BeginCacheRecording(hairInstance, cachePath);
+    for (uint32_t i = 0; i < framesCount; i++) {
+        hairConfig.modelMatrix = HairSimulation::Matrix4::RotateY(0.6f * sinf(i / 30.0f));
+        hairSystem->UpdateInstanceSettings(hairInstance, hairConfig);
+        hairSystem->SimulateHair(hairInstance);
+    }
+    hairSystem->EndCacheRecording(hairInstance);
+
+    auto cache = hairSystem->OpenCache(cachePath);
+    uint32_t recordedFrames = hairSystem->GetCacheFramesCount(cache);
+    uint32_t strandsCount, verticesPerStrand;
+    hairSystem->GetCacheLayout(cache, strandsCount, verticesPerStrand);
+    auto getRecordedFrame = [&](uint32_t frame, HairSimulation::Vector4* vertices) {
+        hairSystem->GetCacheFrame(cache, frame, vertices);
+    };
+    BenchmarkCodec("Sample groom", getRecordedFrame, strandsCount, verticesPerStrand, recordedFrames);
+    hairSystem->CloseCache(cache);
+    remove(cachePath);
+
+    auto getGeneratedFrame = [](uint32_t frame, HairSimulation::Vector4* vertices) {
+        GenerateGroomFrame(65536, 16, frame, vertices);
+    };
+    BenchmarkCodec("Generated groom", getGeneratedFrame, 65536, 16, framesCount);
+}
+
 App::~App()
 {
     ImGui_ImplOpenGL3_Shutdown();
@@ -10,6 +10,7 @@ class App
 public:
     App(int screenWidth, int screenHeight);
     void Run();
+    void RunCodecBenchmark(uint32_t framesCount);
     ~App();
 
 private:
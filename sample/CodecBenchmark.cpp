@@ -0,0 +1,95 @@
+#include "CodecBenchmark.h"
+#include <algorithm>
+#include <chrono>
+#include <stdio.h>
+#include <math.h>
+
+using namespace HairSimulation;
+
+void GenerateGroomFrame(uint32_t strandsCount, uint32_t verticesPerStrand, uint32_t frame, Vector4* vertices)
+{
+    const float segmentLength = 0.3f / verticesPerStrand;
+    float time = frame / 60.0f;
+
+    for (uint32_t s = 0; s < strandsCount; s++) {
+        // roots on a sphere cap, the whole head turns slowly
+        float theta = 0.5f + 1.2f * (s % 256) / 256.0f;
+        float phi = 2.0f * PI * (s / 256) * 256 / strandsCount + 0.2f * sinf(time);
+        Vector3 root(sinf(theta) * cosf(phi) * 0.1f, cosf(theta) * 0.1f, sinf(theta) * sinf(phi) * 0.1f);
+        Vector3 direction = Vector3(root.x, 0.0f, root.z).Normalized();
+        float swing = 0.4f * sinf(2.0f * time + s * 0.01f);
+
+        auto strand = &vertices[(size_t)s * verticesPerStrand];
+        Vector3 position = root;
+        for (uint32_t v = 0; v < verticesPerStrand; v++) {
+            strand[v] = Vector4(position.x, position.y, position.z, v == 0 ? 0.0f : 1.0f);
+
+            float bend = swing * v / verticesPerStrand;
+            float wave = 0.3f * sinf(v * 1.3f + s * 0.7f);
+            Vector3 segment = direction * (0.3f + wave) + Vector3(sinf(bend), -1.0f, cosf(bend) * 0.2f);
+            position += segment.Normalized() * segmentLength;
+        }
+    }
+}
+
+void BenchmarkCodec(const char* name, const FrameSource& getFrame, uint32_t strandsCount, uint32_t verticesPerStrand, uint32_t framesCount)
+{
+    size_t frameVertices = (size_t)strandsCount * verticesPerStrand;
+    std::vector<Vector4> frame(frameVertices);
+
+    // vertices never get further from their root than the quantization range
+    float maxOffset = 0.0f;
+    for (uint32_t f = 0; f < framesCount; f++) {
+        getFrame(f, frame.data());
+        for (size_t i = 0; i < frameVertices; i++) {
+            auto& root = frame[i - i % verticesPerStrand];
+            for (int c = 0; c < 3; c++) {
+                maxOffset = (std::max)(maxOffset, fabsf(frame[i][c] - root[c]));
+            }
+        }
+    }
+
+    HairCodecSettings settings;
+    settings.quantizationStep = (std::max)(maxOffset * 1.1f / 32767.0f, 1e-7f);
+
+    printf("%s: %u strands, %u vertices per strand, %u frames, step %g\n", name, strandsCount, verticesPerStrand, framesCount, settings.quantizationStep);
+
+    uint32_t threadsCounts[] = { 1, 0 };
+    for (uint32_t threadsCount : threadsCounts) {
+        settings.threadsCount = threadsCount;
+        HairCodec encoder(strandsCount, verticesPerStrand, settings);
+        HairCodec decoder(strandsCount, verticesPerStrand, settings);
+
+        std::vector<uint8_t> data;
+        std::vector<Vector4> decoded(frameVertices);
+        double encodeTime = 0.0;
+        double decodeTime = 0.0;
+        size_t encodedSize = 0;
+        float maxError = 0.0f;
+
+        for (uint32_t f = 0; f < framesCount; f++) {
+            getFrame(f, frame.data());
+
+            auto start = std::chrono::high_resolution_clock::now();
+            encoder.Encode(frame.data(), f % 30 == 0, data);
+            auto encoded = std::chrono::high_resolution_clock::now();
+            decoder.Decode(data.data(), data.size(), decoded.data());
+            auto end = std::chrono::high_resolution_clock::now();
+
+            encodeTime += std::chrono::duration<double>(encoded - start).count();
+            decodeTime += std::chrono::duration<double>(end - encoded).count();
+            encodedSize += data.size();
+
+            for (size_t i = 0; i < frameVertices; i++) {
+                for (int c = 0; c < 4; c++) {
+                    maxError = (std::max)(maxError, fabsf(decoded[i][c] - frame[i][c]));
+                }
+            }
+        }
+
+        double rawSize = (double)frameVertices * sizeof(Vector4) * framesCount;
+        printf("  %s: ratio %.2f, %.2f bits per vertex, encode %.0f MB/s, decode %.0f MB/s, max error %g\n",
+            threadsCount == 1 ? "1 thread " : "all threads", rawSize / encodedSize, encodedSize * 8.0 / (frameVertices * framesCount),
+            rawSize / encodeTime / 1e6, rawSize / decodeTime / 1e6, maxError);
+    }
+}
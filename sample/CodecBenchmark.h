@@ -0,0 +1,19 @@
+#ifndef CODEC_BENCHMARK_H
+#define CODEC_BENCHMARK_H
+
+#include <hairsimulation/HairCodec.h>
+#include <functional>
+#include <vector>
+
+// Fills the vertices of one frame, laid out like a cache frame.
+typedef std::function<void(uint32_t frame, HairSimulation::Vector4* vertices)> FrameSource;
+
+// A frame of wavy strands swinging around their roots.
+void GenerateGroomFrame(uint32_t strandsCount, uint32_t verticesPerStrand, uint32_t frame, HairSimulation::Vector4* vertices);
+
+// Encodes and decodes every frame, once on one thread and once on all of them,
+// and prints the compression ratio, the throughput and the largest error. Frames
+// are fetched one at a time, so long sequences never have to fit in memory.
+void BenchmarkCodec(const char* name, const FrameSource& getFrame, uint32_t strandsCount, uint32_t verticesPerStrand, uint32_t framesCount);
+
+#endif
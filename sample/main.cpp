@@ -1,15 +1,20 @@
 #include "App.h"
 #include <iostream>
+#include <string.h>
 
-int main()
+int main(int argc, char** argv)
 {
     try {
         App application(1280, 720);
-        application.Run();
+        if (argc > 1 && strcmp(argv[1], "--codec-benchmark") == 0) {
+            application.RunCodecBenchmark(300);
+        } else {
+            application.Run();
+        }
     }
     catch (std::exception e) {
         std::cerr << e.what() << std::endl;
         return -1;
     }
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,124 @@
+#include "BufferPool.h"
+#include "gl/GLUtils.h"
+#include <algorithm>
+#include <stdexcept>
+
+namespace HairSimulation
+{
+    void BindBufferRange(uint32_t binding, const BufferRange& range)
+    {
+        if (range.buffID == 0) {
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, binding, 0);
+        } else {
+            glBindBufferRange(GL_SHADER_STORAGE_BUFFER, binding, range.buffID, range.offset, range.size);
+        }
+    }
+
+    void CopyBufferRange(const BufferRange& src, const BufferRange& dst, size_t size)
+    {
+        glBindBuffer(GL_COPY_READ_BUFFER, src.buffID);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, dst.buffID);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, src.offset, dst.offset, size);
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    }
+
+    BufferPool::BufferPool(size_t arenaSize, uint32_t usage) :
+        arenaSize(arenaSize),
+        alignment(16),
+        usage(usage)
+    {
+        GLint offsetAlignment = 0;
+        glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &offsetAlignment);
+        alignment = (std::max)(alignment, (size_t)offsetAlignment);
+    }
+
+    BufferPool::~BufferPool()
+    {
+        for (auto& arena : arenas) {
+            glDeleteBuffers(1, &arena.buffID);
+        }
+    }
+
+    BufferRange BufferPool::Allocate(size_t size)
+    {
+        BufferRange range = {};
+        if (size == 0) {
+            return range;
+        }
+
+        size_t alignedSize = (size + alignment - 1) / alignment * alignment;
+        for (auto& arena : arenas) {
+            if (AllocateFrom(arena, alignedSize, range)) {
+                range.size = size;
+                return range;
+            }
+        }
+
+        Arena arena = {};
+        arena.size = (std::max)(arenaSize, alignedSize);
+        arena.freeBlocks.push_back({ 0, arena.size });
+        glGenBuffers(1, &arena.buffID);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, arena.buffID);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, arena.size, nullptr, usage);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+        arenas.push_back(arena);
+        AllocateFrom(arenas.back(), alignedSize, range);
+        range.size = size;
+        return range;
+    }
+
+    bool BufferPool::AllocateFrom(Arena& arena, size_t size, BufferRange& range)
+    {
+        for (size_t i = 0; i < arena.freeBlocks.size(); i++) {
+            auto& block = arena.freeBlocks[i];
+            if (block.size < size) {
+                continue;
+            }
+
+            range.buffID = arena.buffID;
+            range.offset = block.offset;
+            block.offset += size;
+            block.size -= size;
+            if (block.size == 0) {
+                arena.freeBlocks.erase(arena.freeBlocks.begin() + i);
+            }
+            return true;
+        }
+        return false;
+    }
+
+    void BufferPool::Free(BufferRange& range)
+    {
+        if (range.buffID == 0) {
+            return;
+        }
+
+        auto arena = std::find_if(arenas.begin(), arenas.end(), [&](const Arena& arena) { return arena.buffID == range.buffID; });
+        if (arena == arenas.end()) {
+            throw std::runtime_error("Buffer range does not belong to the pool");
+        }
+
+        // free blocks are kept sorted by offset so neighbours can be merged
+        size_t alignedSize = (range.size + alignment - 1) / alignment * alignment;
+        auto& blocks = arena->freeBlocks;
+        auto next = std::lower_bound(blocks.begin(), blocks.end(), range.offset, [](const Block& block, size_t offset) { return block.offset < offset; });
+        next = blocks.insert(next, { range.offset, alignedSize });
+        if (next + 1 != blocks.end() && next->offset + next->size == (next + 1)->offset) {
+            next->size += (next + 1)->size;
+            blocks.erase(next + 1);
+        }
+        if (next != blocks.begin() && (next - 1)->offset + (next - 1)->size == next->offset) {
+            (next - 1)->size += next->size;
+            blocks.erase(next);
+        }
+        range = {};
+
+        auto isEmpty = [](const Arena& arena) { return arena.freeBlocks.size() == 1 && arena.freeBlocks[0].size == arena.size; };
+        if (isEmpty(*arena) && std::count_if(arenas.begin(), arenas.end(), isEmpty) > 1) {
+            glDeleteBuffers(1, &arena->buffID);
+            arenas.erase(arena);
+        }
+    }
+}
@@ -0,0 +1,58 @@
+#ifndef BUFFER_POOL_H
+#define BUFFER_POOL_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+namespace HairSimulation
+{
+    // Part of a pooled buffer, shaders see only the range when it is bound with
+    // BindBufferRange. A zero buffID is an empty range.
+    struct BufferRange
+    {
+        uint32_t buffID;
+        size_t offset;
+        size_t size;
+    };
+
+    void BindBufferRange(uint32_t binding, const BufferRange& range);
+    void CopyBufferRange(const BufferRange& src, const BufferRange& dst, size_t size);
+
+    // Sub-allocates shader storage from a few large arenas with a first fit free
+    // list, neighbouring free blocks are merged when a range is released. Ranges
+    // larger than the arena size get an arena of their own. One empty arena is
+    // kept for reuse, further ones are released.
+    class BufferPool
+    {
+    public:
+        BufferPool(size_t arenaSize, uint32_t usage);
+        BufferPool(const BufferPool&) = delete;
+        ~BufferPool();
+        BufferRange Allocate(size_t size);
+        void Free(BufferRange& range);
+
+    private:
+        struct Block
+        {
+            size_t offset;
+            size_t size;
+        };
+
+        struct Arena
+        {
+            uint32_t buffID;
+            size_t size;
+            std::vector<Block> freeBlocks;
+        };
+
+        std::vector<Arena> arenas;
+        size_t arenaSize;
+        size_t alignment;
+        uint32_t usage;
+
+        bool AllocateFrom(Arena& arena, size_t size, BufferRange& range);
+    };
+}
+
+#endif
@@ -0,0 +1,64 @@
+#include "CommandQueue.h"
+
+namespace HairSimulation
+{
+    CommandQueue::CommandQueue() :
+        head(&stub),
+        tail(&stub),
+        stub()
+    {
+        stub.next.store(nullptr, std::memory_order_relaxed);
+    }
+
+    // An instance whose creation is still queued has no GL resources yet and is
+    // only owned by its command.
+    CommandQueue::~CommandQueue()
+    {
+        while (auto command = Pop()) {
+            if (command->type == CommandType::CreateInstance) {
+                delete command->instance;
+            }
+            delete command;
+        }
+    }
+
+    void CommandQueue::Push(Command* command)
+    {
+        command->next.store(nullptr, std::memory_order_relaxed);
+        auto previous = head.exchange(command, std::memory_order_acq_rel);
+        previous->next.store(command, std::memory_order_release);
+    }
+
+    Command* CommandQueue::Pop()
+    {
+        auto first = tail;
+        auto next = first->next.load(std::memory_order_acquire);
+
+        if (first == &stub) {
+            if (next == nullptr) {
+                return nullptr;
+            }
+            tail = next;
+            first = next;
+            next = next->next.load(std::memory_order_acquire);
+        }
+
+        if (next != nullptr) {
+            tail = next;
+            return first;
+        }
+
+        // the last command can only be taken once the stub is queued behind it
+        if (first != head.load(std::memory_order_acquire)) {
+            return nullptr;
+        }
+
+        Push(&stub);
+        next = first->next.load(std::memory_order_acquire);
+        if (next != nullptr) {
+            tail = next;
+            return first;
+        }
+        return nullptr;
+    }
+}
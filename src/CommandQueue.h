@@ -0,0 +1,47 @@
+#ifndef COMMAND_QUEUE_H
+#define COMMAND_QUEUE_H
+
+#include "Common.h"
+#include <atomic>
+
+namespace HairSimulation
+{
+    enum class CommandType
+    {
+        CreateInstance,
+        UpdateInstanceSettings,
+        SimulateHair,
+        DestroyInstance
+    };
+
+    struct Command
+    {
+        std::atomic<Command*> next;
+        CommandType type;
+        HairInstance* instance;
+        const HairModel* model;
+        HairConfig config;
+        float timeStep;
+    };
+
+    // Intrusive multiple producer single consumer queue (Vyukov). Push is wait free
+    // and can be called from any thread, Pop only from the thread draining the queue.
+    // Pop returns nullptr while a push is halfway done, that command is picked up
+    // by the next drain.
+    class CommandQueue
+    {
+    public:
+        CommandQueue();
+        CommandQueue(const CommandQueue&) = delete;
+        ~CommandQueue();
+        void Push(Command* command);
+        Command* Pop();
+
+    private:
+        std::atomic<Command*> head;
+        Command* tail;
+        Command stub;
+    };
+}
+
+#endif
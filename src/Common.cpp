@@ -1,10 +1,16 @@
 #include "Common.h"
+#include <string.h>
+#include <stdexcept>
+#include <algorithm>
 
 namespace HairSimulation
 {
     std::string LoadFile(const char* path)
     {
         auto file = fopen(path, "rb");
+        if (file == nullptr) {
+            throw std::runtime_error(std::string("Cannot open file ") + path);
+        }
         fseek(file, 0, SEEK_END);
 
         int size = ftell(file);
@@ -16,4 +22,45 @@ namespace HairSimulation
         fclose(file);
         return str;
     }
-}
+
+    Vector3 TransformPoint(const Matrix4& matrix, const Vector3& point)
+    {
+        Vector3 result;
+        for (int j = 0; j < 3; j++) {
+            result[j] = matrix.m[0][j] * point.x + matrix.m[1][j] * point.y + matrix.m[2][j] * point.z + matrix.m[3][j];
+        }
+        return result;
+    }
+
+    float GetMaxScale(const Matrix4& matrix)
+    {
+        float maxScale = 0.0f;
+        for (int i = 0; i < 3; i++) {
+            maxScale = (std::max)(maxScale, matrix.m[i].XYZ().Length());
+        }
+        return maxScale;
+    }
+
+    // Rounds to the nearest half, values out of range become infinity and tiny
+    // values are flushed to zero.
+    uint16_t FloatToHalf(float value)
+    {
+        uint32_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+
+        uint16_t sign = (bits >> 16) & 0x8000;
+        int32_t exponent = (int32_t)((bits >> 23) & 0xff) - 127 + 15;
+        uint32_t mantissa = bits & 0x7fffff;
+
+        if (((bits >> 23) & 0xff) == 0xff) {
+            return sign | 0x7c00 | (mantissa != 0 ? 0x200 : 0);
+        }
+        if (exponent <= 0) {
+            return sign;
+        }
+
+        uint32_t half = ((uint32_t)exponent << 10) | (mantissa >> 13);
+        half += (mantissa >> 12) & 1;
+        return half >= 0x7c00 ? sign | 0x7c00 : sign | (uint16_t)half;
+    }
+}
\ No newline at end of file
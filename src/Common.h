@@ -3,7 +3,11 @@
 
 #include <stdint.h>
 #include <hairsimulation/HairTypes.h>
+#include <atomic>
 #include <string>
+#include <vector>
+#include "gl/GLUtils.h"
+#include "BufferPool.h"
 
 namespace HairSimulation
 {
@@ -13,25 +17,91 @@ namespace HairSimulation
         uint32_t segCount;
         uint32_t strandCount;
         uint32_t trianglesCount;
-        uint32_t restBuffID;
-        uint32_t tangentsBuffID;
-        uint32_t hairIndicesBuffID;
-        uint32_t refVecsBufferID;
-        uint32_t globalRotBuffID;
-        uint32_t debugBuffID;
+        Vector3 boundsMin;
+        Vector3 boundsMax;
+        float maxAreaWeight;
+        std::vector<Vector4> strandReach;
+        std::vector<uint32_t> fileStrandIndices;
+        std::vector<uint32_t> strandIndices;
+        bool compactStorage;
+        BufferRange restBuffer;
+        BufferRange tangentsBuffer;
+        BufferRange hairIndicesBuffer;
+        BufferRange refVecsBuffer;
+        BufferRange globalRotBuffer;
+        BufferRange debugBuffer;
+        BufferRange followersBuffer;
+        BufferRange followerCoordsBuffer;
+        uint32_t scalpIndicesBuffID;
+        uint32_t rootAttachmentsBuffID;
+        BufferRange movabilityBuffer;
+        BufferRange strandReachBuffer;
+        HairMemoryUsage memoryUsage;
+    };
+
+    class CacheRecorder;
+
+    class HairDistanceField
+    {
+    public:
+        uint32_t textureID;
+        Vector3 boundsMin;
+        Vector3 boundsMax;
+        HairMemoryUsage memoryUsage;
     };
 
     class HairInstance
     {
     public:
         const HairModel* model;
+        // polled from any thread, the error is written before the status turns failed
+        std::atomic<HairInstanceStatus> status;
+        std::string error;
         uint32_t frame;
-        uint32_t posBuffID;
-        uint32_t prevPosBuffID;
+        BufferRange posBuffer;
+        BufferRange prevPosBuffer;
+        uint32_t cullingCommandsBuffID;
+        uint32_t visibleTrianglesBuffID;
+        uint32_t hairGridAccumulationBuffID;
+        uint32_t hairGridBuffID;
+        std::vector<HairCollider> colliders;
+        uint32_t collidersBuffID;
+        uint32_t colliderMasksBuffID;
+        const HairDistanceField* distanceField;
+        Matrix4 distanceFieldTransform;
+        uint32_t scalpVerticesBuffID;
+        uint32_t rootTransformsBuffID;
+        CacheRecorder* cacheRecorder;
+        uint32_t cullingStatsBuffIDs[2];
+        mutable GLsync cullingStatsFences[2];
+        mutable uint32_t strandVerticesBuffID;
+        mutable size_t strandVerticesCapacity;
+        mutable bool geometryCaptured;
+        mutable uint32_t capturedFrame;
+        mutable uint32_t followerCacheBuffID;
+        mutable size_t followerCacheCapacity;
+        mutable uint32_t densityGridBuffID;
+        mutable uint32_t densityVolumeTexID;
+        mutable bool densityVolumeBuilt;
+        mutable uint32_t densityVolumeFrame;
+        mutable GPUTimer densityTimer;
+        mutable uint32_t renderedFrames;
+        mutable GPUTimer renderTimer;
+        GPUTimer simulationTimer;
+        mutable HairStatistics statistics;
+        mutable HairMemoryUsage memoryUsage;
         HairConfig config;
     };
 
     std::string LoadFile(const char* path);
+
+    // applies a column major transform, as uploaded to the shaders, to a point
+    Vector3 TransformPoint(const Matrix4& matrix, const Vector3& point);
+
+    // largest axis scale of a column major transform, bounds a sphere under non uniform scale
+    float GetMaxScale(const Matrix4& matrix);
+
+    uint16_t FloatToHalf(float value);
 }
 
 #endif
\ No newline at end of file
@@ -0,0 +1,268 @@
+#include "DistanceField.h"
+#include "Common.h"
+#include "TriangleBVH.h"
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <stdio.h>
+#include <math.h>
+#include <float.h>
+
+namespace HairSimulation
+{
+    namespace
+    {
+        constexpr uint32_t CacheMagic = 0x46445348;
+        constexpr uint32_t CacheVersion = 1;
+
+        // slightly skewed so parity rays rarely run exactly through edges
+        const Vector3 ParityRayDirection(0.9999f, 0.0101f, 0.0057f);
+
+        // Angle weighted pseudo normals, their sign test is exact for closed meshes
+        // wherever the nearest point lands (Baerentzen and Aanaes).
+        struct PseudoNormals
+        {
+            std::vector<Vector3> faces;
+            std::vector<Vector3> vertices;
+            std::vector<Vector3> edges;
+
+            PseudoNormals(const TriangleBVH& bvh, const HairMeshDescriptor& mesh) :
+                faces(mesh.trianglesCount),
+                vertices(mesh.verticesCount, Vector3(0, 0, 0)),
+                edges(mesh.trianglesCount * 3, Vector3(0, 0, 0))
+            {
+                std::unordered_map<uint64_t, Vector3> edgeSums;
+
+                for (uint32_t i = 0; i < mesh.trianglesCount; i++) {
+                    Vector3 corners[3] = { bvh.GetVertex(i, 0), bvh.GetVertex(i, 1), bvh.GetVertex(i, 2) };
+                    auto normal = Vector3::Cross(corners[1] - corners[0], corners[2] - corners[0]);
+                    faces[i] = normal.Length2() > 0.0f ? normal.Normalized() : Vector3(0, 0, 0);
+
+                    for (int j = 0; j < 3; j++) {
+                        auto e1 = corners[(j + 1) % 3] - corners[j];
+                        auto e2 = corners[(j + 2) % 3] - corners[j];
+                        float lengths = sqrtf(e1.Length2() * e2.Length2());
+                        float angle = lengths > 0.0f ? acosf((std::max)(-1.0f, (std::min)(Vector3::Dot(e1, e2) / lengths, 1.0f))) : 0.0f;
+                        vertices[mesh.indices[i * 3 + j]] += faces[i] * angle;
+                        edgeSums[GetEdgeKey(mesh, i, j)] += faces[i];
+                    }
+                }
+
+                for (uint32_t i = 0; i < mesh.trianglesCount; i++) {
+                    for (int j = 0; j < 3; j++) {
+                        edges[i * 3 + j] = edgeSums[GetEdgeKey(mesh, i, j)];
+                    }
+                }
+            }
+
+            Vector3 Get(const HairMeshDescriptor& mesh, const NearestTriangle& nearest) const
+            {
+                int triangle = nearest.triangle;
+                switch (nearest.feature) {
+                case VertexA:
+                case VertexB:
+                case VertexC:
+                    return vertices[mesh.indices[triangle * 3 + nearest.feature - VertexA]];
+                case EdgeAB:
+                case EdgeBC:
+                case EdgeCA:
+                    return edges[triangle * 3 + nearest.feature - EdgeAB];
+                default:
+                    return faces[triangle];
+                }
+            }
+
+            static uint64_t GetEdgeKey(const HairMeshDescriptor& mesh, uint32_t triangle, int edge)
+            {
+                uint64_t a = mesh.indices[triangle * 3 + edge];
+                uint64_t b = mesh.indices[triangle * 3 + (edge + 1) % 3];
+                return a < b ? (a << 32) | b : (b << 32) | a;
+            }
+        };
+
+        void HashBytes(uint64_t& hash, const void* data, size_t size)
+        {
+            auto bytes = (const uint8_t*)data;
+            for (size_t i = 0; i < size; i++) {
+                hash ^= bytes[i];
+                hash *= 0x100000001b3ull;
+            }
+        }
+    }
+
+    void BakeDistanceField(const HairMeshDescriptor& mesh, const HairDistanceFieldSettings& settings, DistanceFieldData& field)
+    {
+        Vector3 meshMin(FLT_MAX, FLT_MAX, FLT_MAX);
+        Vector3 meshMax(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+        for (uint32_t i = 0; i < mesh.verticesCount; i++) {
+            for (int j = 0; j < 3; j++) {
+                meshMin[j] = (std::min)(meshMin[j], mesh.vertices[i][j]);
+                meshMax[j] = (std::max)(meshMax[j], mesh.vertices[i][j]);
+            }
+        }
+
+        auto size = meshMax - meshMin;
+        float extent = (std::max)((std::max)(size.x, size.y), (std::max)(size.z, 1e-6f));
+        int padding = (int)settings.padding;
+        int innerResolution = (std::max)((int)settings.resolution - 2 * padding, 1);
+        float voxelSize = extent / innerResolution;
+
+        for (int i = 0; i < 3; i++) {
+            field.dims[i] = (std::min)((int)ceilf(size[i] / voxelSize), innerResolution) + 2 * padding;
+            field.dims[i] = (std::max)(field.dims[i], 1);
+            field.boundsMin[i] = meshMin[i] - padding * voxelSize;
+            field.boundsMax[i] = field.boundsMin[i] + field.dims[i] * voxelSize;
+        }
+
+        TriangleBVH bvh(mesh);
+        PseudoNormals pseudoNormals(bvh, mesh);
+        float band = (std::max)(settings.bandWidth, 1.0f) * voxelSize;
+        field.texels.resize((size_t)field.dims[0] * field.dims[1] * field.dims[2] * 4);
+
+        auto bakeSlice = [&](int z) {
+            for (int y = 0; y < field.dims[1]; y++) {
+                for (int x = 0; x < field.dims[0]; x++) {
+                    Vector3 position(field.boundsMin.x + (x + 0.5f) * voxelSize,
+                        field.boundsMin.y + (y + 0.5f) * voxelSize,
+                        field.boundsMin.z + (z + 0.5f) * voxelSize);
+
+                    Vector3 normal(0, 0, 0);
+                    float distance;
+
+                    // outside the band the exact distance doesn't matter, only the side
+                    NearestTriangle nearest;
+                    if (bvh.FindNearest(position, band, nearest)) {
+                        distance = sqrtf(nearest.distance2);
+                        auto offset = position - nearest.point;
+                        float side = Vector3::Dot(offset, pseudoNormals.Get(mesh, nearest)) >= 0.0f ? 1.0f : -1.0f;
+                        normal = distance > voxelSize * 1e-3f ? offset * (side / distance) : pseudoNormals.Get(mesh, nearest).Normalized();
+                        distance *= side;
+                    } else {
+                        distance = bvh.CountCrossings(position, ParityRayDirection) % 2 == 1 ? -band : band;
+                    }
+
+                    size_t texel = (((size_t)z * field.dims[1] + y) * field.dims[0] + x) * 4;
+                    field.texels[texel] = FloatToHalf(normal.x);
+                    field.texels[texel + 1] = FloatToHalf(normal.y);
+                    field.texels[texel + 2] = FloatToHalf(normal.z);
+                    field.texels[texel + 3] = FloatToHalf(distance);
+                }
+            }
+        };
+
+        int threadsCount = settings.threadsCount > 0 ? (int)settings.threadsCount : (int)std::thread::hardware_concurrency();
+        threadsCount = (std::max)(1, (std::min)(threadsCount, field.dims[2]));
+
+        // the first exception thrown by a worker is rethrown once all have stopped
+        std::atomic<int> nextSlice(0);
+        std::exception_ptr error;
+        std::mutex errorMutex;
+        auto worker = [&]() {
+            try {
+                for (int z = nextSlice++; z < field.dims[2]; z = nextSlice++) {
+                    bakeSlice(z);
+                }
+            }
+            catch (...) {
+                std::lock_guard<std::mutex> lock(errorMutex);
+                if (!error) {
+                    error = std::current_exception();
+                }
+                nextSlice = field.dims[2];
+            }
+        };
+
+        std::vector<std::thread> threads;
+        for (int i = 1; i < threadsCount; i++) {
+            threads.emplace_back(worker);
+        }
+        worker();
+        for (auto& thread : threads) {
+            thread.join();
+        }
+
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+
+    uint64_t GetDistanceFieldKey(const HairMeshDescriptor& mesh, const HairDistanceFieldSettings& settings)
+    {
+        uint64_t hash = 0xcbf29ce484222325ull;
+        for (uint32_t i = 0; i < mesh.verticesCount; i++) {
+            HashBytes(hash, &mesh.vertices[i].x, sizeof(float));
+            HashBytes(hash, &mesh.vertices[i].y, sizeof(float));
+            HashBytes(hash, &mesh.vertices[i].z, sizeof(float));
+        }
+        HashBytes(hash, mesh.indices, mesh.trianglesCount * 3 * sizeof(uint32_t));
+        HashBytes(hash, &settings.resolution, sizeof(settings.resolution));
+        HashBytes(hash, &settings.padding, sizeof(settings.padding));
+        HashBytes(hash, &settings.bandWidth, sizeof(settings.bandWidth));
+        return hash;
+    }
+
+    bool LoadDistanceField(const char* path, uint64_t key, DistanceFieldData& field)
+    {
+        auto file = fopen(path, "rb");
+        if (file == nullptr) {
+            return false;
+        }
+
+        uint32_t magic = 0;
+        uint32_t version = 0;
+        uint64_t fileKey = 0;
+        bool valid = fread(&magic, sizeof(magic), 1, file) == 1 && magic == CacheMagic &&
+            fread(&version, sizeof(version), 1, file) == 1 && version == CacheVersion &&
+            fread(&fileKey, sizeof(fileKey), 1, file) == 1 && fileKey == key &&
+            fread(&field.boundsMin, sizeof(float), 3, file) == 3 &&
+            fread(&field.boundsMax, sizeof(float), 3, file) == 3 &&
+            fread(field.dims, sizeof(int), 3, file) == 3;
+
+        for (int i = 0; valid && i < 3; i++) {
+            valid = field.dims[i] > 0 && field.dims[i] <= 4096;
+        }
+
+        if (valid) {
+            field.texels.resize((size_t)field.dims[0] * field.dims[1] * field.dims[2] * 4);
+            valid = fread(field.texels.data(), sizeof(uint16_t), field.texels.size(), file) == field.texels.size();
+        }
+
+        fclose(file);
+        return valid;
+    }
+
+    bool SaveDistanceField(const char* path, uint64_t key, const DistanceFieldData& field)
+    {
+        // written next to the cache and renamed at the end, so a failed write
+        // never leaves a truncated cache behind
+        std::string tempPath = std::string(path) + ".tmp";
+        auto file = fopen(tempPath.c_str(), "wb");
+        if (file == nullptr) {
+            return false;
+        }
+
+        bool written =
+            fwrite(&CacheMagic, sizeof(CacheMagic), 1, file) == 1 &&
+            fwrite(&CacheVersion, sizeof(CacheVersion), 1, file) == 1 &&
+            fwrite(&key, sizeof(key), 1, file) == 1 &&
+            fwrite(&field.boundsMin, sizeof(float), 3, file) == 3 &&
+            fwrite(&field.boundsMax, sizeof(float), 3, file) == 3 &&
+            fwrite(field.dims, sizeof(int), 3, file) == 3 &&
+            fwrite(field.texels.data(), sizeof(uint16_t), field.texels.size(), file) == field.texels.size();
+        written = fclose(file) == 0 && written;
+
+        if (written) {
+            // rename doesn't replace an existing file on Windows
+            remove(path);
+            written = rename(tempPath.c_str(), path) == 0;
+        }
+        if (!written) {
+            remove(tempPath.c_str());
+        }
+        return written;
+    }
+}
@@ -0,0 +1,27 @@
+#ifndef DISTANCE_FIELD_H
+#define DISTANCE_FIELD_H
+
+#include <hairsimulation/HairTypes.h>
+#include <vector>
+
+namespace HairSimulation
+{
+    // Signed distance to a closed triangle mesh sampled at voxel centers, four
+    // halfs per voxel holding the outward normal and the distance.
+    struct DistanceFieldData
+    {
+        Vector3 boundsMin;
+        Vector3 boundsMax;
+        int dims[3];
+        std::vector<uint16_t> texels;
+    };
+
+    void BakeDistanceField(const HairMeshDescriptor& mesh, const HairDistanceFieldSettings& settings, DistanceFieldData& field);
+
+    uint64_t GetDistanceFieldKey(const HairMeshDescriptor& mesh, const HairDistanceFieldSettings& settings);
+    // Saving is best effort, a cache that cannot be written only costs the bake next time.
+    bool LoadDistanceField(const char* path, uint64_t key, DistanceFieldData& field);
+    bool SaveDistanceField(const char* path, uint64_t key, const DistanceFieldData& field);
+}
+
+#endif
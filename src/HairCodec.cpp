@@ -0,0 +1,458 @@
+#include <hairsimulation/HairCodec.h>
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <stdexcept>
+#include <string.h>
+#include <math.h>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace HairSimulation
+{
+    namespace
+    {
+        constexpr int32_t RootLimit = 1 << 29;
+        constexpr int32_t OffsetLimit = 32767;
+        constexpr uint32_t MaxRiceParameter = 24;
+        constexpr uint32_t EscapeQuotient = 24;
+
+        struct FrameHeader
+        {
+            uint8_t keyframe;
+            uint8_t _padding[3];
+            uint32_t chunksCount;
+        };
+
+        uint32_t CountTrailingOnes(uint64_t value)
+        {
+            value = ~value;
+            if (value == 0) {
+                return 64;
+            }
+#ifdef _MSC_VER
+            unsigned long index;
+            _BitScanForward64(&index, value);
+            return index;
+#else
+            return (uint32_t)__builtin_ctzll(value);
+#endif
+        }
+
+        uint32_t ZigZag(int32_t value)
+        {
+            return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+        }
+
+        int32_t UnZigZag(uint32_t value)
+        {
+            return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+        }
+
+        int32_t Quantize(double value, int32_t limit)
+        {
+            return (int32_t)lround((std::max)((double)-limit, (std::min)(value, (double)limit)));
+        }
+
+        // Rice parameter close to the optimum for geometrically distributed residuals.
+        uint8_t GetRiceParameter(const std::vector<uint32_t>& values)
+        {
+            if (values.empty()) {
+                return 0;
+            }
+
+            uint64_t sum = 0;
+            for (uint32_t value : values) {
+                sum += value;
+            }
+
+            uint64_t mean = sum / values.size();
+            uint8_t parameter = 0;
+            while (parameter < MaxRiceParameter && (2ull << parameter) <= mean) {
+                parameter++;
+            }
+            return parameter;
+        }
+
+        class BitWriter
+        {
+        public:
+            BitWriter(std::vector<uint8_t>& output) :
+                output(output),
+                bits(0),
+                count(0)
+            {
+            }
+
+            void Write(uint32_t value, uint32_t bitsCount)
+            {
+                bits |= (uint64_t)value << count;
+                count += bitsCount;
+                while (count >= 8) {
+                    output.push_back((uint8_t)bits);
+                    bits >>= 8;
+                    count -= 8;
+                }
+            }
+
+            // The quotient is written in unary, values with a too long quotient are
+            // escaped and written in full.
+            void WriteRice(uint32_t value, uint32_t parameter)
+            {
+                uint32_t quotient = value >> parameter;
+                if (quotient >= EscapeQuotient) {
+                    Write((1u << EscapeQuotient) - 1, EscapeQuotient);
+                    Write(value, 32);
+                    return;
+                }
+
+                Write((1u << quotient) - 1, quotient + 1);
+                Write(value & ((1u << parameter) - 1), parameter);
+            }
+
+            void Flush()
+            {
+                if (count > 0) {
+                    output.push_back((uint8_t)bits);
+                }
+                bits = 0;
+                count = 0;
+            }
+
+        private:
+            std::vector<uint8_t>& output;
+            uint64_t bits;
+            uint32_t count;
+        };
+
+        class BitReader
+        {
+        public:
+            BitReader(const uint8_t* data, size_t size) :
+                data(data),
+                size(size),
+                position(0),
+                bits(0),
+                count(0)
+            {
+            }
+
+            uint32_t Read(uint32_t bitsCount)
+            {
+                if (count < bitsCount) {
+                    Refill();
+                    if (count < bitsCount) {
+                        throw std::runtime_error("Invalid hair codec frame");
+                    }
+                }
+
+                uint32_t value = (uint32_t)(bits & ((1ull << bitsCount) - 1));
+                bits >>= bitsCount;
+                count -= bitsCount;
+                return value;
+            }
+
+            uint32_t ReadRice(uint32_t parameter)
+            {
+                Refill();
+                uint32_t quotient = (std::min)(CountTrailingOnes(bits), count);
+                if (quotient >= EscapeQuotient) {
+                    Read(EscapeQuotient);
+                    return Read(32);
+                }
+                if (quotient == count) {
+                    throw std::runtime_error("Invalid hair codec frame");
+                }
+
+                Read(quotient + 1);
+                return (quotient << parameter) | Read(parameter);
+            }
+
+        private:
+            const uint8_t* data;
+            size_t size;
+            size_t position;
+            uint64_t bits;
+            uint32_t count;
+
+            void Refill()
+            {
+                while (count <= 56 && position < size) {
+                    bits |= (uint64_t)data[position++] << count;
+                    count += 8;
+                }
+            }
+        };
+
+        // Runs function(i) for every i below count on up to threadsCount threads,
+        // the first exception thrown by a worker is rethrown once all have stopped.
+        template <typename Function>
+        void ParallelFor(uint32_t count, uint32_t threadsCount, const Function& function)
+        {
+            uint32_t workersCount = threadsCount > 0 ? threadsCount : std::thread::hardware_concurrency();
+            workersCount = (std::max)(1u, (std::min)(workersCount, count));
+
+            std::atomic<uint32_t> next(0);
+            std::exception_ptr error;
+            std::mutex errorMutex;
+
+            auto worker = [&]() {
+                try {
+                    for (uint32_t i = next++; i < count; i = next++) {
+                        function(i);
+                    }
+                }
+                catch (...) {
+                    std::lock_guard<std::mutex> lock(errorMutex);
+                    if (!error) {
+                        error = std::current_exception();
+                    }
+                    next = count;
+                }
+            };
+
+            std::vector<std::thread> threads;
+            for (uint32_t i = 1; i < workersCount; i++) {
+                threads.emplace_back(worker);
+            }
+            worker();
+            for (auto& thread : threads) {
+                thread.join();
+            }
+
+            if (error) {
+                std::rethrow_exception(error);
+            }
+        }
+    }
+
+    HairCodec::HairCodec(uint32_t strandsCount, uint32_t verticesPerStrand, const HairCodecSettings& settings) :
+        strandsCount(strandsCount),
+        verticesPerStrand(verticesPerStrand),
+        quantizationStep(settings.quantizationStep),
+        threadsCount(settings.threadsCount),
+        hasPrevious(false),
+        roots(strandsCount * 3),
+        offsets(strandsCount * verticesPerStrand * 3),
+        movable(strandsCount * verticesPerStrand),
+        chunks((strandsCount + ChunkStrands - 1) / ChunkStrands)
+    {
+        if (!(quantizationStep > 0.0f)) {
+            throw std::runtime_error("Hair codec quantization step must be positive");
+        }
+        if (verticesPerStrand == 0) {
+            throw std::runtime_error("Hair codec strands need at least one vertex");
+        }
+    }
+
+    // The first frame after construction or Reset is always a keyframe.
+    void HairCodec::Encode(const Vector4* positions, bool keyframe, std::vector<uint8_t>& data)
+    {
+        keyframe |= !hasPrevious;
+        uint32_t chunksCount = (uint32_t)chunks.size();
+        ParallelFor(chunksCount, threadsCount, [&](uint32_t chunk) {
+            EncodeChunk(positions, keyframe, chunk);
+        });
+        hasPrevious = true;
+
+        FrameHeader header = {};
+        header.keyframe = keyframe ? 1 : 0;
+        header.chunksCount = chunksCount;
+
+        size_t size = sizeof(header) + chunksCount * sizeof(uint32_t);
+        for (auto& chunk : chunks) {
+            size += chunk.size();
+        }
+
+        data.resize(size);
+        auto output = data.data();
+        memcpy(output, &header, sizeof(header));
+        output += sizeof(header);
+        for (auto& chunk : chunks) {
+            uint32_t chunkSize = (uint32_t)chunk.size();
+            memcpy(output, &chunkSize, sizeof(chunkSize));
+            output += sizeof(chunkSize);
+        }
+        for (auto& chunk : chunks) {
+            memcpy(output, chunk.data(), chunk.size());
+            output += chunk.size();
+        }
+    }
+
+    void HairCodec::Decode(const uint8_t* data, size_t size, Vector4* positions)
+    {
+        FrameHeader header;
+        if (size < sizeof(header)) {
+            throw std::runtime_error("Invalid hair codec frame");
+        }
+        memcpy(&header, data, sizeof(header));
+
+        uint32_t chunksCount = (uint32_t)chunks.size();
+        if (header.chunksCount != chunksCount || size < sizeof(header) + chunksCount * sizeof(uint32_t)) {
+            throw std::runtime_error("Invalid hair codec frame");
+        }
+        if (!header.keyframe && !hasPrevious) {
+            throw std::runtime_error("Hair codec frame depends on a frame that wasn't decoded");
+        }
+
+        std::vector<size_t> chunkOffsets(chunksCount + 1);
+        chunkOffsets[0] = sizeof(header) + chunksCount * sizeof(uint32_t);
+        for (uint32_t i = 0; i < chunksCount; i++) {
+            uint32_t chunkSize;
+            memcpy(&chunkSize, data + sizeof(header) + i * sizeof(uint32_t), sizeof(chunkSize));
+            chunkOffsets[i + 1] = chunkOffsets[i] + chunkSize;
+        }
+        if (chunkOffsets[chunksCount] > size) {
+            throw std::runtime_error("Invalid hair codec frame");
+        }
+
+        // a frame that fails halfway leaves the state unusable for the next one
+        hasPrevious = false;
+        ParallelFor(chunksCount, threadsCount, [&](uint32_t chunk) {
+            DecodeChunk(data + chunkOffsets[chunk], chunkOffsets[chunk + 1] - chunkOffsets[chunk], header.keyframe != 0, chunk, positions);
+        });
+        hasPrevious = true;
+    }
+
+    void HairCodec::Reset()
+    {
+        hasPrevious = false;
+    }
+
+    // Keyframes predict each root from the previous strand and each offset by
+    // extending the previous segment, other frames add the motion of the previous
+    // vertex to the vertex of the previous frame.
+    void HairCodec::EncodeChunk(const Vector4* positions, bool keyframe, uint32_t chunk)
+    {
+        uint32_t first = chunk * ChunkStrands;
+        uint32_t last = (std::min)(first + ChunkStrands, strandsCount);
+        double step = quantizationStep;
+
+        std::vector<uint32_t> rootResiduals;
+        std::vector<uint32_t> offsetResiduals;
+        rootResiduals.reserve((last - first) * 3);
+        offsetResiduals.reserve((last - first) * (verticesPerStrand - 1) * 3);
+
+        for (uint32_t s = first; s < last; s++) {
+            auto strand = positions + s * verticesPerStrand;
+            auto root = &roots[s * 3];
+            auto offset = &offsets[s * verticesPerStrand * 3];
+
+            for (int c = 0; c < 3; c++) {
+                int32_t value = Quantize(strand[0][c] / step, RootLimit);
+                int32_t prediction = keyframe ? (s > first ? roots[(s - 1) * 3 + c] : 0) : root[c];
+                rootResiduals.push_back(ZigZag(value - prediction));
+                root[c] = value;
+
+                float rootPosition = (float)(value * step);
+                int32_t previous = 0;
+                int32_t previousOld = 0;
+                int32_t beforePrevious = 0;
+                for (uint32_t v = 1; v < verticesPerStrand; v++) {
+                    int32_t old = offset[v * 3 + c];
+                    value = Quantize((strand[v][c] - rootPosition) / step, OffsetLimit);
+                    prediction = keyframe ? (v > 1 ? 2 * previous - beforePrevious : 0) : old + previous - previousOld;
+                    offsetResiduals.push_back(ZigZag(value - prediction));
+                    offset[v * 3 + c] = (int16_t)value;
+
+                    beforePrevious = previous;
+                    previous = value;
+                    previousOld = old;
+                }
+            }
+
+            if (keyframe) {
+                for (uint32_t v = 0; v < verticesPerStrand; v++) {
+                    movable[s * verticesPerStrand + v] = strand[v].w > 0.0f ? 1 : 0;
+                }
+            }
+        }
+
+        auto& output = chunks[chunk];
+        output.clear();
+        output.push_back(GetRiceParameter(rootResiduals));
+        output.push_back(GetRiceParameter(offsetResiduals));
+
+        BitWriter writer(output);
+        if (keyframe) {
+            for (uint32_t i = first * verticesPerStrand; i < last * verticesPerStrand; i++) {
+                writer.Write(movable[i], 1);
+            }
+        }
+        for (uint32_t residual : rootResiduals) {
+            writer.WriteRice(residual, output[0]);
+        }
+        for (uint32_t residual : offsetResiduals) {
+            writer.WriteRice(residual, output[1]);
+        }
+        writer.Flush();
+    }
+
+    void HairCodec::DecodeChunk(const uint8_t* data, size_t size, bool keyframe, uint32_t chunk, Vector4* positions)
+    {
+        if (size < 2 || data[0] > MaxRiceParameter || data[1] > MaxRiceParameter) {
+            throw std::runtime_error("Invalid hair codec frame");
+        }
+
+        uint32_t first = chunk * ChunkStrands;
+        uint32_t last = (std::min)(first + ChunkStrands, strandsCount);
+        uint32_t rootParameter = data[0];
+        uint32_t offsetParameter = data[1];
+        double step = quantizationStep;
+
+        BitReader reader(data + 2, size - 2);
+        if (keyframe) {
+            for (uint32_t i = first * verticesPerStrand; i < last * verticesPerStrand; i++) {
+                movable[i] = (uint8_t)reader.Read(1);
+            }
+        }
+
+        // the encoder writes every root before the offsets
+        for (uint32_t s = first; s < last; s++) {
+            for (int c = 0; c < 3; c++) {
+                int32_t prediction = keyframe ? (s > first ? roots[(s - 1) * 3 + c] : 0) : roots[s * 3 + c];
+                int32_t value = prediction + UnZigZag(reader.ReadRice(rootParameter));
+                if (value < -RootLimit || value > RootLimit) {
+                    throw std::runtime_error("Invalid hair codec frame");
+                }
+                roots[s * 3 + c] = value;
+            }
+        }
+
+        for (uint32_t s = first; s < last; s++) {
+            auto strand = positions + s * verticesPerStrand;
+            auto offset = &offsets[s * verticesPerStrand * 3];
+
+            for (int c = 0; c < 3; c++) {
+                float rootPosition = (float)(roots[s * 3 + c] * step);
+                strand[0][c] = rootPosition;
+
+                int32_t previous = 0;
+                int32_t previousOld = 0;
+                int32_t beforePrevious = 0;
+                for (uint32_t v = 1; v < verticesPerStrand; v++) {
+                    int32_t old = offset[v * 3 + c];
+                    int32_t prediction = keyframe ? (v > 1 ? 2 * previous - beforePrevious : 0) : old + previous - previousOld;
+                    int32_t value = prediction + UnZigZag(reader.ReadRice(offsetParameter));
+                    if (value < -OffsetLimit || value > OffsetLimit) {
+                        throw std::runtime_error("Invalid hair codec frame");
+                    }
+                    offset[v * 3 + c] = (int16_t)value;
+                    strand[v][c] = rootPosition + (float)(value * step);
+
+                    beforePrevious = previous;
+                    previous = value;
+                    previousOld = old;
+                }
+            }
+
+            for (uint32_t v = 0; v < verticesPerStrand; v++) {
+                strand[v].w = movable[s * verticesPerStrand + v] ? 1.0f : 0.0f;
+            }
+        }
+    }
+}
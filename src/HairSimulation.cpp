@@ -1,19 +1,43 @@
 #include <hairsimulation/HairSimulation.h>
 #include <stdexcept>
+#include <exception>
 #include <vector>
+#include <algorithm>
+#include <float.h>
+#include <string.h>
 #include "gl/GLUtils.h"
 #include "Renderer.h"
+#include "SpatialGrid.h"
+#include "DistanceField.h"
+#include "TriangleBVH.h"
+#include "SimulationCache.h"
+#include "ModelLoader.h"
+#include "CommandQueue.h"
+#include "MemoryTracker.h"
+#include "shaders/ShaderTypes.h"
 
 namespace HairSimulation
 {
-    HairSimulationSystem::HairSimulationSystem() :
-        hairRenderer(nullptr)
+    // The shaders are built into the library. With a program cache path the linked
+    // programs are stored there and loaded on the next start instead of compiled.
+    HairSimulationSystem::HairSimulationSystem(const char* programCachePath) :
+        hairRenderer(nullptr),
+        memoryTracker(nullptr),
+        modelBufferPool(nullptr),
+        instanceBufferPool(nullptr),
+        modelLoader(nullptr),
+        commandQueue(nullptr)
     {
         if (!InitGL()) {
             throw std::runtime_error("Cannot initialize OpenGL resources.");
         }
 
-        hairRenderer = new HairRenderer();
+        memoryTracker = new MemoryTracker();
+        hairRenderer = new HairRenderer(memoryTracker, programCachePath);
+        modelBufferPool = new BufferPool(ModelArenaSize, GL_STATIC_DRAW);
+        instanceBufferPool = new BufferPool(InstanceArenaSize, GL_DYNAMIC_DRAW);
+        modelLoader = new ModelLoader(modelBufferPool, memoryTracker);
+        commandQueue = new CommandQueue();
     }
 
 
@@ -33,20 +57,23 @@ namespace HairSimulation
         }
     }
 
+    // Strands are walked side by side, the same segment of every strand is
+    // rotated into its parent frame and aligned in one batch.
     void UpdateRotationBuffers(const std::vector<Vector4>& vertices, int segmentsPerStrand, std::vector<Quaternion>& globalRotations, std::vector<Vector4>& refVectors)
     {
         globalRotations.resize(vertices.size());
         refVectors.resize(vertices.size());
-        std::vector<Quaternion> localRotations(vertices.size());
 
+        size_t strandsCount = vertices.size() / segmentsPerStrand;
+        std::vector<Vector3> tangents(strandsCount);
+        for (size_t strandIndex = 0; strandIndex < strandsCount; strandIndex++) {
+            size_t rootIndex = strandIndex * segmentsPerStrand;
+            tangents[strandIndex] = vertices[rootIndex + 1].XYZ() - vertices[rootIndex].XYZ();
+        }
+        NormalizeVectors(tangents.data(), tangents.data(), strandsCount);
 
-        for (int strandIndex = 0; strandIndex < vertices.size() / segmentsPerStrand; strandIndex++) {
-            int rootIndex = strandIndex * segmentsPerStrand;
-
-            auto position = vertices[rootIndex].XYZ();
-            auto positionNext = vertices[rootIndex + 1].XYZ();
-            auto tangent = positionNext - position;
-            auto tangentX = tangent.Normalized();
+        for (size_t strandIndex = 0; strandIndex < strandsCount; strandIndex++) {
+            auto tangentX = tangents[strandIndex];
             auto tangentZ = Vector3::Cross(tangentX, Vector3(1.0f, 0, 0));
 
             if (tangentZ.Length() < 0.0001f) {
@@ -67,31 +94,355 @@ namespace HairSimulation
             rotationMatrix.m[2][1] = tangentY[2];
             rotationMatrix.m[2][2] = tangentZ[2];
 
-            globalRotations[rootIndex] = localRotations[rootIndex] = Quaternion::FromMatrix(rotationMatrix);
+            globalRotations[strandIndex * segmentsPerStrand] = Quaternion::FromMatrix(rotationMatrix);
+        }
+
+        std::vector<Vector3> axisX(strandsCount, Vector3(1.0f, 0, 0));
+        std::vector<Quaternion> parentInversed(strandsCount);
+        std::vector<Quaternion> localRotations(strandsCount);
+
+        for (int i = 1; i < segmentsPerStrand; i++) {
+            for (size_t strandIndex = 0; strandIndex < strandsCount; strandIndex++) {
+                size_t index = strandIndex * segmentsPerStrand + i;
+                tangents[strandIndex] = vertices[index].XYZ() - vertices[index - 1].XYZ();
+                parentInversed[strandIndex] = globalRotations[index - 1].Inversed();
+            }
+
+            RotateVectors(parentInversed.data(), tangents.data(), tangents.data(), strandsCount);
+            RotationsBetween(axisX.data(), tangents.data(), localRotations.data(), strandsCount);
+
+            for (size_t strandIndex = 0; strandIndex < strandsCount; strandIndex++) {
+                size_t index = strandIndex * segmentsPerStrand + i;
+                auto& tangentLocal = tangents[strandIndex];
+                globalRotations[index] = globalRotations[index - 1] * localRotations[strandIndex];
+                refVectors[index] = Vector4(tangentLocal.x, tangentLocal.y, tangentLocal.z, 0.0f);
+            }
+        }
+    }
+
+    Vector4 CalculateSkinningWeights(const Vector3& position, const Vector3& a, const Vector3& b, const Vector3& c)
+    {
+        auto ab = b - a;
+        auto ac = c - a;
+        auto ap = position - a;
+
+        float d00 = Vector3::Dot(ab, ab);
+        float d01 = Vector3::Dot(ab, ac);
+        float d11 = Vector3::Dot(ac, ac);
+        float d20 = Vector3::Dot(ap, ab);
+        float d21 = Vector3::Dot(ap, ac);
+        float denominator = d00 * d11 - d01 * d01;
+
+        if (denominator > 1e-6f * d00 * d11) {
+            float v = (std::max)((d11 * d20 - d01 * d21) / denominator, 0.0f);
+            float w = (std::max)((d00 * d21 - d01 * d20) / denominator, 0.0f);
+            float u = (std::max)(1.0f - v - w, 0.0f);
+            float sum = u + v + w;
+            if (sum > 0.0f) {
+                return Vector4(u / sum, v / sum, w / sum, 0.0f);
+            }
+        }
+
+        // guides are collinear, fall back to inverse distance weights
+        float wa = 1.0f / (std::max)((position - a).Length(), 1e-6f);
+        float wb = 1.0f / (std::max)((position - b).Length(), 1e-6f);
+        float wc = 1.0f / (std::max)((position - c).Length(), 1e-6f);
+        float sum = wa + wb + wc;
+        return Vector4(wa / sum, wb / sum, wc / sum, 0.0f);
+    }
+
+    void UpdateFollowerBuffers(const std::vector<Vector4>& vertices, int segmentsPerStrand, std::vector<FollowerData>& followers)
+    {
+        int strandCount = vertices.size() / segmentsPerStrand;
+        followers.resize((SIMULATION_LOD_LEVELS - 1) * strandCount);
+
+        std::vector<Vector3> roots(strandCount);
+        Vector3 boundsMin(FLT_MAX, FLT_MAX, FLT_MAX);
+        Vector3 boundsMax(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+        for (int strandIndex = 0; strandIndex < strandCount; strandIndex++) {
+            roots[strandIndex] = vertices[strandIndex * segmentsPerStrand].XYZ();
+            for (int i = 0; i < 3; i++) {
+                boundsMin[i] = (std::min)(boundsMin[i], roots[strandIndex][i]);
+                boundsMax[i] = (std::max)(boundsMax[i], roots[strandIndex][i]);
+            }
+        }
+
+        // on level L every (1 << L)-th strand is simulated, the others are skinned
+        // to their three nearest simulated strands
+        for (int level = 1; level < SIMULATION_LOD_LEVELS; level++) {
+            int stride = 1 << level;
+            auto levelFollowers = &followers[(level - 1) * strandCount];
 
-            for (int i = 1; i < segmentsPerStrand; i++) {
-                auto positionPrev = vertices[rootIndex + i - 1].XYZ();
-                position = vertices[rootIndex + i].XYZ();
-                tangent = position - positionPrev;
-                auto tangentLocal = globalRotations[rootIndex + i - 1].Inversed() * tangent;
+            std::vector<Vector3> guideRoots;
+            for (int strandIndex = 0; strandIndex < strandCount; strandIndex += stride) {
+                guideRoots.push_back(roots[strandIndex]);
+            }
+
+            SpatialGrid grid(guideRoots, boundsMin, boundsMax);
 
-                tangentX = tangentLocal.Normalized();
-                Vector3 axisX(1.0f, 0, 0);
-                auto rotationAxis = Vector3::Cross(axisX, tangentX);
-                float angle = acos(Vector3::Dot(axisX, tangentX));
+            for (int strandIndex = 0; strandIndex < strandCount; strandIndex++) {
+                auto& follower = levelFollowers[strandIndex];
 
-                if (abs(angle) > 0.001 && rotationAxis.Length2() > 0.001) {
-                    rotationAxis.Normalize();
-                    localRotations[rootIndex + i] = Quaternion(rotationAxis, angle);
+                int nearest[3] = {};
+                int found = strandIndex % stride == 0 ? 0 : grid.FindNearest(roots[strandIndex], nearest, 3);
+                if (found == 0) {
+                    nearest[0] = strandIndex / stride;
                 }
-                else {
-                    localRotations[rootIndex + i] = Quaternion();
+
+                for (int i = found; i < 3; i++) {
+                    nearest[i] = nearest[0];
+                }
+
+                follower.weights = found < 3 ?
+                    Vector4(1.0f, 0.0f, 0.0f, 0.0f) :
+                    CalculateSkinningWeights(roots[strandIndex], guideRoots[nearest[0]], guideRoots[nearest[1]], guideRoots[nearest[2]]);
+
+                for (int i = 0; i < 3; i++) {
+                    follower.guideIndices[i] = nearest[i] * stride;
                 }
+                follower.guideIndices[3] = 0;
+            }
+        }
+    }
+
+    void UpdateFollowerCoordsBuffer(std::vector<Vector4>& followerCoords)
+    {
+        followerCoords.resize(MAX_HAIRS_PER_TRIANGLE);
+
+        // R2 low discrepancy sequence folded into the triangle, any prefix of it
+        // is evenly spread so lowering the density removes hairs uniformly
+        const float g = 1.32471795724474602596f;
+        const float a1 = 1.0f / g;
+        const float a2 = 1.0f / (g * g);
+
+        for (int i = 0; i < MAX_HAIRS_PER_TRIANGLE; i++) {
+            float u = fmodf(0.5f + a1 * i, 1.0f);
+            float v = fmodf(0.5f + a2 * i, 1.0f);
+            if (u + v > 1.0f) {
+                u = 1.0f - u;
+                v = 1.0f - v;
+            }
+            followerCoords[i] = Vector4(u, v, 1.0f - u - v, 0.0f);
+        }
+    }
+
+    // Stores the area of every root triangle relative to the mean area as float
+    // bits in the unused fourth index, returns the largest weight.
+    float UpdateAreaWeights(const std::vector<Vector4>& vertices, int verticesPerStrand, std::vector<int>& triangles)
+    {
+        size_t trianglesCount = triangles.size() / 4;
+        std::vector<float> areas(trianglesCount);
+        double totalArea = 0.0;
+
+        for (size_t i = 0; i < trianglesCount; i++) {
+            auto a = vertices[triangles[i * 4] * verticesPerStrand].XYZ();
+            auto b = vertices[triangles[i * 4 + 1] * verticesPerStrand].XYZ();
+            auto c = vertices[triangles[i * 4 + 2] * verticesPerStrand].XYZ();
+            areas[i] = Vector3::Cross(b - a, c - a).Length() * 0.5f;
+            totalArea += areas[i];
+        }
+
+        float meanArea = trianglesCount > 0 ? (float)(totalArea / trianglesCount) : 0.0f;
+        float maxWeight = 1.0f;
+
+        for (size_t i = 0; i < trianglesCount; i++) {
+            float weight = meanArea > 0.0f ? areas[i] / meanArea : 1.0f;
+            memcpy(&triangles[i * 4 + 3], &weight, sizeof(float));
+            maxWeight = (std::max)(maxWeight, weight);
+        }
+
+        return maxWeight;
+    }
+
+    uint32_t SpreadBits(uint32_t value)
+    {
+        value &= 0x3ff;
+        value = (value | (value << 16)) & 0x030000ff;
+        value = (value | (value << 8)) & 0x0300f00f;
+        value = (value | (value << 4)) & 0x030c30c3;
+        value = (value | (value << 2)) & 0x09249249;
+        return value;
+    }
+
+    // 30 bit Morton code of a point on a 1024^3 grid over the bounds
+    uint32_t GetMortonCode(const Vector3& point, const Vector3& boundsMin, const Vector3& boundsMax)
+    {
+        uint32_t code = 0;
+        for (int i = 0; i < 3; i++) {
+            float size = (std::max)(boundsMax[i] - boundsMin[i], 1e-6f);
+            float cell = (std::min)((std::max)((point[i] - boundsMin[i]) / size * 1024.0f, 0.0f), 1023.0f);
+            code |= SpreadBits((uint32_t)cell) << i;
+        }
+        return code;
+    }
+
+    // Sorts strands by the Morton code of their root and root triangles by the code
+    // of their centroid, triangle indices are remapped to the new strand order.
+    // fileStrandIndices[i] is the index in the file of strand i.
+    void ReorderStrands(std::vector<Vector4>& vertices, int verticesPerStrand, std::vector<int>& triangles, std::vector<uint32_t>& fileStrandIndices)
+    {
+        size_t strandsCount = vertices.size() / verticesPerStrand;
+        Vector3 boundsMin(FLT_MAX, FLT_MAX, FLT_MAX);
+        Vector3 boundsMax(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+        for (size_t i = 0; i < strandsCount; i++) {
+            for (int j = 0; j < 3; j++) {
+                boundsMin[j] = (std::min)(boundsMin[j], vertices[i * verticesPerStrand][j]);
+                boundsMax[j] = (std::max)(boundsMax[j], vertices[i * verticesPerStrand][j]);
+            }
+        }
+
+        std::vector<uint32_t> codes(strandsCount);
+        fileStrandIndices.resize(strandsCount);
+        for (size_t i = 0; i < strandsCount; i++) {
+            codes[i] = GetMortonCode(vertices[i * verticesPerStrand].XYZ(), boundsMin, boundsMax);
+            fileStrandIndices[i] = (uint32_t)i;
+        }
+        std::stable_sort(fileStrandIndices.begin(), fileStrandIndices.end(), [&](uint32_t a, uint32_t b) { return codes[a] < codes[b]; });
+
+        std::vector<Vector4> sortedVertices(vertices.size());
+        std::vector<int> strandIndices(strandsCount);
+        for (size_t i = 0; i < strandsCount; i++) {
+            uint32_t fileIndex = fileStrandIndices[i];
+            std::copy_n(&vertices[fileIndex * verticesPerStrand], verticesPerStrand, &sortedVertices[i * verticesPerStrand]);
+            strandIndices[fileIndex] = (int)i;
+        }
+        vertices.swap(sortedVertices);
+
+        size_t trianglesCount = triangles.size() / 4;
+        std::vector<uint32_t> triangleCodes(trianglesCount);
+        std::vector<uint32_t> triangleOrder(trianglesCount);
+        for (size_t i = 0; i < trianglesCount; i++) {
+            Vector3 centroid(0, 0, 0);
+            for (int j = 0; j < 3; j++) {
+                int& index = triangles[i * 4 + j];
+                index = strandIndices[index];
+                centroid += vertices[index * verticesPerStrand].XYZ() / 3.0f;
+            }
+            triangleCodes[i] = GetMortonCode(centroid, boundsMin, boundsMax);
+            triangleOrder[i] = (uint32_t)i;
+        }
+        std::stable_sort(triangleOrder.begin(), triangleOrder.end(), [&](uint32_t a, uint32_t b) { return triangleCodes[a] < triangleCodes[b]; });
+
+        std::vector<int> sortedTriangles(triangles.size());
+        for (size_t i = 0; i < trianglesCount; i++) {
+            std::copy_n(&triangles[triangleOrder[i] * 4], 4, &sortedTriangles[i * 4]);
+        }
+        triangles.swap(sortedTriangles);
+    }
+
+    // Root position and length of every strand, no vertex of a strand can get
+    // further from its root than that.
+    void UpdateStrandReach(const std::vector<Vector4>& vertices, int verticesPerStrand, std::vector<Vector4>& strandReach)
+    {
+        size_t strandsCount = vertices.size() / verticesPerStrand;
+        strandReach.resize(strandsCount);
+
+        for (size_t i = 0; i < strandsCount; i++) {
+            auto root = vertices[i * verticesPerStrand].XYZ();
+            float length = 0.0f;
+            for (int j = 1; j < verticesPerStrand; j++) {
+                length += (vertices[i * verticesPerStrand + j].XYZ() - vertices[i * verticesPerStrand + j - 1].XYZ()).Length();
+            }
+            strandReach[i] = Vector4(root.x, root.y, root.z, length);
+        }
+    }
+
+    // Frame of a scalp triangle, x along the first edge and z along the normal.
+    // HairRootSkinning.comp builds the same frame from the deformed triangle.
+    Quaternion GetTriangleFrame(const Vector3& a, const Vector3& b, const Vector3& c)
+    {
+        auto axisZ = Vector3::Cross(b - a, c - a);
+        if (axisZ.Length2() == 0.0f) {
+            return Quaternion();
+        }
 
-                globalRotations[rootIndex + i] = globalRotations[rootIndex + i - 1] * localRotations[rootIndex + i];
-                refVectors[rootIndex + i] = Vector4(tangentLocal.x, tangentLocal.y, tangentLocal.z, 0.0f);
+        auto axisX = (b - a).Normalized();
+        axisZ.Normalize();
+        auto axisY = Vector3::Cross(axisZ, axisX);
+
+        Matrix3 rotationMatrix;
+        for (int i = 0; i < 3; i++) {
+            rotationMatrix.m[i][0] = axisX[i];
+            rotationMatrix.m[i][1] = axisY[i];
+            rotationMatrix.m[i][2] = axisZ[i];
+        }
+        return Quaternion::FromMatrix(rotationMatrix);
+    }
+
+    void UpdateRootAttachments(const HairModel* model, const HairMeshDescriptor& scalp, std::vector<RootAttachment>& attachments)
+    {
+        TriangleBVH bvh(scalp);
+        attachments.resize(model->strandCount);
+
+        for (uint32_t i = 0; i < model->strandCount; i++) {
+            auto root = model->strandReach[i].XYZ();
+            NearestTriangle nearest;
+            bvh.FindNearest(root, FLT_MAX, nearest);
+
+            auto a = bvh.GetVertex(nearest.triangle, 0);
+            auto b = bvh.GetVertex(nearest.triangle, 1);
+            auto c = bvh.GetVertex(nearest.triangle, 2);
+            auto barycentrics = TriangleBVH::GetBarycentrics(nearest.point, a, b, c);
+            auto frameInverse = GetTriangleFrame(a, b, c).Inversed();
+            auto offset = frameInverse * (root - nearest.point);
+
+            auto& attachment = attachments[i];
+            attachment.triangle = nearest.triangle;
+            attachment.u = barycentrics.y;
+            attachment.v = barycentrics.z;
+            attachment._padding = 0.0f;
+            attachment.offset = Vector4(offset.x, offset.y, offset.z, 0.0f);
+            attachment.restFrameInverse = Vector4(frameInverse.x, frameInverse.y, frameInverse.z, frameInverse.w);
+        }
+    }
+
+    template <typename T>
+    void AddModelBuffer(ModelData& data, BufferRange HairModel::* buffer, const std::vector<T>& values)
+    {
+        auto bytes = (const uint8_t*)values.data();
+        data.buffers.push_back({ buffer, values.size() * sizeof(T), std::vector<uint8_t>(bytes, bytes + values.size() * sizeof(T)) });
+    }
+
+    // Packs the rest data for the COMPACT_STORAGE shader variant: three floats per
+    // rest position, a movability bit per vertex, the rest length alone and halfs
+    // for the reference vectors and rotations. No debug buffer is allocated.
+    void PackCompactRestData(ModelData& data, const std::vector<Vector4>& vertices, const std::vector<Vector4>& tangents,
+        const std::vector<Vector4>& refVecs, const std::vector<Quaternion>& globalRotations)
+    {
+        std::vector<float> restPositions(vertices.size() * 3);
+        std::vector<uint32_t> movability((vertices.size() + 31) / 32, 0);
+        for (size_t i = 0; i < vertices.size(); i++) {
+            restPositions[i * 3] = vertices[i].x;
+            restPositions[i * 3 + 1] = vertices[i].y;
+            restPositions[i * 3 + 2] = vertices[i].z;
+            if (vertices[i].w > 0.0f) {
+                movability[i / 32] |= 1u << (i % 32);
             }
         }
+
+        std::vector<float> restLengths(tangents.size());
+        for (size_t i = 0; i < tangents.size(); i++) {
+            restLengths[i] = tangents[i].w;
+        }
+
+        std::vector<uint32_t> halfRefVecs(refVecs.size() * 2);
+        for (size_t i = 0; i < refVecs.size(); i++) {
+            halfRefVecs[i * 2] = FloatToHalf(refVecs[i].x) | (uint32_t)FloatToHalf(refVecs[i].y) << 16;
+            halfRefVecs[i * 2 + 1] = FloatToHalf(refVecs[i].z);
+        }
+
+        std::vector<uint32_t> halfRotations(globalRotations.size() * 2);
+        for (size_t i = 0; i < globalRotations.size(); i++) {
+            halfRotations[i * 2] = FloatToHalf(globalRotations[i].x) | (uint32_t)FloatToHalf(globalRotations[i].y) << 16;
+            halfRotations[i * 2 + 1] = FloatToHalf(globalRotations[i].z) | (uint32_t)FloatToHalf(globalRotations[i].w) << 16;
+        }
+
+        data.compactStorage = true;
+        AddModelBuffer(data, &HairModel::restBuffer, restPositions);
+        AddModelBuffer(data, &HairModel::movabilityBuffer, movability);
+        AddModelBuffer(data, &HairModel::tangentsBuffer, restLengths);
+        AddModelBuffer(data, &HairModel::refVecsBuffer, halfRefVecs);
+        AddModelBuffer(data, &HairModel::globalRotBuffer, halfRotations);
     }
 
     void HairSimulationSystem::RenderHair(const HairInstance* instance, const Matrix4& viewMatrix, const Matrix4& projectionMatrix) const
@@ -99,13 +450,274 @@ namespace HairSimulation
         hairRenderer->Render(instance, viewMatrix, projectionMatrix);
     }
 
+    void HairSimulationSystem::RenderHair(const HairInstance* instance, const HairRenderPass* passes, uint32_t passesCount) const
+    {
+        hairRenderer->Render(instance, passes, passesCount);
+    }
+
+    void HairSimulationSystem::RenderHairMultiView(const HairInstance* instance, const HairRenderPass* views, uint32_t viewsCount) const
+    {
+        hairRenderer->RenderMultiView(instance, views, viewsCount);
+    }
+
+    void HairSimulationSystem::SetOcclusionDepth(uint32_t depthTextureID, uint32_t width, uint32_t height) const
+    {
+        hairRenderer->BuildOcclusionPyramid(depthTextureID, width, height);
+    }
+
+    void HairSimulationSystem::SetLights(const HairLight* lights, uint32_t lightsCount) const
+    {
+        if (lightsCount > MAX_LIGHTS) {
+            throw std::runtime_error("Too many hair lights, the limit is " + std::to_string(MAX_LIGHTS));
+        }
+        hairRenderer->SetLights(lights, lightsCount);
+    }
+
+    void HairSimulationSystem::SetColliders(HairInstance* instance, const HairCollider* colliders, uint32_t collidersCount) const
+    {
+        if (collidersCount > MAX_COLLIDERS) {
+            throw std::runtime_error("Too many hair colliders, the limit is " + std::to_string(MAX_COLLIDERS));
+        }
+
+        instance->colliders.assign(colliders, colliders + collidersCount);
+
+        // the candidate masks, two words per strand, are rebuilt on the GPU every step
+        if (instance->collidersBuffID == 0) {
+            size_t masksSize = instance->model->strandCount * 2 * sizeof(uint32_t);
+
+            glGenBuffers(1, &instance->collidersBuffID);
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, instance->collidersBuffID);
+            glBufferData(GL_SHADER_STORAGE_BUFFER, MAX_COLLIDERS * sizeof(Collider), nullptr, GL_DYNAMIC_DRAW);
+
+            glGenBuffers(1, &instance->colliderMasksBuffID);
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, instance->colliderMasksBuffID);
+            glBufferData(GL_SHADER_STORAGE_BUFFER, masksSize, nullptr, GL_DYNAMIC_DRAW);
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+            memoryTracker->Add(&instance->memoryUsage, &HairMemoryUsage::dynamicData, MAX_COLLIDERS * sizeof(Collider) + masksSize);
+        }
+    }
+
+    // Only moves the colliders, the candidate masks follow at the next simulation step.
+    void HairSimulationSystem::UpdateColliderTransforms(HairInstance* instance, const Matrix4* transforms, uint32_t transformsCount) const
+    {
+        if (transformsCount != instance->colliders.size()) {
+            throw std::runtime_error("Collider transforms count does not match the colliders count");
+        }
+
+        for (uint32_t i = 0; i < transformsCount; i++) {
+            instance->colliders[i].transform = transforms[i];
+        }
+    }
+
+    HairDistanceField* HairSimulationSystem::BakeDistanceField(const HairMeshDescriptor& mesh, const HairDistanceFieldSettings& settings) const
+    {
+        for (uint32_t i = 0; i < mesh.trianglesCount * 3; i++) {
+            if (mesh.indices[i] >= mesh.verticesCount) {
+                throw std::runtime_error("Invalid distance field mesh, vertex index out of range");
+            }
+        }
+
+        DistanceFieldData data;
+        uint64_t key = 0;
+        bool cached = false;
+        if (settings.cachePath != nullptr) {
+            key = GetDistanceFieldKey(mesh, settings);
+            cached = LoadDistanceField(settings.cachePath, key, data);
+        }
+
+        if (!cached) {
+            HairSimulation::BakeDistanceField(mesh, settings, data);
+            if (settings.cachePath != nullptr) {
+                SaveDistanceField(settings.cachePath, key, data);
+            }
+        }
+
+        auto field = new HairDistanceField();
+        field->boundsMin = data.boundsMin;
+        field->boundsMax = data.boundsMax;
+
+        glGenTextures(1, &field->textureID);
+        glBindTexture(GL_TEXTURE_3D, field->textureID);
+        glTexStorage3D(GL_TEXTURE_3D, 1, GL_RGBA16F, data.dims[0], data.dims[1], data.dims[2]);
+        glTexSubImage3D(GL_TEXTURE_3D, 0, 0, 0, 0, data.dims[0], data.dims[1], data.dims[2], GL_RGBA, GL_HALF_FLOAT, data.texels.data());
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+        glBindTexture(GL_TEXTURE_3D, 0);
+        memoryTracker->Add(&field->memoryUsage, &HairMemoryUsage::restData, data.texels.size() * sizeof(uint16_t));
+
+        return field;
+    }
+
+    void HairSimulationSystem::DestroyDistanceField(HairDistanceField* field) const
+    {
+        glDeleteTextures(1, &field->textureID);
+        memoryTracker->Release(field->memoryUsage);
+        delete field;
+    }
+
+    // The field is placed in the space of the hair model by transform, a null
+    // field disables the distance field collisions of the instance.
+    void HairSimulationSystem::SetDistanceField(HairInstance* instance, const HairDistanceField* field, const Matrix4& transform) const
+    {
+        instance->distanceField = field;
+        instance->distanceFieldTransform = transform;
+    }
+
+    HairStatistics HairSimulationSystem::GetStatistics(const HairInstance* instance) const
+    {
+        auto statistics = instance->statistics;
+        statistics.simulationTime = instance->simulationTimer.GetTime();
+        statistics.renderTime = instance->renderTimer.GetTime();
+        statistics.selfShadowTime = instance->densityTimer.GetTime();
+        return statistics;
+    }
+
+    // Limits the GPU memory of all models, instances and distance fields, 0 is
+    // unlimited. CreateInstance fails when the simulation data of the instance does
+    // not fit, render caches that do not fit lower the hair density of the instance
+    // and self shadowing or hair interaction are skipped.
+    void HairSimulationSystem::SetMemoryBudget(uint64_t bytes) const
+    {
+        memoryTracker->SetBudget(bytes);
+    }
+
+    HairMemoryUsage HairSimulationSystem::GetMemoryUsage() const
+    {
+        return memoryTracker->GetTotals();
+    }
+
+    HairMemoryUsage HairSimulationSystem::GetMemoryUsage(const HairModel* model) const
+    {
+        return model->memoryUsage;
+    }
+
+    HairMemoryUsage HairSimulationSystem::GetMemoryUsage(const HairInstance* instance) const
+    {
+        return instance->memoryUsage;
+    }
+
     void HairSimulationSystem::SimulateHair(HairInstance* instance, float timeStep) const
     {
         hairRenderer->Simulate(instance, timeStep);
+
+        if (instance->cacheRecorder != nullptr) {
+            instance->cacheRecorder->Capture(instance->posBuffer);
+        }
+    }
+
+    int64_t GetCacheRecorderStaging(const HairModel* model)
+    {
+        return (int64_t)(CacheRecorder::ReadbackBuffersCount * model->strandCount * (model->segCount + 1) * sizeof(Vector4));
+    }
+
+    // Every following SimulateHair step of the instance is appended to the cache
+    // file, the positions are read back asynchronously and written on a worker thread.
+    // With codec settings the frames are compressed before they are written.
+    void HairSimulationSystem::BeginCacheRecording(HairInstance* instance, const char* path, const HairCodecSettings* codec) const
+    {
+        EndCacheRecording(instance);
+
+        HairCodecSettings codecSettings;
+        if (codec != nullptr) {
+            codecSettings = *codec;
+        }
+
+        // vertices stay within a strand length of their root, wherever the instance is scaled
+        if (codec != nullptr && codecSettings.quantizationStep <= 0.0f) {
+            float maxLength = 0.0f;
+            for (auto& reach : instance->model->strandReach) {
+                maxLength = (std::max)(maxLength, reach.w);
+            }
+
+            float maxScale = GetMaxScale(instance->config.modelMatrix);
+            codecSettings.quantizationStep = (std::max)(maxLength * maxScale * 1.1f / 32767.0f, 1e-7f);
+        }
+
+        instance->cacheRecorder = new CacheRecorder(path, instance->model, codec != nullptr ? &codecSettings : nullptr);
+        memoryTracker->Add(&instance->memoryUsage, &HairMemoryUsage::staging, GetCacheRecorderStaging(instance->model));
+    }
+
+    void HairSimulationSystem::EndCacheRecording(HairInstance* instance) const
+    {
+        auto recorder = instance->cacheRecorder;
+        if (recorder == nullptr) {
+            return;
+        }
+
+        instance->cacheRecorder = nullptr;
+        memoryTracker->Add(&instance->memoryUsage, &HairMemoryUsage::staging, -GetCacheRecorderStaging(instance->model));
+        try {
+            recorder->Finish();
+        }
+        catch (...) {
+            delete recorder;
+            throw;
+        }
+        delete recorder;
+    }
+
+    HairCache* HairSimulationSystem::OpenCache(const char* path) const
+    {
+        return new HairCache(path);
+    }
+
+    void HairSimulationSystem::CloseCache(HairCache* cache) const
+    {
+        delete cache;
+    }
+
+    uint32_t HairSimulationSystem::GetCacheFramesCount(const HairCache* cache) const
+    {
+        return cache->framesCount;
+    }
+
+    // Replaces a simulation step, the frame is uploaded from the mapped file and
+    // the solver doesn't run. Frames can be played in any order, compressed caches
+    // play fastest forwards since their frames are decoded from the last keyframe.
+    void HairSimulationSystem::PlayCacheFrame(HairInstance* instance, const HairCache* cache, uint32_t frame) const
+    {
+        auto model = instance->model;
+        if (cache->strandsCount != model->strandCount || cache->verticesPerStrand != model->segCount + 1) {
+            throw std::runtime_error("Hair simulation cache does not match the hair model");
+        }
+        if (frame >= cache->framesCount) {
+            throw std::runtime_error("Hair simulation cache frame out of range");
+        }
+
+        // the positions may just have been written by the simulation shader
+        glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+        CopyBufferRange(instance->posBuffer, instance->prevPosBuffer, cache->frameSize);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, instance->posBuffer.buffID);
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, instance->posBuffer.offset, cache->frameSize, cache->GetFrame(frame));
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+        instance->frame++;
+    }
+
+    void HairSimulationSystem::GetCacheLayout(const HairCache* cache, uint32_t& strandsCount, uint32_t& verticesPerStrand) const
+    {
+        strandsCount = cache->strandsCount;
+        verticesPerStrand = cache->verticesPerStrand;
+    }
+
+    // Copies a frame of the cache, decoding it if the cache is compressed, positions
+    // must hold verticesPerStrand vertices for each strand of the cache.
+    void HairSimulationSystem::GetCacheFrame(const HairCache* cache, uint32_t frame, Vector4* positions) const
+    {
+        if (frame >= cache->framesCount) {
+            throw std::runtime_error("Hair simulation cache frame out of range");
+        }
+
+        memcpy(positions, cache->GetFrame(frame), cache->frameSize);
     }
 
 
-    HairModel* HairSimulationSystem::LoadModel(const char* path) const
+    // File reading and every precompute of LoadModel, safe to run on a worker thread.
+    void ReadModel(const char* path, const HairLoadSettings& settings, ModelData& data)
     {
         auto file = fopen(path, "rb");
         if (file == nullptr) {
@@ -146,6 +758,22 @@ namespace HairSimulation
 
         fclose(file);
 
+        for (int index : triangles) {
+            if (index < 0 || index >= strandCount) {
+                throw std::runtime_error(std::string("Invalid hair asset file ") + path);
+            }
+        }
+
+        std::vector<uint32_t> fileStrandIndices;
+        if (settings.spatialReorder) {
+            ReorderStrands(vertices, verticesPerStrand, triangles, fileStrandIndices);
+        }
+
+        float maxAreaWeight = UpdateAreaWeights(vertices, verticesPerStrand, triangles);
+
+        std::vector<Vector4> strandReach;
+        UpdateStrandReach(vertices, verticesPerStrand, strandReach);
+
         std::vector<Vector4> tangents;
         UpdateConstraintsBuffers(vertices, verticesPerStrand, tangents);
 
@@ -153,87 +781,403 @@ namespace HairSimulation
 		std::vector<Quaternion> globalRotations;
 		UpdateRotationBuffers(vertices, verticesPerStrand, globalRotations, refVecs);
 
-        auto model = new HairModel();
-        model->strandCount = strandCount;
-        model->segCount = segmentsCount;
-        model->trianglesCount = trianglesCount;
+        std::vector<FollowerData> followers;
+        UpdateFollowerBuffers(vertices, verticesPerStrand, followers);
 
-        glGenBuffers(1, &model->tangentsBuffID);
-        glBindBuffer(GL_SHADER_STORAGE_BUFFER, model->tangentsBuffID);
-        glBufferData(GL_SHADER_STORAGE_BUFFER, tangents.size() * sizeof(Vector4), tangents.data(), GL_STATIC_DRAW);
+        std::vector<Vector4> followerCoords;
+        UpdateFollowerCoordsBuffer(followerCoords);
 
-        glGenBuffers(1, &model->refVecsBufferID);
-        glBindBuffer(GL_SHADER_STORAGE_BUFFER, model->refVecsBufferID);
-        glBufferData(GL_SHADER_STORAGE_BUFFER, refVecs.size() * sizeof(Vector4), refVecs.data(), GL_STATIC_DRAW);
+        data.strandCount = strandCount;
+        data.segCount = segmentsCount;
+        data.trianglesCount = trianglesCount;
+        data.maxAreaWeight = maxAreaWeight;
+        AddModelBuffer(data, &HairModel::strandReachBuffer, strandReach);
+        data.strandReach = std::move(strandReach);
+        data.fileStrandIndices = std::move(fileStrandIndices);
+        data.boundsMin = Vector3(FLT_MAX, FLT_MAX, FLT_MAX);
+        data.boundsMax = Vector3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+        for (auto& vertex : vertices) {
+            for (int i = 0; i < 3; i++) {
+                data.boundsMin[i] = (std::min)(data.boundsMin[i], vertex[i]);
+                data.boundsMax[i] = (std::max)(data.boundsMax[i], vertex[i]);
+            }
+        }
 
-        glGenBuffers(1, &model->debugBuffID);
-        glBindBuffer(GL_SHADER_STORAGE_BUFFER, model->debugBuffID);
-        glBufferData(GL_SHADER_STORAGE_BUFFER, vertices.size() * sizeof(Vector4), nullptr, GL_STATIC_DRAW);
+        if (settings.compactStorage) {
+            PackCompactRestData(data, vertices, tangents, refVecs, globalRotations);
+        } else {
+            AddModelBuffer(data, &HairModel::tangentsBuffer, tangents);
+            AddModelBuffer(data, &HairModel::refVecsBuffer, refVecs);
+            AddModelBuffer(data, &HairModel::restBuffer, vertices);
+            AddModelBuffer(data, &HairModel::globalRotBuffer, globalRotations);
+            data.buffers.push_back({ &HairModel::debugBuffer, vertices.size() * sizeof(Vector4), {} });
+        }
 
-        glGenBuffers(1, &model->restBuffID);
-        glBindBuffer(GL_SHADER_STORAGE_BUFFER, model->restBuffID);
-        glBufferData(GL_SHADER_STORAGE_BUFFER, vertices.size() * sizeof(Vector4), vertices.data(), GL_STATIC_DRAW);
+        AddModelBuffer(data, &HairModel::followersBuffer, followers);
+        AddModelBuffer(data, &HairModel::followerCoordsBuffer, followerCoords);
+        AddModelBuffer(data, &HairModel::hairIndicesBuffer, triangles);
+    }
 
-        glGenBuffers(1, &model->globalRotBuffID);
-        glBindBuffer(GL_SHADER_STORAGE_BUFFER, model->globalRotBuffID);
-        glBufferData(GL_SHADER_STORAGE_BUFFER, globalRotations.size() * sizeof(Quaternion), globalRotations.data(), GL_STATIC_DRAW);
+    HairModel* HairSimulationSystem::LoadModel(const char* path, const HairLoadSettings& settings) const
+    {
+        ModelData data = {};
+        ReadModel(path, settings, data);
+        return CreateModel(data, true, modelBufferPool, memoryTracker);
+    }
 
-        glGenBuffers(1, &model->hairIndicesBuffID);
-        glBindBuffer(GL_SHADER_STORAGE_BUFFER, model->hairIndicesBuffID);
-        glBufferData(GL_SHADER_STORAGE_BUFFER, triangles.size() * sizeof(int), triangles.data(), GL_STATIC_DRAW);
+    // The model is read and precomputed on a worker thread, UpdateModelLoads then
+    // uploads it in chunks. TakeLoadedModel returns it once it is complete.
+    HairModelLoad* HairSimulationSystem::LoadModelAsync(const char* path, const HairLoadSettings& settings) const
+    {
+        return modelLoader->Start(path, settings);
+    }
 
-        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    // Call once per frame on the thread owning the GL context, at most uploadBudget
+    // bytes of pending models are copied to the GPU.
+    void HairSimulationSystem::UpdateModelLoads(uint32_t uploadBudget) const
+    {
+        modelLoader->Update(uploadBudget);
+    }
 
-        return model;
+    // Returns nullptr while the model is loading. Once the model or the error of
+    // the load is returned the handle is released.
+    HairModel* HairSimulationSystem::TakeLoadedModel(HairModelLoad* load) const
+    {
+        return modelLoader->Take(load);
+    }
+
+    void HairSimulationSystem::CancelModelLoad(HairModelLoad* load) const
+    {
+        modelLoader->Cancel(load);
     }
 
     void HairSimulationSystem::DestroyModel(HairModel* model) const
     {
-        glDeleteBuffers(1, &model->restBuffID);
+        ReleaseModelBuffers(model, modelBufferPool);
+        glDeleteBuffers(1, &model->scalpIndicesBuffID);
+        glDeleteBuffers(1, &model->rootAttachmentsBuffID);
+        memoryTracker->Release(model->memoryUsage);
         delete model;
     }
 
-    void CopyBuffer(uint32_t src, uint32_t dst, int size)
+    // Without spatial reordering both mappings are the identity.
+    uint32_t HairSimulationSystem::GetStrandIndex(const HairModel* model, uint32_t fileStrandIndex) const
     {
-        glBindBuffer(GL_COPY_READ_BUFFER, src);
-        glBindBuffer(GL_COPY_WRITE_BUFFER, dst);
-        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, size);
+        if (fileStrandIndex >= model->strandCount) {
+            throw std::runtime_error("Strand index out of range");
+        }
+        return model->strandIndices.empty() ? fileStrandIndex : model->strandIndices[fileStrandIndex];
+    }
+
+    uint32_t HairSimulationSystem::GetFileStrandIndex(const HairModel* model, uint32_t strandIndex) const
+    {
+        if (strandIndex >= model->strandCount) {
+            throw std::runtime_error("Strand index out of range");
+        }
+        return model->fileStrandIndices.empty() ? strandIndex : model->fileStrandIndices[strandIndex];
+    }
+
+    // Pins every strand root to the nearest triangle of the scalp in its rest pose.
+    // Instances then follow the deformed scalp given to SetScalpVertices.
+    void HairSimulationSystem::AttachToScalp(HairModel* model, const HairMeshDescriptor& scalp) const
+    {
+        if (scalp.trianglesCount == 0) {
+            throw std::runtime_error("Scalp mesh has no triangles");
+        }
+        for (uint32_t i = 0; i < scalp.trianglesCount * 3; i++) {
+            if (scalp.indices[i] >= scalp.verticesCount) {
+                throw std::runtime_error("Invalid scalp mesh, vertex index out of range");
+            }
+        }
+
+        std::vector<RootAttachment> attachments;
+        UpdateRootAttachments(model, scalp, attachments);
+
+        memoryTracker->Add(&model->memoryUsage, &HairMemoryUsage::indexData, -(int64_t)GetBufferSize(model->scalpIndicesBuffID));
+        memoryTracker->Add(&model->memoryUsage, &HairMemoryUsage::restData, -(int64_t)GetBufferSize(model->rootAttachmentsBuffID));
+        glDeleteBuffers(1, &model->scalpIndicesBuffID);
+        glDeleteBuffers(1, &model->rootAttachmentsBuffID);
+
+        glGenBuffers(1, &model->scalpIndicesBuffID);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, model->scalpIndicesBuffID);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, scalp.trianglesCount * 3 * sizeof(uint32_t), scalp.indices, GL_STATIC_DRAW);
+
+        glGenBuffers(1, &model->rootAttachmentsBuffID);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, model->rootAttachmentsBuffID);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, attachments.size() * sizeof(RootAttachment), attachments.data(), GL_STATIC_DRAW);
+
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+        memoryTracker->Add(&model->memoryUsage, &HairMemoryUsage::indexData, scalp.trianglesCount * 3 * sizeof(uint32_t));
+        memoryTracker->Add(&model->memoryUsage, &HairMemoryUsage::restData, attachments.size() * sizeof(RootAttachment));
     }
 
     HairInstance* HairSimulationSystem::CreateInstance(const HairModel* model) const
     {
         auto instance = new HairInstance();
-        instance->model = model;
+        try {
+            InitializeInstance(instance, model);
+        }
+        catch (...) {
+            ReleaseInstanceResources(instance);
+            delete instance;
+            throw;
+        }
+        return instance;
+    }
+
+    // The Queue functions can be called from any thread, the commands run in the
+    // order they were queued on the next ExecuteQueuedCommands. An instance returned
+    // by QueueCreateInstance can be passed to other queued commands right away and
+    // to the other functions once its creation has been executed.
+    HairInstance* HairSimulationSystem::QueueCreateInstance(const HairModel* model) const
+    {
+        auto command = new Command();
+        command->type = CommandType::CreateInstance;
+        command->instance = new HairInstance();
+        command->model = model;
+        commandQueue->Push(command);
+        return command->instance;
+    }
+
+    void HairSimulationSystem::QueueUpdateInstanceSettings(HairInstance* instance, const HairConfig& settings) const
+    {
+        auto command = new Command();
+        command->type = CommandType::UpdateInstanceSettings;
+        command->instance = instance;
+        command->config = settings;
+        commandQueue->Push(command);
+    }
+
+    void HairSimulationSystem::QueueSimulateHair(HairInstance* instance, float timeStep) const
+    {
+        auto command = new Command();
+        command->type = CommandType::SimulateHair;
+        command->instance = instance;
+        command->timeStep = timeStep;
+        commandQueue->Push(command);
+    }
+
+    void HairSimulationSystem::QueueDestroyInstance(HairInstance* instance) const
+    {
+        auto command = new Command();
+        command->type = CommandType::DestroyInstance;
+        command->instance = instance;
+        commandQueue->Push(command);
+    }
 
+    // Call once per frame on the thread owning the GL context.
+    // A failing command doesn't stop the queue, it marks its instance as failed with
+    // the error and the number of failed commands is returned. Later commands for a
+    // failed instance are skipped, only its destruction is executed.
+    uint32_t HairSimulationSystem::ExecuteQueuedCommands() const
+    {
+        uint32_t failedCount = 0;
+        while (auto command = commandQueue->Pop()) {
+            auto instance = command->instance;
+            if (command->type != CommandType::DestroyInstance && instance->status.load(std::memory_order_relaxed) == HairInstanceStatus::Failed) {
+                failedCount++;
+                delete command;
+                continue;
+            }
+
+            bool failed = false;
+            std::string error;
+            try {
+                switch (command->type) {
+                case CommandType::CreateInstance:
+                    try {
+                        InitializeInstance(instance, command->model);
+                    }
+                    catch (...) {
+                        ReleaseInstanceResources(instance);
+                        throw;
+                    }
+                    break;
+                case CommandType::UpdateInstanceSettings:
+                    UpdateInstanceSettings(instance, command->config);
+                    break;
+                case CommandType::SimulateHair:
+                    SimulateHair(instance, command->timeStep);
+                    break;
+                case CommandType::DestroyInstance:
+                    DestroyInstance(instance);
+                    break;
+                }
+            }
+            catch (const std::exception& exception) {
+                failed = true;
+                error = exception.what();
+            }
+            catch (...) {
+                failed = true;
+                error = "Unknown error";
+            }
+
+            // a destroyed instance is gone even when destroying it failed
+            if (failed) {
+                failedCount++;
+                if (command->type != CommandType::DestroyInstance) {
+                    instance->error = error;
+                    instance->status.store(HairInstanceStatus::Failed, std::memory_order_release);
+                }
+            }
+            delete command;
+        }
+        return failedCount;
+    }
+
+    HairInstanceStatus HairSimulationSystem::GetInstanceStatus(const HairInstance* instance) const
+    {
+        return instance->status.load(std::memory_order_acquire);
+    }
+
+    // Error of the queued command that failed the instance, nullptr while it hasn't
+    // failed. The error never changes once set, so any thread may read it.
+    const char* HairSimulationSystem::GetInstanceError(const HairInstance* instance) const
+    {
+        if (instance->status.load(std::memory_order_acquire) != HairInstanceStatus::Failed) {
+            return nullptr;
+        }
+        return instance->error.c_str();
+    }
+
+    // Render caches allocated later on are limited to what is left of the budget,
+    // an instance only fails when its simulation data does not fit.
+    void HairSimulationSystem::InitializeInstance(HairInstance* instance, const HairModel* model) const
+    {
         size_t positionsSize = sizeof(Vector4) * model->strandCount * (model->segCount + 1);
+        size_t visibleTrianglesSize = model->trianglesCount * sizeof(int);
+        if (!memoryTracker->Fits(2 * positionsSize + sizeof(CullingCommands) + visibleTrianglesSize)) {
+            throw std::runtime_error("Hair instance does not fit into the memory budget");
+        }
 
-        glGenBuffers(1, &instance->posBuffID);
-        glBindBuffer(GL_SHADER_STORAGE_BUFFER, instance->posBuffID);
-        glBufferData(GL_SHADER_STORAGE_BUFFER, positionsSize, nullptr, GL_DYNAMIC_DRAW);
+        instance->model = model;
 
-        glGenBuffers(1, &instance->prevPosBuffID);
-        glBindBuffer(GL_SHADER_STORAGE_BUFFER, instance->prevPosBuffID);
-        glBufferData(GL_SHADER_STORAGE_BUFFER, positionsSize, nullptr, GL_DYNAMIC_DRAW);
+        instance->posBuffer = instanceBufferPool->Allocate(positionsSize);
+        instance->prevPosBuffer = instanceBufferPool->Allocate(positionsSize);
 
-        CopyBuffer(model->restBuffID, instance->posBuffID, positionsSize);
-        CopyBuffer(model->restBuffID, instance->prevPosBuffID, positionsSize);
+        if (model->compactStorage) {
+            hairRenderer->UnpackRestPositions(instance);
+        } else {
+            CopyBufferRange(model->restBuffer, instance->posBuffer, positionsSize);
+            CopyBufferRange(model->restBuffer, instance->prevPosBuffer, positionsSize);
+        }
 
-        return instance;
+        glGenBuffers(1, &instance->cullingCommandsBuffID);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, instance->cullingCommandsBuffID);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(CullingCommands), nullptr, GL_DYNAMIC_DRAW);
+
+        glGenBuffers(1, &instance->visibleTrianglesBuffID);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, instance->visibleTrianglesBuffID);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, visibleTrianglesSize, nullptr, GL_DYNAMIC_DRAW);
+
+        glGenBuffers(2, instance->cullingStatsBuffIDs);
+        for (int i = 0; i < 2; i++) {
+            glBindBuffer(GL_COPY_WRITE_BUFFER, instance->cullingStatsBuffIDs[i]);
+            glBufferData(GL_COPY_WRITE_BUFFER, sizeof(CullingCommands), nullptr, GL_STREAM_READ);
+        }
+
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+        memoryTracker->Add(&instance->memoryUsage, &HairMemoryUsage::dynamicData, 2 * positionsSize + sizeof(CullingCommands));
+        memoryTracker->Add(&instance->memoryUsage, &HairMemoryUsage::indexData, visibleTrianglesSize);
+        memoryTracker->Add(&instance->memoryUsage, &HairMemoryUsage::staging, 2 * sizeof(CullingCommands));
+
+        instance->statistics.trianglesCount = model->trianglesCount;
+        instance->statistics.visibleTrianglesCount = model->trianglesCount;
+        instance->status.store(HairInstanceStatus::Ready, std::memory_order_release);
     }
 
     void HairSimulationSystem::UpdateInstanceSettings(HairInstance* instance, const HairConfig& config) const
     {
         instance->config = config;
+        instance->geometryCaptured = false;
+        instance->densityVolumeBuilt = false;
+    }
+
+    // The buffer holds one vec4 per scalp vertex in the space of the hair model,
+    // it usually is the output of the character skinning. 0 detaches the scalp,
+    // roots then follow the model matrix.
+    void HairSimulationSystem::SetScalpVertices(HairInstance* instance, uint32_t vertexBufferID) const
+    {
+        if (vertexBufferID != 0 && instance->model->rootAttachmentsBuffID == 0) {
+            throw std::runtime_error("Hair model is not attached to a scalp");
+        }
+        instance->scalpVerticesBuffID = vertexBufferID;
     }
 
+    // A recording still running is finished first so its pending read backs are
+    // written. Should that fail the instance is released anyway and the error is
+    // thrown afterwards.
     void HairSimulationSystem::DestroyInstance(HairInstance* instance) const
     {
-        glDeleteBuffers(1, &instance->posBuffID);
+        std::exception_ptr recordingError;
+        try {
+            EndCacheRecording(instance);
+        }
+        catch (...) {
+            recordingError = std::current_exception();
+        }
+
+        ReleaseInstanceResources(instance);
         delete instance;
+
+        if (recordingError) {
+            std::rethrow_exception(recordingError);
+        }
+    }
+
+    // Also releases what a failed InitializeInstance got to allocate. Everything is
+    // reset, so releasing twice is harmless.
+    void HairSimulationSystem::ReleaseInstanceResources(HairInstance* instance) const
+    {
+        uint32_t* buffIDs[] = {
+            &instance->cullingCommandsBuffID,
+            &instance->visibleTrianglesBuffID,
+            &instance->cullingStatsBuffIDs[0],
+            &instance->cullingStatsBuffIDs[1],
+            &instance->strandVerticesBuffID,
+            &instance->followerCacheBuffID,
+            &instance->densityGridBuffID,
+            &instance->hairGridAccumulationBuffID,
+            &instance->hairGridBuffID,
+            &instance->collidersBuffID,
+            &instance->colliderMasksBuffID,
+            &instance->rootTransformsBuffID
+        };
+        for (auto buffID : buffIDs) {
+            glDeleteBuffers(1, buffID);
+            *buffID = 0;
+        }
+
+        for (int i = 0; i < 2; i++) {
+            glDeleteSync(instance->cullingStatsFences[i]);
+            instance->cullingStatsFences[i] = nullptr;
+        }
+        glDeleteTextures(1, &instance->densityVolumeTexID);
+        instance->densityVolumeTexID = 0;
+        instance->strandVerticesCapacity = 0;
+        instance->followerCacheCapacity = 0;
+
+        instanceBufferPool->Free(instance->posBuffer);
+        instanceBufferPool->Free(instance->prevPosBuffer);
+        instance->simulationTimer.Release();
+        instance->renderTimer.Release();
+        instance->densityTimer.Release();
+
+        memoryTracker->Release(instance->memoryUsage);
+        instance->memoryUsage = HairMemoryUsage();
     }
 
     HairSimulationSystem::~HairSimulationSystem()
     {
+        delete commandQueue;
+        delete modelLoader;
+        delete instanceBufferPool;
+        delete modelBufferPool;
         delete hairRenderer;
+        delete memoryTracker;
     }
 }
\ No newline at end of file
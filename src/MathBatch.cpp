@@ -0,0 +1,285 @@
+#include <hairsimulation/Math.h>
+#include <math.h>
+#include <algorithm>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define HAIR_MATH_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+namespace HairSimulation
+{
+    namespace
+    {
+        constexpr size_t BlockSize = 8;
+
+        struct alignas(32) Vector3Block
+        {
+            float x[BlockSize];
+            float y[BlockSize];
+            float z[BlockSize];
+        };
+
+        struct alignas(32) Vector4Block
+        {
+            float x[BlockSize];
+            float y[BlockSize];
+            float z[BlockSize];
+            float w[BlockSize];
+        };
+
+        void Gather(const Vector3* vectors, size_t count, Vector3Block& block)
+        {
+            for (size_t i = 0; i < BlockSize; i++) {
+                Vector3 v = i < count ? vectors[i] : Vector3(1.0f, 0.0f, 0.0f);
+                block.x[i] = v.x;
+                block.y[i] = v.y;
+                block.z[i] = v.z;
+            }
+        }
+
+        template<typename T>
+        void Gather4(const T* vectors, size_t count, Vector4Block& block)
+        {
+            for (size_t i = 0; i < BlockSize; i++) {
+                T v = i < count ? vectors[i] : T(0.0f, 0.0f, 0.0f, 1.0f);
+                block.x[i] = v.x;
+                block.y[i] = v.y;
+                block.z[i] = v.z;
+                block.w[i] = v.w;
+            }
+        }
+
+        void Scatter(const Vector3Block& block, size_t count, Vector3* vectors)
+        {
+            for (size_t i = 0; i < count; i++) {
+                vectors[i] = Vector3(block.x[i], block.y[i], block.z[i]);
+            }
+        }
+
+        template<typename T>
+        void Scatter4(const Vector4Block& block, size_t count, T* vectors)
+        {
+            for (size_t i = 0; i < count; i++) {
+                vectors[i] = T(block.x[i], block.y[i], block.z[i], block.w[i]);
+            }
+        }
+
+#if !HAIR_MATH_X86
+        namespace Scalar
+        {
+            struct Lanes
+            {
+                static constexpr size_t Width = 1;
+                float v;
+
+                static Lanes Set(float value) { return { value }; }
+                static Lanes Load(const float* p) { return { *p }; }
+                void Store(float* p) const { *p = v; }
+            };
+
+            inline Lanes operator+(Lanes a, Lanes b) { return { a.v + b.v }; }
+            inline Lanes operator-(Lanes a, Lanes b) { return { a.v - b.v }; }
+            inline Lanes operator*(Lanes a, Lanes b) { return { a.v * b.v }; }
+            inline Lanes operator/(Lanes a, Lanes b) { return { a.v / b.v }; }
+            inline Lanes Sqrt(Lanes a) { return { sqrtf(a.v) }; }
+
+#include "MathBatchKernels.inl"
+        }
+#else
+        namespace SSE
+        {
+            struct Lanes
+            {
+                static constexpr size_t Width = 4;
+                __m128 v;
+
+                static Lanes Set(float value) { return { _mm_set1_ps(value) }; }
+                static Lanes Load(const float* p) { return { _mm_load_ps(p) }; }
+                void Store(float* p) const { _mm_store_ps(p, v); }
+            };
+
+            inline Lanes operator+(Lanes a, Lanes b) { return { _mm_add_ps(a.v, b.v) }; }
+            inline Lanes operator-(Lanes a, Lanes b) { return { _mm_sub_ps(a.v, b.v) }; }
+            inline Lanes operator*(Lanes a, Lanes b) { return { _mm_mul_ps(a.v, b.v) }; }
+            inline Lanes operator/(Lanes a, Lanes b) { return { _mm_div_ps(a.v, b.v) }; }
+            inline Lanes Sqrt(Lanes a) { return { _mm_sqrt_ps(a.v) }; }
+
+#include "MathBatchKernels.inl"
+        }
+
+        // Everything in the AVX namespace is compiled for AVX regardless of the
+        // project flags, and is only reached after the runtime check below.
+#if defined(__clang__)
+#pragma clang attribute push (__attribute__((target("avx"))), apply_to = function)
+#elif defined(__GNUC__)
+#pragma GCC push_options
+#pragma GCC target("avx")
+#endif
+        namespace AVX
+        {
+            struct Lanes
+            {
+                static constexpr size_t Width = 8;
+                __m256 v;
+
+                static Lanes Set(float value) { return { _mm256_set1_ps(value) }; }
+                static Lanes Load(const float* p) { return { _mm256_load_ps(p) }; }
+                void Store(float* p) const { _mm256_store_ps(p, v); }
+            };
+
+            inline Lanes operator+(Lanes a, Lanes b) { return { _mm256_add_ps(a.v, b.v) }; }
+            inline Lanes operator-(Lanes a, Lanes b) { return { _mm256_sub_ps(a.v, b.v) }; }
+            inline Lanes operator*(Lanes a, Lanes b) { return { _mm256_mul_ps(a.v, b.v) }; }
+            inline Lanes operator/(Lanes a, Lanes b) { return { _mm256_div_ps(a.v, b.v) }; }
+            inline Lanes Sqrt(Lanes a) { return { _mm256_sqrt_ps(a.v) }; }
+
+#include "MathBatchKernels.inl"
+        }
+#if defined(__clang__)
+#pragma clang attribute pop
+#elif defined(__GNUC__)
+#pragma GCC pop_options
+#endif
+#endif
+
+        struct BatchKernels
+        {
+            const char* name;
+            void (*transform)(const Matrix4&, const Vector4Block&, Vector4Block&);
+            void (*rotate)(const Vector4Block&, const Vector3Block&, Vector3Block&);
+            void (*normalize)(const Vector3Block&, Vector3Block&);
+            void (*rotationsBetween)(const Vector3Block&, const Vector3Block&, Vector4Block&);
+        };
+
+        bool IsAVXSupported()
+        {
+#if HAIR_MATH_X86 && defined(_MSC_VER)
+            int info[4];
+            __cpuid(info, 1);
+            bool osSavesYMM = (info[2] & (1 << 27)) != 0;
+            bool hasAVX = (info[2] & (1 << 28)) != 0;
+            return osSavesYMM && hasAVX && (_xgetbv(0) & 6) == 6;
+#elif HAIR_MATH_X86
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("avx");
+#else
+            return false;
+#endif
+        }
+
+        BatchKernels SelectKernels()
+        {
+#if HAIR_MATH_X86
+            if (IsAVXSupported()) {
+                return { "AVX", AVX::TransformBlock, AVX::RotateBlock, AVX::NormalizeBlock, AVX::RotationsBetweenBlock };
+            }
+            return { "SSE", SSE::TransformBlock, SSE::RotateBlock, SSE::NormalizeBlock, SSE::RotationsBetweenBlock };
+#else
+            return { "Scalar", Scalar::TransformBlock, Scalar::RotateBlock, Scalar::NormalizeBlock, Scalar::RotationsBetweenBlock };
+#endif
+        }
+
+        const BatchKernels& GetKernels()
+        {
+            static const BatchKernels kernels = SelectKernels();
+            return kernels;
+        }
+
+        Quaternion RotationBetweenOpposite(const Vector3& from, const Vector3& to)
+        {
+            float lengths = sqrtf(from.Length2() * to.Length2());
+            if (lengths == 0.0f || Vector3::Dot(from, to) > -0.9999f * lengths) {
+                return Quaternion();
+            }
+
+            auto axis = Vector3::Cross(from, Vector3(1.0f, 0.0f, 0.0f));
+            if (axis.Length2() < 0.0001f * from.Length2()) {
+                axis = Vector3::Cross(from, Vector3(0.0f, 1.0f, 0.0f));
+            }
+
+            axis.Normalize();
+            return Quaternion(axis.x, axis.y, axis.z, 0.0f);
+        }
+    }
+
+    void TransformPoints(const Matrix4& matrix, const Vector4* points, Vector4* result, size_t count)
+    {
+        auto& kernels = GetKernels();
+        Vector4Block in, out;
+
+        for (size_t i = 0; i < count; i += BlockSize) {
+            size_t blockCount = (std::min)(BlockSize, count - i);
+            Gather4(points + i, blockCount, in);
+            kernels.transform(matrix, in, out);
+            Scatter4(out, blockCount, result + i);
+        }
+    }
+
+    void RotateVectors(const Quaternion* rotations, const Vector3* vectors, Vector3* result, size_t count)
+    {
+        auto& kernels = GetKernels();
+        Vector4Block q;
+        Vector3Block in, out;
+
+        for (size_t i = 0; i < count; i += BlockSize) {
+            size_t blockCount = (std::min)(BlockSize, count - i);
+            Gather4(rotations + i, blockCount, q);
+            Gather(vectors + i, blockCount, in);
+            kernels.rotate(q, in, out);
+            Scatter(out, blockCount, result + i);
+        }
+    }
+
+    void NormalizeVectors(const Vector3* vectors, Vector3* result, size_t count)
+    {
+        auto& kernels = GetKernels();
+        Vector3Block in, out;
+
+        for (size_t i = 0; i < count; i += BlockSize) {
+            size_t blockCount = (std::min)(BlockSize, count - i);
+            Gather(vectors + i, blockCount, in);
+            kernels.normalize(in, out);
+            Scatter(out, blockCount, result + i);
+        }
+    }
+
+    void RotationsBetween(const Vector3* from, const Vector3* to, Quaternion* result, size_t count)
+    {
+        auto& kernels = GetKernels();
+        Vector3Block a, b;
+        Vector4Block out;
+
+        for (size_t i = 0; i < count; i += BlockSize) {
+            size_t blockCount = (std::min)(BlockSize, count - i);
+            Gather(from + i, blockCount, a);
+            Gather(to + i, blockCount, b);
+            kernels.rotationsBetween(a, b, out);
+
+            // Nearly opposite or zero length vectors have no stable rotation axis,
+            // those few are resolved one by one.
+            for (size_t j = 0; j < blockCount; j++) {
+                if (!(out.w[j] > 0.001f)) {
+                    Quaternion q = RotationBetweenOpposite(from[i + j], to[i + j]);
+                    if (q.w == 1.0f && out.w[j] == out.w[j]) {
+                        continue;
+                    }
+                    out.x[j] = q.x;
+                    out.y[j] = q.y;
+                    out.z[j] = q.z;
+                    out.w[j] = q.w;
+                }
+            }
+
+            Scatter4(out, blockCount, result + i);
+        }
+    }
+
+    const char* GetMathInstructionSet()
+    {
+        return GetKernels().name;
+    }
+}
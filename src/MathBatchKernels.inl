@@ -0,0 +1,94 @@
+// Block kernels shared by every instruction set. MathBatch.cpp includes this
+// file once per instruction set, inside a namespace that defines Lanes as the
+// register wrapper of that set.
+
+void TransformBlock(const Matrix4& matrix, const Vector4Block& points, Vector4Block& result)
+{
+    Lanes m[4][4];
+    for (int i = 0; i < 4; i++) {
+        for (int j = 0; j < 4; j++) {
+            m[i][j] = Lanes::Set(matrix.m[i][j]);
+        }
+    }
+
+    for (size_t i = 0; i < BlockSize; i += Lanes::Width) {
+        Lanes x = Lanes::Load(points.x + i);
+        Lanes y = Lanes::Load(points.y + i);
+        Lanes z = Lanes::Load(points.z + i);
+        Lanes w = Lanes::Load(points.w + i);
+
+        (m[0][0] * x + m[1][0] * y + m[2][0] * z + m[3][0] * w).Store(result.x + i);
+        (m[0][1] * x + m[1][1] * y + m[2][1] * z + m[3][1] * w).Store(result.y + i);
+        (m[0][2] * x + m[1][2] * y + m[2][2] * z + m[3][2] * w).Store(result.z + i);
+        (m[0][3] * x + m[1][3] * y + m[2][3] * z + m[3][3] * w).Store(result.w + i);
+    }
+}
+
+void RotateBlock(const Vector4Block& rotations, const Vector3Block& vectors, Vector3Block& result)
+{
+    Lanes two = Lanes::Set(2.0f);
+
+    for (size_t i = 0; i < BlockSize; i += Lanes::Width) {
+        Lanes qx = Lanes::Load(rotations.x + i);
+        Lanes qy = Lanes::Load(rotations.y + i);
+        Lanes qz = Lanes::Load(rotations.z + i);
+        Lanes qw = Lanes::Load(rotations.w + i);
+        Lanes vx = Lanes::Load(vectors.x + i);
+        Lanes vy = Lanes::Load(vectors.y + i);
+        Lanes vz = Lanes::Load(vectors.z + i);
+
+        Lanes uvx = qy * vz - qz * vy;
+        Lanes uvy = qz * vx - qx * vz;
+        Lanes uvz = qx * vy - qy * vx;
+
+        Lanes uuvx = qy * uvz - qz * uvy;
+        Lanes uuvy = qz * uvx - qx * uvz;
+        Lanes uuvz = qx * uvy - qy * uvx;
+
+        Lanes w2 = qw * two;
+        (vx + uvx * w2 + uuvx * two).Store(result.x + i);
+        (vy + uvy * w2 + uuvy * two).Store(result.y + i);
+        (vz + uvz * w2 + uuvz * two).Store(result.z + i);
+    }
+}
+
+void NormalizeBlock(const Vector3Block& vectors, Vector3Block& result)
+{
+    Lanes one = Lanes::Set(1.0f);
+
+    for (size_t i = 0; i < BlockSize; i += Lanes::Width) {
+        Lanes x = Lanes::Load(vectors.x + i);
+        Lanes y = Lanes::Load(vectors.y + i);
+        Lanes z = Lanes::Load(vectors.z + i);
+
+        Lanes inversedLength = one / Sqrt(x * x + y * y + z * z);
+        (x * inversedLength).Store(result.x + i);
+        (y * inversedLength).Store(result.y + i);
+        (z * inversedLength).Store(result.z + i);
+    }
+}
+
+void RotationsBetweenBlock(const Vector3Block& from, const Vector3Block& to, Vector4Block& result)
+{
+    for (size_t i = 0; i < BlockSize; i += Lanes::Width) {
+        Lanes ax = Lanes::Load(from.x + i);
+        Lanes ay = Lanes::Load(from.y + i);
+        Lanes az = Lanes::Load(from.z + i);
+        Lanes bx = Lanes::Load(to.x + i);
+        Lanes by = Lanes::Load(to.y + i);
+        Lanes bz = Lanes::Load(to.z + i);
+
+        Lanes cx = ay * bz - az * by;
+        Lanes cy = az * bx - ax * bz;
+        Lanes cz = ax * by - ay * bx;
+        Lanes dot = ax * bx + ay * by + az * bz;
+        Lanes lengths = Sqrt((ax * ax + ay * ay + az * az) * (bx * bx + by * by + bz * bz));
+
+        Lanes w = lengths + dot;
+        Lanes inversedLength = Lanes::Set(1.0f) / Sqrt(cx * cx + cy * cy + cz * cz + w * w);
+        (cx * inversedLength).Store(result.x + i);
+        (cy * inversedLength).Store(result.y + i);
+        (cz * inversedLength).Store(result.z + i);
+        (w * inversedLength).Store(result.w + i);
+    }
+}
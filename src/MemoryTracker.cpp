@@ -0,0 +1,67 @@
+#include "MemoryTracker.h"
+#include "gl/GLUtils.h"
+#include <stdint.h>
+
+namespace HairSimulation
+{
+    MemoryTracker::MemoryTracker() :
+        totals(),
+        budget(0)
+    {
+    }
+
+    // Usage may be nullptr for memory no model or instance owns.
+    void MemoryTracker::Add(HairMemoryUsage* usage, uint64_t HairMemoryUsage::* category, int64_t bytes)
+    {
+        if (usage != nullptr) {
+            usage->*category += bytes;
+        }
+        totals.*category += bytes;
+    }
+
+    void MemoryTracker::Release(const HairMemoryUsage& usage)
+    {
+        totals.restData -= usage.restData;
+        totals.dynamicData -= usage.dynamicData;
+        totals.indexData -= usage.indexData;
+        totals.debugData -= usage.debugData;
+        totals.staging -= usage.staging;
+    }
+
+    void MemoryTracker::SetBudget(uint64_t bytes)
+    {
+        budget = bytes;
+    }
+
+    uint64_t MemoryTracker::GetAvailable() const
+    {
+        if (budget == 0) {
+            return UINT64_MAX;
+        }
+        uint64_t used = totals.restData + totals.dynamicData + totals.indexData + totals.debugData;
+        return used < budget ? budget - used : 0;
+    }
+
+    bool MemoryTracker::Fits(uint64_t bytes) const
+    {
+        return bytes <= GetAvailable();
+    }
+
+    const HairMemoryUsage& MemoryTracker::GetTotals() const
+    {
+        return totals;
+    }
+
+    size_t GetBufferSize(uint32_t buffID)
+    {
+        if (buffID == 0) {
+            return 0;
+        }
+
+        GLint64 size = 0;
+        glBindBuffer(GL_COPY_READ_BUFFER, buffID);
+        glGetBufferParameteri64v(GL_COPY_READ_BUFFER, GL_BUFFER_SIZE, &size);
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        return (size_t)size;
+    }
+}
@@ -0,0 +1,32 @@
+#ifndef MEMORY_TRACKER_H
+#define MEMORY_TRACKER_H
+
+#include <hairsimulation/HairTypes.h>
+#include <stdint.h>
+#include <stddef.h>
+
+namespace HairSimulation
+{
+    // Keeps the totals of every model and instance next to their own usage. The
+    // budget covers all categories but staging, a budget of 0 is unlimited.
+    class MemoryTracker
+    {
+    public:
+        MemoryTracker();
+        MemoryTracker(const MemoryTracker&) = delete;
+        void Add(HairMemoryUsage* usage, uint64_t HairMemoryUsage::* category, int64_t bytes);
+        void Release(const HairMemoryUsage& usage);
+        void SetBudget(uint64_t bytes);
+        uint64_t GetAvailable() const;
+        bool Fits(uint64_t bytes) const;
+        const HairMemoryUsage& GetTotals() const;
+
+    private:
+        HairMemoryUsage totals;
+        uint64_t budget;
+    };
+
+    size_t GetBufferSize(uint32_t buffID);
+}
+
+#endif
@@ -0,0 +1,239 @@
+#include "ModelLoader.h"
+#include <algorithm>
+#include <stdexcept>
+#include <string.h>
+
+namespace HairSimulation
+{
+    uint64_t HairMemoryUsage::* GetMemoryCategory(BufferRange HairModel::* buffer)
+    {
+        if (buffer == &HairModel::hairIndicesBuffer) {
+            return &HairMemoryUsage::indexData;
+        }
+        if (buffer == &HairModel::debugBuffer) {
+            return &HairMemoryUsage::debugData;
+        }
+        return &HairMemoryUsage::restData;
+    }
+
+    HairModel* CreateModel(ModelData& data, bool upload, BufferPool* pool, MemoryTracker* memoryTracker)
+    {
+        auto model = new HairModel();
+        model->strandCount = data.strandCount;
+        model->segCount = data.segCount;
+        model->trianglesCount = data.trianglesCount;
+        model->maxAreaWeight = data.maxAreaWeight;
+        model->boundsMin = data.boundsMin;
+        model->boundsMax = data.boundsMax;
+        model->compactStorage = data.compactStorage;
+        model->strandReach = std::move(data.strandReach);
+        model->fileStrandIndices = std::move(data.fileStrandIndices);
+        model->strandIndices.resize(model->fileStrandIndices.size());
+        for (uint32_t i = 0; i < model->fileStrandIndices.size(); i++) {
+            model->strandIndices[model->fileStrandIndices[i]] = i;
+        }
+
+        for (auto& buffer : data.buffers) {
+            auto& range = model->*buffer.buffer;
+            range = pool->Allocate(buffer.size);
+            memoryTracker->Add(&model->memoryUsage, GetMemoryCategory(buffer.buffer), buffer.size);
+            if (upload && !buffer.data.empty()) {
+                glBindBuffer(GL_SHADER_STORAGE_BUFFER, range.buffID);
+                glBufferSubData(GL_SHADER_STORAGE_BUFFER, range.offset, buffer.size, buffer.data.data());
+            }
+        }
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+        return model;
+    }
+
+    void ReleaseModelBuffers(HairModel* model, BufferPool* pool)
+    {
+        pool->Free(model->restBuffer);
+        pool->Free(model->tangentsBuffer);
+        pool->Free(model->hairIndicesBuffer);
+        pool->Free(model->refVecsBuffer);
+        pool->Free(model->globalRotBuffer);
+        pool->Free(model->debugBuffer);
+        pool->Free(model->followersBuffer);
+        pool->Free(model->followerCoordsBuffer);
+        pool->Free(model->movabilityBuffer);
+        pool->Free(model->strandReachBuffer);
+    }
+
+    HairModelLoad::HairModelLoad() :
+        read(false),
+        data(),
+        model(nullptr),
+        uploadedBuffers(0),
+        uploadedBytes(0)
+    {
+    }
+
+    ModelLoader::ModelLoader(BufferPool* pool, MemoryTracker* memoryTracker) :
+        pool(pool),
+        memoryTracker(memoryTracker),
+        stagingBuffID(0),
+        stagingSize(0)
+    {
+    }
+
+    ModelLoader::~ModelLoader()
+    {
+        while (!loads.empty()) {
+            Cancel(loads.back());
+        }
+
+        // shutting down has to wait for the workers still reading
+        for (auto load : cancelledLoads) {
+            load->thread.join();
+            delete load;
+        }
+        glDeleteBuffers(1, &stagingBuffID);
+        memoryTracker->Add(nullptr, &HairMemoryUsage::staging, -(int64_t)stagingSize);
+    }
+
+    HairModelLoad* ModelLoader::Start(const char* path, const HairLoadSettings& settings)
+    {
+        auto load = new HairModelLoad();
+        load->thread = std::thread([load, path = std::string(path), settings]() {
+            try {
+                ReadModel(path.c_str(), settings, load->data);
+            }
+            catch (...) {
+                load->error = std::current_exception();
+            }
+            load->read = true;
+        });
+
+        loads.push_back(load);
+        return load;
+    }
+
+    // Loads are uploaded in the order they were started, a load only starts
+    // uploading once the ones before it are done so each finishes as early as possible.
+    void ModelLoader::Update(size_t uploadBudget)
+    {
+        ReapCancelledLoads();
+
+        for (auto load : loads) {
+            if (uploadBudget == 0) {
+                break;
+            }
+            if (!load->read || load->error) {
+                continue;
+            }
+            Upload(load, uploadBudget);
+        }
+    }
+
+    void ModelLoader::Upload(HairModelLoad* load, size_t& budget)
+    {
+        auto& buffers = load->data.buffers;
+        if (load->model == nullptr) {
+            load->model = CreateModel(load->data, false, pool, memoryTracker);
+        }
+
+        if (stagingSize < budget && load->uploadedBuffers < buffers.size()) {
+            memoryTracker->Add(nullptr, &HairMemoryUsage::staging, (int64_t)budget - (int64_t)stagingSize);
+            stagingSize = budget;
+            if (stagingBuffID == 0) {
+                glGenBuffers(1, &stagingBuffID);
+            }
+            glBindBuffer(GL_COPY_READ_BUFFER, stagingBuffID);
+            glBufferData(GL_COPY_READ_BUFFER, stagingSize, nullptr, GL_STREAM_DRAW);
+        }
+
+        while (budget > 0 && load->uploadedBuffers < buffers.size()) {
+            auto& buffer = buffers[load->uploadedBuffers];
+            size_t remaining = buffer.data.size() - load->uploadedBytes;
+            if (remaining == 0) {
+                std::vector<uint8_t>().swap(buffer.data);
+                load->uploadedBuffers++;
+                load->uploadedBytes = 0;
+                continue;
+            }
+
+            // invalidating the staging buffer lets the driver hand out fresh
+            // storage while earlier copies from it are still pending
+            size_t chunkSize = (std::min)(remaining, budget);
+            glBindBuffer(GL_COPY_READ_BUFFER, stagingBuffID);
+            auto staging = glMapBufferRange(GL_COPY_READ_BUFFER, 0, chunkSize, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+            memcpy(staging, buffer.data.data() + load->uploadedBytes, chunkSize);
+            glUnmapBuffer(GL_COPY_READ_BUFFER);
+
+            auto& range = load->model->*buffer.buffer;
+            glBindBuffer(GL_COPY_WRITE_BUFFER, range.buffID);
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, range.offset + load->uploadedBytes, chunkSize);
+
+            load->uploadedBytes += chunkSize;
+            budget -= chunkSize;
+        }
+
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    }
+
+    // Returns the model once it is fully uploaded and nullptr before, the load is
+    // destroyed when the model or its error is returned.
+    HairModel* ModelLoader::Take(HairModelLoad* load)
+    {
+        if (!load->read) {
+            return nullptr;
+        }
+
+        if (load->error) {
+            auto error = load->error;
+            Cancel(load);
+            std::rethrow_exception(error);
+        }
+
+        if (load->uploadedBuffers < load->data.buffers.size()) {
+            return nullptr;
+        }
+
+        auto model = load->model;
+        load->model = nullptr;
+        Remove(load);
+        return model;
+    }
+
+    void ModelLoader::Cancel(HairModelLoad* load)
+    {
+        if (load->model != nullptr) {
+            ReleaseModelBuffers(load->model, pool);
+            memoryTracker->Release(load->model->memoryUsage);
+            delete load->model;
+            load->model = nullptr;
+        }
+        Remove(load);
+    }
+
+    void ModelLoader::Remove(HairModelLoad* load)
+    {
+        loads.erase(std::remove(loads.begin(), loads.end(), load), loads.end());
+        if (!load->read) {
+            cancelledLoads.push_back(load);
+            return;
+        }
+
+        // the worker has set read as its last step, joining doesn't wait
+        load->thread.join();
+        delete load;
+    }
+
+    void ModelLoader::ReapCancelledLoads()
+    {
+        for (size_t i = 0; i < cancelledLoads.size();) {
+            auto load = cancelledLoads[i];
+            if (!load->read) {
+                i++;
+                continue;
+            }
+
+            load->thread.join();
+            delete load;
+            cancelledLoads.erase(cancelledLoads.begin() + i);
+        }
+    }
+}
@@ -0,0 +1,89 @@
+#ifndef MODEL_LOADER_H
+#define MODEL_LOADER_H
+
+#include "Common.h"
+#include "MemoryTracker.h"
+#include <atomic>
+#include <exception>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace HairSimulation
+{
+    // Contents of one GPU buffer of a model, an empty data vector only allocates.
+    struct ModelBufferData
+    {
+        BufferRange HairModel::* buffer;
+        size_t size;
+        std::vector<uint8_t> data;
+    };
+
+    // Everything LoadModel computes before touching GL, so it can be built on any thread.
+    struct ModelData
+    {
+        uint32_t strandCount;
+        uint32_t segCount;
+        uint32_t trianglesCount;
+        float maxAreaWeight;
+        Vector3 boundsMin;
+        Vector3 boundsMax;
+        bool compactStorage;
+        std::vector<Vector4> strandReach;
+        std::vector<uint32_t> fileStrandIndices;
+        std::vector<ModelBufferData> buffers;
+    };
+
+    void ReadModel(const char* path, const HairLoadSettings& settings, ModelData& data);
+
+    // Creates the model and allocates its buffers from the pool, with upload false
+    // the buffers are only allocated.
+    HairModel* CreateModel(ModelData& data, bool upload, BufferPool* pool, MemoryTracker* memoryTracker);
+    void ReleaseModelBuffers(HairModel* model, BufferPool* pool);
+
+    class HairModelLoad
+    {
+    public:
+        std::thread thread;
+        std::atomic<bool> read;
+        std::exception_ptr error;
+        ModelData data;
+        HairModel* model;
+        size_t uploadedBuffers;
+        size_t uploadedBytes;
+
+        HairModelLoad();
+        HairModelLoad(const HairModelLoad&) = delete;
+    };
+
+    // Reads and precomputes models on worker threads, the render thread then
+    // uploads them through a staging buffer a bounded number of bytes per update.
+    // A load cancelled while its worker still reads waits in the cancelled list
+    // and is joined by a later update once the worker is done, so the render
+    // thread never blocks on a file read.
+    class ModelLoader
+    {
+    public:
+        ModelLoader(BufferPool* pool, MemoryTracker* memoryTracker);
+        ModelLoader(const ModelLoader&) = delete;
+        ~ModelLoader();
+        HairModelLoad* Start(const char* path, const HairLoadSettings& settings);
+        void Update(size_t uploadBudget);
+        HairModel* Take(HairModelLoad* load);
+        void Cancel(HairModelLoad* load);
+
+    private:
+        std::vector<HairModelLoad*> loads;
+        std::vector<HairModelLoad*> cancelledLoads;
+        BufferPool* pool;
+        MemoryTracker* memoryTracker;
+        uint32_t stagingBuffID;
+        size_t stagingSize;
+
+        void Upload(HairModelLoad* load, size_t& budget);
+        void Remove(HairModelLoad* load);
+        void ReapCancelledLoads();
+    };
+}
+
+#endif
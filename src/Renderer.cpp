@@ -2,19 +2,113 @@
 #include "gl/GLUtils.h"
 #include <vector>
 #include <algorithm>
+#include <math.h>
+#include <float.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdexcept>
 #include <hairsimulation/Math.h>
 #include "shaders/ShaderTypes.h"
+#include "shaders/EmbeddedShaders.h"
 
 namespace HairSimulation
 {
     const std::string GLSLVersion = "#version 430 core\n";
+    const std::string CompactStorageHeader = GLSLVersion + "#define COMPACT_STORAGE\n";
+    const std::string MultiViewHeader = GLSLVersion + "#define MULTI_VIEW\n";
 
-    HairRenderer::HairRenderer() :
-        strandVisualizationID(0),
-        rootVisualizationID(0),
+    // every program of the renderer, in the order they are stored in the program cache
+    uint32_t HairRenderer::* const HairRenderer::Programs[HairRenderer::ProgramsCount] = {
+        &HairRenderer::strandVisualizationID,
+        &HairRenderer::rootVisualizationID,
+        &HairRenderer::hairSimulationID,
+        &HairRenderer::hairFollowersID,
+        &HairRenderer::hairSimulationCompactID,
+        &HairRenderer::hairFollowersCompactID,
+        &HairRenderer::compactRestUnpackID,
+        &HairRenderer::hairRootSkinningID,
+        &HairRenderer::colliderMasksID,
+        &HairRenderer::hairCullingID,
+        &HairRenderer::hiZBuildID,
+        &HairRenderer::hairExpandID,
+        &HairRenderer::hairFollowerCacheID,
+        &HairRenderer::lightCullingID,
+        &HairRenderer::densitySplatID,
+        &HairRenderer::densityResolveID,
+        &HairRenderer::hairGridScatterID,
+        &HairRenderer::hairGridSmoothID,
+        &HairRenderer::hairRenderID,
+        &HairRenderer::hairMultiViewRenderID,
+        &HairRenderer::hairStripRenderID
+    };
+
+    std::string GetShaderSource(const char* name)
+    {
+        for (auto& shader : EmbeddedShaders) {
+            if (strcmp(shader.name, name) == 0) {
+                return shader.source;
+            }
+        }
+        throw std::runtime_error(std::string("Missing embedded shader ") + name);
+    }
+
+    void HashString(uint64_t& hash, const char* text)
+    {
+        for (auto c = text; *c != '\0'; c++) {
+            hash = (hash ^ (uint8_t)*c) * 0x100000001b3ull;
+        }
+        hash = (hash ^ 0xff) * 0x100000001b3ull;
+    }
+
+    // Changes with the driver, the embedded shaders and the variant headers.
+    uint64_t GetProgramCacheKey()
+    {
+        uint64_t hash = 0xcbf29ce484222325ull;
+        for (auto name : { GL_VENDOR, GL_RENDERER, GL_VERSION }) {
+            auto value = (const char*)glGetString(name);
+            HashString(hash, value != nullptr ? value : "");
+        }
+        HashString(hash, CompactStorageHeader.c_str());
+        HashString(hash, MultiViewHeader.c_str());
+        for (auto& shader : EmbeddedShaders) {
+            HashString(hash, shader.name);
+            HashString(hash, shader.source);
+        }
+        return hash;
+    }
+
+    // the density grid and its R16F volume, and the two buffers of the hair grid
+    const uint64_t DensityVolumeBytes = DENSITY_VOLUME_SIZE * DENSITY_VOLUME_SIZE * DENSITY_VOLUME_SIZE * (sizeof(uint32_t) + sizeof(uint16_t));
+    const uint64_t HairGridBytes = HAIR_GRID_SIZE * HAIR_GRID_SIZE * HAIR_GRID_SIZE * (4 * sizeof(int32_t) + 2 * sizeof(Vector4));
+
+    HairRenderer::HairRenderer(MemoryTracker* memoryTracker, const char* programCachePath) :
+        emptyVertexArrID(0),
+        memoryTracker(memoryTracker),
         hairSimulationID(0),
+        hairFollowersID(0),
+        hairSimulationCompactID(0),
+        hairFollowersCompactID(0),
+        hairRootSkinningID(0),
+        colliderMasksID(0),
+        compactRestUnpackID(0),
+        hairCullingID(0),
+        hiZBuildID(0),
+        hairExpandID(0),
+        hairStripRenderID(0),
+        hairFollowerCacheID(0),
+        lightCullingID(0),
+        densitySplatID(0),
+        densityResolveID(0),
+        hairGridScatterID(0),
+        hairGridSmoothID(0),
+        hiZTextureID(0),
+        hiZWidth(0),
+        hiZHeight(0),
+        hiZLevels(0),
         hairRenderID(0),
-        emptyVertexArrID(0)
+        hairMultiViewRenderID(0),
+        rootVisualizationID(0),
+        strandVisualizationID(0)
     {
         glGenVertexArrays(1, &emptyVertexArrID);
 
@@ -33,30 +127,157 @@ namespace HairSimulation
         glBufferData(GL_UNIFORM_BUFFER, sizeof(SceneRenderData), nullptr, GL_DYNAMIC_DRAW);
         glBindBuffer(GL_UNIFORM_BUFFER, 0);
 
+        glGenBuffers(1, &multiViewBuffID);
+        glBindBuffer(GL_UNIFORM_BUFFER, multiViewBuffID);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(MultiViewRenderData), nullptr, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+        glGenBuffers(1, &clusterBuffID);
+        glBindBuffer(GL_UNIFORM_BUFFER, clusterBuffID);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(ClusterRenderData), nullptr, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+        glGenBuffers(1, &clusterLightsBuffID);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, clusterLightsBuffID);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, MAX_VIEWS * CLUSTER_TILES_X * CLUSTER_TILES_Y * CLUSTER_SLICES * (MAX_LIGHTS_PER_CLUSTER + 1) * sizeof(int), nullptr, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+        HairLight defaultLight;
+        defaultLight.position = Vector3(5, 5, 5);
+        SetLights(&defaultLight, 1);
+
+        // a cache built by another driver or from other sources is rebuilt, a
+        // cache that cannot be written only costs the compilation next time
+        if (programCachePath == nullptr || !LoadPrograms(programCachePath)) {
+            CompilePrograms();
+            if (programCachePath != nullptr) {
+                uint32_t programIDs[ProgramsCount];
+                for (uint32_t i = 0; i < ProgramsCount; i++) {
+                    programIDs[i] = this->*Programs[i];
+                }
+                SaveProgramBinaries(programCachePath, GetProgramCacheKey(), programIDs, ProgramsCount);
+            }
+        }
+    }
+
+    bool HairRenderer::LoadPrograms(const char* programCachePath)
+    {
+        uint32_t programIDs[ProgramsCount];
+        if (!LoadProgramBinaries(programCachePath, GetProgramCacheKey(), programIDs, ProgramsCount)) {
+            return false;
+        }
+        for (uint32_t i = 0; i < ProgramsCount; i++) {
+            this->*Programs[i] = programIDs[i];
+        }
+        return true;
+    }
 
-        shaderIncludeSrc = LoadFile("HairSimulationshaders/ShaderTypes.h");
+    void HairRenderer::CompilePrograms()
+    {
+        std::string shaderIncludeSrc = GetShaderSource("ShaderTypes.h") + GetShaderSource("ShaderFunctions.glsl");
 
-        auto strandVisualizationVertShaderSource = LoadFile("HairSimulationshaders/StrandVisualization.vert");
-        auto strandVisualizationFragShaderSource = LoadFile("HairSimulationshaders/SimpleColor.frag");
+        auto strandVisualizationVertShaderSource = GetShaderSource("StrandVisualization.vert");
+        auto strandVisualizationFragShaderSource = GetShaderSource("SimpleColor.frag");
         uint32_t strandVisualizationVertShaderID = CompileShader(GLSLVersion, strandVisualizationVertShaderSource, GL_VERTEX_SHADER);
         uint32_t strandVisualizationFragShaderID = CompileShader(GLSLVersion, strandVisualizationFragShaderSource, GL_FRAGMENT_SHADER);
         strandVisualizationID = LinkProgram(strandVisualizationVertShaderID, strandVisualizationFragShaderID);
 
-        auto rootVisualizationVertShaderSource = LoadFile("HairSimulationshaders/RootVisualization.vert");
-        auto rootVisualizationFragShaderSource = LoadFile("HairSimulationshaders/SimpleColor.frag");
+        glDeleteShader(strandVisualizationVertShaderID);
+        glDeleteShader(strandVisualizationFragShaderID);
+
+        auto rootVisualizationVertShaderSource = GetShaderSource("RootVisualization.vert");
+        auto rootVisualizationFragShaderSource = GetShaderSource("SimpleColor.frag");
         uint32_t rootVisualizationVertShaderID = CompileShader(GLSLVersion, rootVisualizationVertShaderSource, GL_VERTEX_SHADER);
         uint32_t rootVisualizationFragShaderID = CompileShader(GLSLVersion, rootVisualizationFragShaderSource, GL_FRAGMENT_SHADER);
         rootVisualizationID = LinkProgram(rootVisualizationVertShaderID, rootVisualizationFragShaderID);
 
-        auto simulationShaderSource = LoadFile("HairSimulationshaders/HairSimulation.comp");
+        glDeleteShader(rootVisualizationVertShaderID);
+        glDeleteShader(rootVisualizationFragShaderID);
+
+        auto simulationShaderSource = GetShaderSource("HairSimulation.comp");
         uint32_t simulationShaderID = CompileShader(GLSLVersion, simulationShaderSource, GL_COMPUTE_SHADER, &shaderIncludeSrc);
         hairSimulationID = LinkProgram(simulationShaderID);
+        glDeleteShader(simulationShaderID);
+
+        auto followersShaderSource = GetShaderSource("HairFollowers.comp");
+        uint32_t followersShaderID = CompileShader(GLSLVersion, followersShaderSource, GL_COMPUTE_SHADER, &shaderIncludeSrc);
+        hairFollowersID = LinkProgram(followersShaderID);
+        glDeleteShader(followersShaderID);
+
+        // models loaded with compact storage unpack their rest data in the shaders
+        uint32_t compactSimulationShaderID = CompileShader(CompactStorageHeader, simulationShaderSource, GL_COMPUTE_SHADER, &shaderIncludeSrc);
+        hairSimulationCompactID = LinkProgram(compactSimulationShaderID);
+        uint32_t compactFollowersShaderID = CompileShader(CompactStorageHeader, followersShaderSource, GL_COMPUTE_SHADER, &shaderIncludeSrc);
+        hairFollowersCompactID = LinkProgram(compactFollowersShaderID);
+
+        glDeleteShader(compactSimulationShaderID);
+        glDeleteShader(compactFollowersShaderID);
+
+        auto compactRestUnpackShaderSource = GetShaderSource("CompactRestUnpack.comp");
+        uint32_t compactRestUnpackShaderID = CompileShader(GLSLVersion, compactRestUnpackShaderSource, GL_COMPUTE_SHADER, &shaderIncludeSrc);
+        compactRestUnpackID = LinkProgram(compactRestUnpackShaderID);
+        glDeleteShader(compactRestUnpackShaderID);
+
+        auto rootSkinningShaderSource = GetShaderSource("HairRootSkinning.comp");
+        uint32_t rootSkinningShaderID = CompileShader(GLSLVersion, rootSkinningShaderSource, GL_COMPUTE_SHADER, &shaderIncludeSrc);
+        hairRootSkinningID = LinkProgram(rootSkinningShaderID);
+        glDeleteShader(rootSkinningShaderID);
 
-        auto hairSimulationVertShaderSource = LoadFile("HairSimulationshaders/HairSimulation.vert");
-        auto hairSimulationTessControlShaderSource = LoadFile("HairSimulationshaders/HairSimulation.tesc");
-        auto hairSimulationTessEvaluationShaderSource = LoadFile("HairSimulationshaders/HairSimulation.tese");
-        auto hairGeomShaderSource = LoadFile("HairSimulationshaders/HairSimulation.geom");
-        auto hairSimulationFragShaderSource = LoadFile("HairSimulationshaders/HairSimulation.frag");
+        auto colliderMasksShaderSource = GetShaderSource("ColliderMasks.comp");
+        uint32_t colliderMasksShaderID = CompileShader(GLSLVersion, colliderMasksShaderSource, GL_COMPUTE_SHADER, &shaderIncludeSrc);
+        colliderMasksID = LinkProgram(colliderMasksShaderID);
+        glDeleteShader(colliderMasksShaderID);
+
+        auto cullingShaderSource = GetShaderSource("HairCulling.comp");
+        uint32_t cullingShaderID = CompileShader(GLSLVersion, cullingShaderSource, GL_COMPUTE_SHADER, &shaderIncludeSrc);
+        hairCullingID = LinkProgram(cullingShaderID);
+        glDeleteShader(cullingShaderID);
+
+        auto hiZBuildShaderSource = GetShaderSource("HiZBuild.comp");
+        uint32_t hiZBuildShaderID = CompileShader(GLSLVersion, hiZBuildShaderSource, GL_COMPUTE_SHADER, &shaderIncludeSrc);
+        hiZBuildID = LinkProgram(hiZBuildShaderID);
+        glDeleteShader(hiZBuildShaderID);
+
+        auto expandShaderSource = GetShaderSource("HairExpand.comp");
+        uint32_t expandShaderID = CompileShader(GLSLVersion, expandShaderSource, GL_COMPUTE_SHADER, &shaderIncludeSrc);
+        hairExpandID = LinkProgram(expandShaderID);
+        glDeleteShader(expandShaderID);
+
+        auto followerCacheShaderSource = GetShaderSource("HairFollowerCache.comp");
+        uint32_t followerCacheShaderID = CompileShader(GLSLVersion, followerCacheShaderSource, GL_COMPUTE_SHADER, &shaderIncludeSrc);
+        hairFollowerCacheID = LinkProgram(followerCacheShaderID);
+        glDeleteShader(followerCacheShaderID);
+
+        auto lightCullingShaderSource = GetShaderSource("LightCulling.comp");
+        uint32_t lightCullingShaderID = CompileShader(GLSLVersion, lightCullingShaderSource, GL_COMPUTE_SHADER, &shaderIncludeSrc);
+        lightCullingID = LinkProgram(lightCullingShaderID);
+        glDeleteShader(lightCullingShaderID);
+
+        auto densitySplatShaderSource = GetShaderSource("DensitySplat.comp");
+        uint32_t densitySplatShaderID = CompileShader(GLSLVersion, densitySplatShaderSource, GL_COMPUTE_SHADER, &shaderIncludeSrc);
+        densitySplatID = LinkProgram(densitySplatShaderID);
+        glDeleteShader(densitySplatShaderID);
+
+        auto densityResolveShaderSource = GetShaderSource("DensityResolve.comp");
+        uint32_t densityResolveShaderID = CompileShader(GLSLVersion, densityResolveShaderSource, GL_COMPUTE_SHADER, &shaderIncludeSrc);
+        densityResolveID = LinkProgram(densityResolveShaderID);
+        glDeleteShader(densityResolveShaderID);
+
+        auto gridScatterShaderSource = GetShaderSource("HairGridScatter.comp");
+        uint32_t gridScatterShaderID = CompileShader(GLSLVersion, gridScatterShaderSource, GL_COMPUTE_SHADER, &shaderIncludeSrc);
+        hairGridScatterID = LinkProgram(gridScatterShaderID);
+        glDeleteShader(gridScatterShaderID);
+
+        auto gridSmoothShaderSource = GetShaderSource("HairGridSmooth.comp");
+        uint32_t gridSmoothShaderID = CompileShader(GLSLVersion, gridSmoothShaderSource, GL_COMPUTE_SHADER, &shaderIncludeSrc);
+        hairGridSmoothID = LinkProgram(gridSmoothShaderID);
+        glDeleteShader(gridSmoothShaderID);
+
+        auto hairSimulationVertShaderSource = GetShaderSource("HairSimulation.vert");
+        auto hairSimulationTessControlShaderSource = GetShaderSource("HairSimulation.tesc");
+        auto hairSimulationTessEvaluationShaderSource = GetShaderSource("HairSimulation.tese");
+        auto hairGeomShaderSource = GetShaderSource("HairSimulation.geom");
+        auto hairSimulationFragShaderSource = GetShaderSource("HairSimulation.frag");
 
         uint32_t hairSimulationVertShaderID = CompileShader(GLSLVersion, hairSimulationVertShaderSource, GL_VERTEX_SHADER, &shaderIncludeSrc);
         uint32_t hairSimulationTessControlShaderID = CompileShader(GLSLVersion, hairSimulationTessControlShaderSource, GL_TESS_CONTROL_SHADER, &shaderIncludeSrc);
@@ -66,6 +287,22 @@ namespace HairSimulation
 
         hairRenderID = LinkProgram(hairSimulationVertShaderID, hairSimulationTessControlShaderID, hairSimulationTessEvaluationShaderID, hairSimulationGeomShaderID, hairSimulationFragShaderID);
 
+        // the multi view variant routes every view to its own viewport from a single draw
+        uint32_t multiViewTessControlShaderID = CompileShader(MultiViewHeader, hairSimulationTessControlShaderSource, GL_TESS_CONTROL_SHADER, &shaderIncludeSrc);
+        uint32_t multiViewGeomShaderID = CompileShader(MultiViewHeader, hairGeomShaderSource, GL_GEOMETRY_SHADER, &shaderIncludeSrc);
+        uint32_t multiViewFragShaderID = CompileShader(MultiViewHeader, hairSimulationFragShaderSource, GL_FRAGMENT_SHADER, &shaderIncludeSrc);
+        hairMultiViewRenderID = LinkProgram(hairSimulationVertShaderID, multiViewTessControlShaderID, hairSimulationTessEvaluationShaderID, multiViewGeomShaderID, multiViewFragShaderID);
+
+        glDeleteShader(multiViewTessControlShaderID);
+        glDeleteShader(multiViewGeomShaderID);
+        glDeleteShader(multiViewFragShaderID);
+
+        auto hairStripVertShaderSource = GetShaderSource("HairStrip.vert");
+        uint32_t hairStripVertShaderID = CompileShader(GLSLVersion, hairStripVertShaderSource, GL_VERTEX_SHADER, &shaderIncludeSrc);
+        hairStripRenderID = LinkProgram(hairStripVertShaderID, hairSimulationFragShaderID);
+
+        glDeleteShader(hairStripVertShaderID);
+
         glDeleteShader(hairSimulationVertShaderID);
         glDeleteShader(hairSimulationTessControlShaderID);
         glDeleteShader(hairSimulationTessEvaluationShaderID);
@@ -78,16 +315,217 @@ namespace HairSimulation
         auto asset = instance->model;
         auto settings = instance->config;
         auto viewProjectionMatrix = projectionMatrix * viewMatrix;
-        int verticesPerStrand = asset->segCount + 1;
 
         glEnable(GL_DEPTH_TEST);
-        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, REST_POSITIONS_BUFFER_BINDING, asset->restBuffID);
-        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, POSITIONS_BUFFER_BINDING, instance->posBuffID);
-        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, PREVIOUS_POSITIONS_BUFFER_BINDING, instance->prevPosBuffID);
-        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, HAIR_INDICES_BUFFER_BINDING, asset->hairIndicesBuffID);
-        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, TANGENTS_DISTANCES_BINDING, asset->tangentsBuffID);
+        BindInstanceBuffers(instance);
+        DrawDebugGeometry(instance, viewProjectionMatrix);
+
+        if (instance->config.renderHair) {
+            float detail = GetRenderDetail(instance, viewProjectionMatrix, projectionMatrix);
+
+            bool cullingEnabled = settings.frustumCulling || settings.occlusionCulling;
+            auto hairRenderData = PrepareHairRenderData(instance, detail, cullingEnabled, settings.renderPipeline);
+            UploadRenderData(hairRenderData);
+            UpdateDensityVolume(instance, hairRenderData);
+            UploadSceneData(viewMatrix, projectionMatrix);
+
+            HairRenderPass view;
+            view.viewMatrix = viewMatrix;
+            view.projectionMatrix = projectionMatrix;
+            CullLights(&view, 1);
+
+            instance->renderTimer.Begin();
+
+            int hairsPerTriangle = hairRenderData.hairsPerTriangle;
+            int pointsPerSegment = GetPointsPerSegment(hairRenderData);
+            int pointsPerHair = asset->segCount * pointsPerSegment + 1;
+            int stripVerticesPerTriangle = hairsPerTriangle * (pointsPerHair - 1) * 6;
+
+            if (cullingEnabled) {
+                CullTriangles(instance, &viewProjectionMatrix, 1, (std::max)(hairRenderData.rootWidth, hairRenderData.tipWidth), stripVerticesPerTriangle);
+            }
+
+            if (settings.renderPipeline == HairRenderPipeline::Compute) {
+                // the view dependent expansion overwrites any captured geometry
+                instance->geometryCaptured = false;
+                ExpandHair(instance, hairsPerTriangle, pointsPerSegment, cullingEnabled);
+                DrawHairStrips(instance, pointsPerHair, asset->trianglesCount * stripVerticesPerTriangle, cullingEnabled);
+            }
+            else {
+                if (hairRenderData.followerCacheEnabled) {
+                    UpdateFollowerCache(instance, hairsPerTriangle, cullingEnabled);
+                }
+                DrawTessellatedHair(instance, cullingEnabled, false);
+            }
+
+            instance->renderTimer.End();
+        }
+    }
+
+    void HairRenderer::RenderMultiView(const HairInstance* instance, const HairRenderPass* views, uint32_t viewsCount) const
+    {
+        auto asset = instance->model;
+        auto& settings = instance->config;
+        viewsCount = (std::min)(viewsCount, (uint32_t)MAX_VIEWS);
+        if (viewsCount == 0) {
+            return;
+        }
+
+        GLint currentViewport[4];
+        glGetIntegerv(GL_VIEWPORT, currentViewport);
+
+        glEnable(GL_DEPTH_TEST);
+        BindInstanceBuffers(instance);
+
+        // the clusters are built while the viewport still is the one the views default to
+        if (settings.renderHair) {
+            CullLights(views, viewsCount);
+        }
+
+        MultiViewRenderData multiViewData = {};
+        multiViewData.viewsCount = viewsCount;
+        Matrix4 viewProjectionMatrices[MAX_VIEWS];
+        float detail = 0.0f;
+
+        for (uint32_t i = 0; i < viewsCount; i++) {
+            auto& view = views[i];
+            GLint viewport[4] = { view.viewportX, view.viewportY, view.viewportWidth, view.viewportHeight };
+            if (view.viewportWidth <= 0) {
+                memcpy(viewport, currentViewport, sizeof(viewport));
+            }
+
+            viewProjectionMatrices[i] = view.projectionMatrix * view.viewMatrix;
+            multiViewData.views[i] = GetSceneRenderData(view.viewMatrix, view.projectionMatrix, viewport[2], viewport[3]);
+            detail = (std::max)(detail, GetRenderDetail(instance, viewProjectionMatrices[i], view.projectionMatrix));
+
+            glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+            DrawDebugGeometry(instance, viewProjectionMatrices[i]);
+        }
+
+        if (settings.renderHair) {
+            // glViewport above reset every viewport, the indexed ones are set last
+            for (uint32_t i = 0; i < viewsCount; i++) {
+                auto& view = views[i];
+                if (view.viewportWidth > 0) {
+                    glViewportIndexedf(i, (float)view.viewportX, (float)view.viewportY, (float)view.viewportWidth, (float)view.viewportHeight);
+                }
+                else {
+                    glViewportIndexedf(i, (float)currentViewport[0], (float)currentViewport[1], (float)currentViewport[2], (float)currentViewport[3]);
+                }
+            }
+
+            bool cullingEnabled = settings.frustumCulling || settings.occlusionCulling;
+            auto hairRenderData = PrepareHairRenderData(instance, detail, cullingEnabled, HairRenderPipeline::Tessellation);
+            UploadRenderData(hairRenderData);
+            UpdateDensityVolume(instance, hairRenderData);
+
+            glBindBuffer(GL_UNIFORM_BUFFER, multiViewBuffID);
+            glBufferData(GL_UNIFORM_BUFFER, sizeof(MultiViewRenderData), &multiViewData, GL_DYNAMIC_DRAW);
+            glBindBuffer(GL_UNIFORM_BUFFER, 0);
+            glBindBufferRange(GL_UNIFORM_BUFFER, MULTI_VIEW_DATA_BINDING, multiViewBuffID, 0, sizeof(MultiViewRenderData));
+
+            instance->renderTimer.Begin();
+
+            int hairsPerTriangle = hairRenderData.hairsPerTriangle;
+            int pointsPerHair = asset->segCount * GetPointsPerSegment(hairRenderData) + 1;
+            int stripVerticesPerTriangle = hairsPerTriangle * (pointsPerHair - 1) * 6;
+
+            if (cullingEnabled) {
+                CullTriangles(instance, viewProjectionMatrices, viewsCount, (std::max)(hairRenderData.rootWidth, hairRenderData.tipWidth), stripVerticesPerTriangle);
+            }
+
+            if (hairRenderData.followerCacheEnabled) {
+                UpdateFollowerCache(instance, hairsPerTriangle, cullingEnabled);
+            }
+            DrawTessellatedHair(instance, cullingEnabled, true);
+
+            instance->renderTimer.End();
+        }
+
+        glViewport(currentViewport[0], currentViewport[1], currentViewport[2], currentViewport[3]);
+    }
+
+    void HairRenderer::Render(const HairInstance* instance, const HairRenderPass* passes, uint32_t passesCount) const
+    {
+        auto asset = instance->model;
+        auto& settings = instance->config;
+
+        // the captured geometry has to serve every view, so it is neither culled
+        // nor reduced by the render LOD
+        auto hairRenderData = PrepareHairRenderData(instance, 1.0f, false, HairRenderPipeline::Compute);
+        int hairsPerTriangle = hairRenderData.hairsPerTriangle;
+        int pointsPerSegment = GetPointsPerSegment(hairRenderData);
+        int pointsPerHair = asset->segCount * pointsPerSegment + 1;
+        int stripVerticesCount = asset->trianglesCount * hairsPerTriangle * (pointsPerHair - 1) * 6;
+
+        // passes without a viewport draw into the target bound by the caller, which
+        // is also restored at the end
+        GLint currentFramebuffer = 0;
+        GLint currentViewport[4];
+        glGetIntegerv(GL_FRAMEBUFFER_BINDING, &currentFramebuffer);
+        glGetIntegerv(GL_VIEWPORT, currentViewport);
+
+        glEnable(GL_DEPTH_TEST);
+        BindInstanceBuffers(instance);
+
+        if (settings.renderHair) {
+            UploadRenderData(hairRenderData);
+            UpdateDensityVolume(instance, hairRenderData);
+            instance->renderTimer.Begin();
+
+            if (!instance->geometryCaptured || instance->capturedFrame != instance->frame) {
+                ExpandHair(instance, hairsPerTriangle, pointsPerSegment, false);
+                instance->geometryCaptured = true;
+                instance->capturedFrame = instance->frame;
+            }
+        }
 
-        if (settings.renderStrands) {
+        for (uint32_t i = 0; i < passesCount; i++) {
+            auto& pass = passes[i];
+            if (pass.viewportWidth > 0) {
+                glBindFramebuffer(GL_FRAMEBUFFER, pass.framebufferID);
+                glViewport(pass.viewportX, pass.viewportY, pass.viewportWidth, pass.viewportHeight);
+            }
+            else {
+                glBindFramebuffer(GL_FRAMEBUFFER, currentFramebuffer);
+                glViewport(currentViewport[0], currentViewport[1], currentViewport[2], currentViewport[3]);
+            }
+
+            DrawDebugGeometry(instance, pass.projectionMatrix * pass.viewMatrix);
+
+            if (settings.renderHair) {
+                UploadSceneData(pass.viewMatrix, pass.projectionMatrix);
+                CullLights(&pass, 1);
+                DrawHairStrips(instance, pointsPerHair, stripVerticesCount, false);
+            }
+        }
+
+        glBindFramebuffer(GL_FRAMEBUFFER, currentFramebuffer);
+        glViewport(currentViewport[0], currentViewport[1], currentViewport[2], currentViewport[3]);
+
+        if (settings.renderHair) {
+            instance->renderTimer.End();
+        }
+    }
+
+    void HairRenderer::BindInstanceBuffers(const HairInstance* instance) const
+    {
+        auto asset = instance->model;
+
+        BindBufferRange(REST_POSITIONS_BUFFER_BINDING, asset->restBuffer);
+        BindBufferRange(POSITIONS_BUFFER_BINDING, instance->posBuffer);
+        BindBufferRange(PREVIOUS_POSITIONS_BUFFER_BINDING, instance->prevPosBuffer);
+        BindBufferRange(HAIR_INDICES_BUFFER_BINDING, asset->hairIndicesBuffer);
+        BindBufferRange(TANGENTS_DISTANCES_BINDING, asset->tangentsBuffer);
+        BindBufferRange(FOLLOWER_COORDS_BINDING, asset->followerCoordsBuffer);
+    }
+
+    void HairRenderer::DrawDebugGeometry(const HairInstance* instance, const Matrix4& viewProjectionMatrix) const
+    {
+        auto asset = instance->model;
+        int verticesPerStrand = asset->segCount + 1;
+
+        if (instance->config.renderStrands) {
             glUseProgram(strandVisualizationID);
 
             glUniformMatrix4fv(glGetUniformLocation(strandVisualizationID, "viewProjectionMatrix"), 1, false, (float*)viewProjectionMatrix.m);
@@ -111,102 +549,899 @@ namespace HairSimulation
             glDrawArrays(GL_LINES, 0, asset->trianglesCount * 6);
             glUseProgram(0);
         }
+    }
 
-        if (instance->config.renderHair) {
-            auto inversedViewMatrix = viewMatrix.EuclidianInversed();
-
-            HairRenderData hairRenderData = {};
-            hairRenderData.tesselationFactor = settings.tesselationFactor;
-            hairRenderData.segmentsCount = instance->model->segCount;
-            hairRenderData.rootWidth = settings.rootWidth;
-            hairRenderData.tipWidth = settings.tipWidth;
-            hairRenderData.density = settings.density;
-            hairRenderData.color = settings.color;
-            hairRenderData.ambient = settings.ambientStrength;
-            hairRenderData.diffuse = settings.diffuseStrength;
-            hairRenderData.specular = settings.specularStrength;
-            hairRenderData.specularPower = settings.specularPow;
-            hairRenderData.thinningStart = settings.thinningStart;
-
-            SceneRenderData sceneRenderData = {};
-            sceneRenderData.viewProjectionMatrix = viewProjectionMatrix;
-            sceneRenderData.eyePosition = inversedViewMatrix.m[3].XYZ();
-
-            LightRenderData lightData = {};
-            lightData.lightsCount = 1;
-            lightData.lights[0].position = { 5, 5, 5 };
-            lightData.lights[0].color = { 1, 1, 1, 1 };
-
-            glBindBuffer(GL_UNIFORM_BUFFER, hairBuffID);
-            glBufferData(GL_UNIFORM_BUFFER, sizeof(HairRenderData), &hairRenderData, GL_DYNAMIC_DRAW);
-            glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    float HairRenderer::GetRenderDetail(const HairInstance* instance, const Matrix4& viewProjectionMatrix, const Matrix4& projectionMatrix) const
+    {
+        auto& settings = instance->config;
+        if (!settings.renderLOD) {
+            return 1.0f;
+        }
 
-            glBindBuffer(GL_UNIFORM_BUFFER, sceneBuffID);
-            glBufferData(GL_UNIFORM_BUFFER, sizeof(SceneRenderData), &sceneRenderData, GL_DYNAMIC_DRAW);
-            glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        float coverage = EstimateScreenCoverage(instance, viewProjectionMatrix, projectionMatrix);
+        return (std::max)((std::min)(coverage / settings.lodFullDetailSize, 1.0f), settings.lodMinDetail);
+    }
 
-            glBindBuffer(GL_UNIFORM_BUFFER, lightBuffID);
-            glBufferData(GL_UNIFORM_BUFFER, sizeof(LightRenderData), &lightData, GL_DYNAMIC_DRAW);
-            glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    HairRenderData HairRenderer::PrepareHairRenderData(const HairInstance* instance, float detail, bool cullingEnabled, HairRenderPipeline pipeline) const
+    {
+        auto asset = instance->model;
+        auto& settings = instance->config;
+
+        // fewer but wider hairs keep the covered area of the instance constant
+        float density = (std::max)(settings.density * detail, 1.0f);
+        float tesselationFactor = (std::max)(settings.tesselationFactor * detail, 1.0f);
+        float widthScale = 1.0f;
+
+        uint32_t trianglesCount = (std::max)(cullingEnabled ? instance->statistics.visibleTrianglesCount : asset->trianglesCount, 1u);
+
+        if (settings.hairBudget > 0) {
+            density = (std::max)((std::min)(density, (float)settings.hairBudget / trianglesCount), 1.0f);
+        }
+
+        density = LimitRenderCacheDensity(instance, density, tesselationFactor, pipeline);
+
+        if (density < settings.density) {
+            widthScale = settings.density / density;
+        }
+
+        // the tessellator rounds the levels up the same way, with area weighting
+        // the largest triangle sets the number of hair slots per triangle
+        float maxDensity = settings.areaWeightedDensity ? density * asset->maxAreaWeight : density;
+        int hairsPerTriangle = (std::min)((std::max)((int)ceilf(maxDensity), 1), MAX_HAIRS_PER_TRIANGLE);
+
+        if (settings.tessellationBudget > 0) {
+            // the budget caps the worst case, adaptive levels usually stay well below it
+            float hairsCount = (float)trianglesCount * asset->segCount * (settings.areaWeightedDensity ? ceilf(density) : hairsPerTriangle);
+            float maxTesselationFactor = settings.tessellationBudget / hairsCount - 1.0f;
+            tesselationFactor = (std::max)((std::min)(tesselationFactor, maxTesselationFactor), 1.0f);
+        }
+
+        HairRenderData hairRenderData = {};
+        hairRenderData.tesselationFactor = tesselationFactor;
+        hairRenderData.segmentsCount = asset->segCount;
+        hairRenderData.rootWidth = settings.rootWidth * widthScale;
+        hairRenderData.tipWidth = settings.tipWidth * widthScale;
+        hairRenderData.density = density;
+        hairRenderData.color = settings.color;
+        hairRenderData.ambient = settings.ambientStrength;
+        hairRenderData.diffuse = settings.diffuseStrength;
+        hairRenderData.specular = settings.specularStrength;
+        hairRenderData.specularPower = settings.specularPow;
+        hairRenderData.thinningStart = settings.thinningStart;
+        hairRenderData.cullingEnabled = cullingEnabled;
+        hairRenderData.followerCacheEnabled = settings.followerCache && settings.renderPipeline == HairRenderPipeline::Tessellation;
+        hairRenderData.adaptiveTessellation = settings.adaptiveTessellation;
+        hairRenderData.tessellationPixelError = (std::max)(settings.tessellationPixelError, 0.01f);
+        hairRenderData.hairsPerTriangle = hairsPerTriangle;
+        hairRenderData.areaWeightedDensity = settings.areaWeightedDensity;
+        hairRenderData.selfShadowing = settings.selfShadowing && (instance->densityVolumeTexID != 0 || memoryTracker->Fits(DensityVolumeBytes));
+        hairRenderData.selfShadowStrength = settings.selfShadowStrength;
+
+        GetInstanceVolume(instance, hairRenderData.densityVolumeMin, hairRenderData.densityVolumeScale);
+
+        return hairRenderData;
+    }
+
+    // The expanded strands or the follower cache of the instance may grow into what
+    // is left of the memory budget and what they already hold, beyond that the
+    // density is lowered and the hairs get wider.
+    float HairRenderer::LimitRenderCacheDensity(const HairInstance* instance, float density, float tesselationFactor, HairRenderPipeline pipeline) const
+    {
+        auto asset = instance->model;
+        auto& settings = instance->config;
+
+        size_t bytesPerHair = 0;
+        size_t capacity = 0;
+        if (pipeline == HairRenderPipeline::Compute) {
+            int pointsPerSegment = (std::min)((std::max)((int)ceilf(tesselationFactor), 1), MAX_POINTS_PER_SEGMENT);
+            bytesPerHair = (asset->segCount * pointsPerSegment + 1) * sizeof(StrandVertex);
+            capacity = instance->strandVerticesCapacity;
+        }
+        else if (settings.followerCache) {
+            bytesPerHair = (asset->segCount + 1) * sizeof(Vector4);
+            capacity = instance->followerCacheCapacity;
+        }
+
+        uint64_t available = memoryTracker->GetAvailable();
+        if (bytesPerHair == 0 || available == UINT64_MAX) {
+            return density;
+        }
+
+        uint64_t maxHairsPerTriangle = (available + capacity) / ((uint64_t)(std::max)(asset->trianglesCount, 1u) * bytesPerHair);
+        float maxDensity = settings.areaWeightedDensity ? maxHairsPerTriangle / asset->maxAreaWeight : (float)maxHairsPerTriangle;
+        return (std::max)((std::min)(density, maxDensity), 1.0f);
+    }
+
+    // The volume is built in the space of the simulated positions: the roots follow the
+    // whole model matrix while the strands keep their rest shape and are only rotated,
+    // so the rigidly placed rest bounds grow by how far the scaled roots can move.
+    void HairRenderer::GetInstanceVolume(const HairInstance* instance, Vector3& volumeMin, Vector3& volumeScale) const
+    {
+        auto asset = instance->model;
+        auto& modelMatrix = instance->config.modelMatrix;
+
+        Matrix4 rigidMatrix = modelMatrix;
+        for (int i = 0; i < 3; i++) {
+            float scale = (std::max)(modelMatrix.m[i].XYZ().Length(), 1e-6f);
+            rigidMatrix.m[i] = modelMatrix.m[i] * (1.0f / scale);
+        }
+
+        Vector3 shapeMin(FLT_MAX, FLT_MAX, FLT_MAX);
+        Vector3 shapeMax(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+        Vector3 rootMin(FLT_MAX, FLT_MAX, FLT_MAX);
+        Vector3 rootMax(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+        for (int i = 0; i < 8; i++) {
+            Vector3 corner((i & 1) ? asset->boundsMax.x : asset->boundsMin.x,
+                (i & 2) ? asset->boundsMax.y : asset->boundsMin.y,
+                (i & 4) ? asset->boundsMax.z : asset->boundsMin.z);
+            Vector3 rigidCorner = TransformPoint(rigidMatrix, corner);
+            Vector3 rootOffset = TransformPoint(modelMatrix, corner) - rigidCorner;
+            for (int j = 0; j < 3; j++) {
+                shapeMin[j] = (std::min)(shapeMin[j], rigidCorner[j]);
+                shapeMax[j] = (std::max)(shapeMax[j], rigidCorner[j]);
+                rootMin[j] = (std::min)(rootMin[j], rootOffset[j]);
+                rootMax[j] = (std::max)(rootMax[j], rootOffset[j]);
+            }
+        }
+
+        // room for the strands to swing
+        for (int j = 0; j < 3; j++) {
+            volumeMin[j] = shapeMin[j] + rootMin[j];
+            float volumeMax = shapeMax[j] + rootMax[j];
+            float margin = (std::max)((volumeMax - volumeMin[j]) * 0.25f, 1e-3f);
+            volumeMin[j] -= margin;
+            volumeMax += margin;
+            volumeScale[j] = 1.0f / (volumeMax - volumeMin[j]);
+        }
+    }
+
+    int HairRenderer::GetPointsPerSegment(const HairRenderData& hairRenderData) const
+    {
+        return (std::min)((std::max)((int)ceilf(hairRenderData.tesselationFactor), 1), MAX_POINTS_PER_SEGMENT);
+    }
+
+    void HairRenderer::UploadRenderData(const HairRenderData& hairRenderData) const
+    {
+        glBindBuffer(GL_UNIFORM_BUFFER, hairBuffID);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(HairRenderData), &hairRenderData, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+        glBindBufferRange(GL_UNIFORM_BUFFER, HAIR_DATA_BINDING, hairBuffID, 0, sizeof(HairRenderData));
+        glBindBufferRange(GL_UNIFORM_BUFFER, SCENE_DATA_BINDING, sceneBuffID, 0, sizeof(SceneRenderData));
+        glBindBufferRange(GL_UNIFORM_BUFFER, LIGHT_DATA_BINDING, lightBuffID, 0, sizeof(LightRenderData));
+        glBindBufferRange(GL_UNIFORM_BUFFER, CLUSTER_DATA_BINDING, clusterBuffID, 0, sizeof(ClusterRenderData));
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, CLUSTER_LIGHTS_BINDING, clusterLightsBuffID);
+    }
+
+    SceneRenderData HairRenderer::GetSceneRenderData(const Matrix4& viewMatrix, const Matrix4& projectionMatrix, int viewportWidth, int viewportHeight) const
+    {
+        auto inversedViewMatrix = viewMatrix.EuclidianInversed();
+
+        SceneRenderData sceneRenderData = {};
+        sceneRenderData.viewProjectionMatrix = projectionMatrix * viewMatrix;
+        sceneRenderData.eyePosition = inversedViewMatrix.m[3].XYZ();
+        sceneRenderData.viewportWidth = (float)viewportWidth;
+        sceneRenderData.viewportHeight = (float)viewportHeight;
+
+        return sceneRenderData;
+    }
 
-            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, POSITIONS_BUFFER_BINDING, instance->posBuffID);
-            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, HAIR_INDICES_BUFFER_BINDING, asset->hairIndicesBuffID);
+    void HairRenderer::UploadSceneData(const Matrix4& viewMatrix, const Matrix4& projectionMatrix) const
+    {
+        GLint viewport[4];
+        glGetIntegerv(GL_VIEWPORT, viewport);
+        auto sceneRenderData = GetSceneRenderData(viewMatrix, projectionMatrix, viewport[2], viewport[3]);
+
+        glBindBuffer(GL_UNIFORM_BUFFER, sceneBuffID);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(SceneRenderData), &sceneRenderData, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+
+    void HairRenderer::UpdateDensityVolume(const HairInstance* instance, const HairRenderData& hairRenderData) const
+    {
+        auto model = instance->model;
+        if (!hairRenderData.selfShadowing) {
+            return;
+        }
+
+        if (instance->densityVolumeTexID == 0) {
+            memoryTracker->Add(&instance->memoryUsage, &HairMemoryUsage::dynamicData, DensityVolumeBytes);
+
+            glGenBuffers(1, &instance->densityGridBuffID);
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, instance->densityGridBuffID);
+            glBufferData(GL_SHADER_STORAGE_BUFFER, DENSITY_VOLUME_SIZE * DENSITY_VOLUME_SIZE * DENSITY_VOLUME_SIZE * sizeof(uint32_t), nullptr, GL_DYNAMIC_DRAW);
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+            glGenTextures(1, &instance->densityVolumeTexID);
+            glBindTexture(GL_TEXTURE_3D, instance->densityVolumeTexID);
+            glTexStorage3D(GL_TEXTURE_3D, 1, GL_R16F, DENSITY_VOLUME_SIZE, DENSITY_VOLUME_SIZE, DENSITY_VOLUME_SIZE);
+            glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+            glBindTexture(GL_TEXTURE_3D, 0);
+        }
 
-            glUseProgram(hairRenderID);
+        // strands only move when simulated, every light and view of a frame shares the volume
+        if (!instance->densityVolumeBuilt || instance->densityVolumeFrame != instance->frame) {
+            instance->densityTimer.Begin();
 
-            glBindBufferRange(GL_UNIFORM_BUFFER, HAIR_DATA_BINDING, hairBuffID, 0, sizeof(HairRenderData));
-            glBindBufferRange(GL_UNIFORM_BUFFER, SCENE_DATA_BINDING, sceneBuffID, 0, sizeof(SceneRenderData));
-            glBindBufferRange(GL_UNIFORM_BUFFER, LIGHT_DATA_BINDING, lightBuffID, 0, sizeof(LightRenderData));
+            uint32_t zero = 0;
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, instance->densityGridBuffID);
+            glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+            glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
 
-            glPatchParameteri(GL_PATCH_VERTICES, 1);
-            glDrawArrays(GL_PATCHES, 0, asset->trianglesCount * asset->segCount);
+            BindBufferRange(POSITIONS_BUFFER_BINDING, instance->posBuffer);
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, DENSITY_GRID_BINDING, instance->densityGridBuffID);
+
+            uint32_t verticesCount = model->strandCount * (model->segCount + 1);
+            glUseProgram(densitySplatID);
+            glUniform1i(glGetUniformLocation(densitySplatID, "verticesCount"), verticesCount);
+            glUniform3fv(glGetUniformLocation(densitySplatID, "volumeMin"), 1, (float*)&hairRenderData.densityVolumeMin);
+            glUniform3fv(glGetUniformLocation(densitySplatID, "volumeScale"), 1, (float*)&hairRenderData.densityVolumeScale);
+            glDispatchCompute((verticesCount + 63) / 64, 1, 1);
+            glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+            glUseProgram(densityResolveID);
+            glBindImageTexture(0, instance->densityVolumeTexID, 0, GL_TRUE, 0, GL_WRITE_ONLY, GL_R16F);
+            glDispatchCompute(DENSITY_VOLUME_SIZE / 4, DENSITY_VOLUME_SIZE / 4, DENSITY_VOLUME_SIZE / 4);
             glUseProgram(0);
+            glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+
+            instance->densityTimer.End();
+            instance->densityVolumeBuilt = true;
+            instance->densityVolumeFrame = instance->frame;
+        }
+
+        glActiveTexture(GL_TEXTURE0 + DENSITY_VOLUME_TEXTURE_UNIT);
+        glBindTexture(GL_TEXTURE_3D, instance->densityVolumeTexID);
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    void HairRenderer::CullLights(const HairRenderPass* views, uint32_t viewsCount) const
+    {
+        GLint currentViewport[4];
+        glGetIntegerv(GL_VIEWPORT, currentViewport);
+
+        ClusterRenderData clusterData = {};
+        for (uint32_t i = 0; i < viewsCount; i++) {
+            auto& view = views[i];
+            auto& clusterView = clusterData.views[i];
+            auto& projection = view.projectionMatrix.m;
+
+            clusterView.viewMatrix = view.viewMatrix;
+            clusterView.projectionMatrix = view.projectionMatrix;
+            if (view.viewportWidth > 0) {
+                clusterView.viewport = Vector4((float)view.viewportX, (float)view.viewportY, (float)view.viewportWidth, (float)view.viewportHeight);
+            }
+            else {
+                clusterView.viewport = Vector4((float)currentViewport[0], (float)currentViewport[1], (float)currentViewport[2], (float)currentViewport[3]);
+            }
+
+            // clip planes of a perspective projection, the slices are spaced
+            // exponentially between them
+            float zNear = projection[3][2] / (projection[2][2] - 1.0f);
+            float zFar = projection[3][2] / (projection[2][2] + 1.0f);
+            zNear = (std::max)(zNear, 1e-4f);
+            zFar = (std::max)(zFar, zNear * 1.01f);
+            clusterView.depthRange = Vector4(zNear, zFar, CLUSTER_SLICES / logf(zFar / zNear), 0.0f);
+        }
+
+        glBindBuffer(GL_UNIFORM_BUFFER, clusterBuffID);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(ClusterRenderData), &clusterData, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+        glBindBufferRange(GL_UNIFORM_BUFFER, LIGHT_DATA_BINDING, lightBuffID, 0, sizeof(LightRenderData));
+        glBindBufferRange(GL_UNIFORM_BUFFER, CLUSTER_DATA_BINDING, clusterBuffID, 0, sizeof(ClusterRenderData));
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, CLUSTER_LIGHTS_BINDING, clusterLightsBuffID);
+
+        glUseProgram(lightCullingID);
+        int clustersPerView = CLUSTER_TILES_X * CLUSTER_TILES_Y * CLUSTER_SLICES;
+        glDispatchCompute((clustersPerView + 63) / 64, viewsCount, 1);
+        glUseProgram(0);
+
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    }
+
+    void HairRenderer::SetLights(const HairLight* lights, uint32_t lightsCount)
+    {
+        LightRenderData lightData = {};
+        lightData.lightsCount = lightsCount;
+        for (uint32_t i = 0; i < lightsCount; i++) {
+            lightData.lights[i].position = lights[i].position;
+            lightData.lights[i].radius = lights[i].radius;
+            lightData.lights[i].color = lights[i].color;
+        }
+
+        glBindBuffer(GL_UNIFORM_BUFFER, lightBuffID);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(LightRenderData), &lightData, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+
+    void HairRenderer::UpdateFollowerCache(const HairInstance* instance, int hairsPerTriangle, bool cullingEnabled) const
+    {
+        auto model = instance->model;
+
+        size_t requiredSize = (size_t)model->trianglesCount * hairsPerTriangle * (model->segCount + 1) * sizeof(Vector4);
+        if (requiredSize > instance->followerCacheCapacity) {
+            if (instance->followerCacheBuffID == 0) {
+                glGenBuffers(1, &instance->followerCacheBuffID);
+            }
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, instance->followerCacheBuffID);
+            glBufferData(GL_SHADER_STORAGE_BUFFER, requiredSize, nullptr, GL_DYNAMIC_DRAW);
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+            memoryTracker->Add(&instance->memoryUsage, &HairMemoryUsage::dynamicData, requiredSize - instance->followerCacheCapacity);
+            instance->followerCacheCapacity = requiredSize;
+        }
+
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, VISIBLE_TRIANGLES_BINDING, instance->visibleTrianglesBuffID);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, FOLLOWER_CACHE_BINDING, instance->followerCacheBuffID);
+
+        glUseProgram(hairFollowerCacheID);
+        glUniform1i(glGetUniformLocation(hairFollowerCacheID, "hairsPerTriangle"), hairsPerTriangle);
+
+        if (cullingEnabled) {
+            glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, instance->cullingCommandsBuffID);
+            glDispatchComputeIndirect(offsetof(CullingCommands, groupsX));
+            glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, 0);
+        }
+        else {
+            glDispatchCompute(model->trianglesCount, 1, 1);
+        }
+
+        glUseProgram(0);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    }
+
+    void HairRenderer::DrawTessellatedHair(const HairInstance* instance, bool cullingEnabled, bool multiView) const
+    {
+        auto model = instance->model;
+
+        glUseProgram(multiView ? hairMultiViewRenderID : hairRenderID);
+        glBindVertexArray(emptyVertexArrID);
+        glPatchParameteri(GL_PATCH_VERTICES, 1);
+
+        if (cullingEnabled) {
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, VISIBLE_TRIANGLES_BINDING, instance->visibleTrianglesBuffID);
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, instance->cullingCommandsBuffID);
+            glDrawArraysIndirect(GL_PATCHES, nullptr);
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+        }
+        else {
+            glDrawArrays(GL_PATCHES, 0, model->trianglesCount * model->segCount);
+        }
+        glUseProgram(0);
+    }
+
+    void HairRenderer::ExpandHair(const HairInstance* instance, int hairsPerTriangle, int pointsPerSegment, bool cullingEnabled) const
+    {
+        auto model = instance->model;
+        int pointsPerHair = model->segCount * pointsPerSegment + 1;
+
+        size_t requiredSize = (size_t)model->trianglesCount * hairsPerTriangle * pointsPerHair * sizeof(StrandVertex);
+        if (requiredSize > instance->strandVerticesCapacity) {
+            if (instance->strandVerticesBuffID == 0) {
+                glGenBuffers(1, &instance->strandVerticesBuffID);
+            }
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, instance->strandVerticesBuffID);
+            glBufferData(GL_SHADER_STORAGE_BUFFER, requiredSize, nullptr, GL_DYNAMIC_DRAW);
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+            memoryTracker->Add(&instance->memoryUsage, &HairMemoryUsage::dynamicData, requiredSize - instance->strandVerticesCapacity);
+            instance->strandVerticesCapacity = requiredSize;
+        }
+
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, VISIBLE_TRIANGLES_BINDING, instance->visibleTrianglesBuffID);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, STRAND_VERTICES_BINDING, instance->strandVerticesBuffID);
+
+        glUseProgram(hairExpandID);
+        glUniform1i(glGetUniformLocation(hairExpandID, "hairsPerTriangle"), hairsPerTriangle);
+        glUniform1i(glGetUniformLocation(hairExpandID, "pointsPerSegment"), pointsPerSegment);
+
+        if (cullingEnabled) {
+            glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, instance->cullingCommandsBuffID);
+            glDispatchComputeIndirect(offsetof(CullingCommands, groupsX));
+            glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, 0);
+        }
+        else {
+            glDispatchCompute(model->trianglesCount, 1, 1);
+        }
+
+        glUseProgram(0);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    }
+
+    void HairRenderer::DrawHairStrips(const HairInstance* instance, int pointsPerHair, int verticesCount, bool cullingEnabled) const
+    {
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, STRAND_VERTICES_BINDING, instance->strandVerticesBuffID);
+
+        glUseProgram(hairStripRenderID);
+        glBindVertexArray(emptyVertexArrID);
+        glUniform1i(glGetUniformLocation(hairStripRenderID, "pointsPerHair"), pointsPerHair);
+
+        if (cullingEnabled) {
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, instance->cullingCommandsBuffID);
+            glDrawArraysIndirect(GL_TRIANGLES, (void*)offsetof(CullingCommands, stripCount));
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+        }
+        else {
+            glDrawArrays(GL_TRIANGLES, 0, verticesCount);
+        }
+        glUseProgram(0);
+    }
+
+    void HairRenderer::CullTriangles(const HairInstance* instance, const Matrix4* viewProjectionMatrices, int viewsCount, float maxHairWidth, int stripVerticesPerTriangle) const
+    {
+        auto model = instance->model;
+        auto& settings = instance->config;
+
+        // counters are read from the copy of an earlier frame once its fence has
+        // passed, so the statistics never stall the pipeline
+        uint32_t readIndex = (instance->renderedFrames + 1) % 2;
+        GLsync readFence = instance->cullingStatsFences[readIndex];
+        if (readFence && glClientWaitSync(readFence, 0, 0) != GL_TIMEOUT_EXPIRED) {
+            CullingCommands previousCommands;
+            glBindBuffer(GL_COPY_READ_BUFFER, instance->cullingStatsBuffIDs[readIndex]);
+            glGetBufferSubData(GL_COPY_READ_BUFFER, 0, sizeof(CullingCommands), &previousCommands);
+            instance->statistics.visibleTrianglesCount = previousCommands.visibleTriangles;
+
+            glDeleteSync(readFence);
+            instance->cullingStatsFences[readIndex] = nullptr;
+        }
+
+        CullingCommands commands = {};
+        commands.instanceCount = 1;
+        commands.stripInstanceCount = 1;
+        commands.groupsY = 1;
+        commands.groupsZ = 1;
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, instance->cullingCommandsBuffID);
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(CullingCommands), &commands);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+        Vector4 frustumPlanes[6 * MAX_VIEWS];
+        for (int view = 0; view < viewsCount; view++) {
+            auto& viewProjectionMatrix = viewProjectionMatrices[view];
+            for (int i = 0; i < 3; i++) {
+                for (int j = 0; j < 4; j++) {
+                    frustumPlanes[view * 6 + i * 2].m[j] = viewProjectionMatrix.m[j][3] + viewProjectionMatrix.m[j][i];
+                    frustumPlanes[view * 6 + i * 2 + 1].m[j] = viewProjectionMatrix.m[j][3] - viewProjectionMatrix.m[j][i];
+                }
+            }
+        }
+
+        // the Hi-Z pyramid belongs to a single view
+        bool occlusionCulling = settings.occlusionCulling && hiZTextureID != 0 && viewsCount == 1;
+        bool frustumCulling = settings.frustumCulling;
+        if (!frustumCulling) {
+            for (auto& plane : frustumPlanes) {
+                plane = Vector4(0.0f, 0.0f, 0.0f, 1.0f);
+            }
+        }
+
+        glUseProgram(hairCullingID);
+
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, CULLING_COMMANDS_BINDING, instance->cullingCommandsBuffID);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, VISIBLE_TRIANGLES_BINDING, instance->visibleTrianglesBuffID);
+
+        glUniform1i(glGetUniformLocation(hairCullingID, "verticesPerStrand"), model->segCount + 1);
+        glUniform1i(glGetUniformLocation(hairCullingID, "trianglesCount"), model->trianglesCount);
+        glUniform1f(glGetUniformLocation(hairCullingID, "maxHairWidth"), maxHairWidth);
+        glUniform1i(glGetUniformLocation(hairCullingID, "stripVerticesPerTriangle"), stripVerticesPerTriangle);
+        glUniform1i(glGetUniformLocation(hairCullingID, "viewsCount"), viewsCount);
+        glUniform4fv(glGetUniformLocation(hairCullingID, "frustumPlanes"), 6 * viewsCount, (float*)frustumPlanes);
+        glUniformMatrix4fv(glGetUniformLocation(hairCullingID, "viewProjectionMatrix"), 1, false, (float*)viewProjectionMatrices[0].m);
+        glUniform1i(glGetUniformLocation(hairCullingID, "occlusionCulling"), occlusionCulling);
+
+        if (occlusionCulling) {
+            glUniform1i(glGetUniformLocation(hairCullingID, "hiZLevels"), hiZLevels);
+            glUniform2f(glGetUniformLocation(hairCullingID, "hiZSize"), (float)hiZWidth, (float)hiZHeight);
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D, hiZTextureID);
+        }
+
+        glDispatchCompute((model->trianglesCount + 63) / 64, 1, 1);
+        glUseProgram(0);
+
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+
+        uint32_t writeIndex = instance->renderedFrames % 2;
+        if (instance->cullingStatsFences[writeIndex] == nullptr) {
+            glBindBuffer(GL_COPY_READ_BUFFER, instance->cullingCommandsBuffID);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, instance->cullingStatsBuffIDs[writeIndex]);
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, sizeof(CullingCommands));
+            glBindBuffer(GL_COPY_READ_BUFFER, 0);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+            instance->cullingStatsFences[writeIndex] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        }
+
+        instance->renderedFrames++;
+    }
+
+    void HairRenderer::BuildOcclusionPyramid(uint32_t depthTextureID, uint32_t width, uint32_t height)
+    {
+        if (width != hiZWidth || height != hiZHeight) {
+            glDeleteTextures(1, &hiZTextureID);
+
+            hiZWidth = width;
+            hiZHeight = height;
+            hiZLevels = 1;
+            while ((std::max)(hiZWidth, hiZHeight) >> hiZLevels) {
+                hiZLevels++;
+            }
+
+            glGenTextures(1, &hiZTextureID);
+            glBindTexture(GL_TEXTURE_2D, hiZTextureID);
+            glTexStorage2D(GL_TEXTURE_2D, hiZLevels, GL_R32F, hiZWidth, hiZHeight);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+            glBindTexture(GL_TEXTURE_2D, 0);
+        }
+
+        glUseProgram(hiZBuildID);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, depthTextureID);
+
+        for (uint32_t level = 0; level < hiZLevels; level++) {
+            uint32_t levelWidth = (std::max)(hiZWidth >> level, 1u);
+            uint32_t levelHeight = (std::max)(hiZHeight >> level, 1u);
+
+            glUniform1i(glGetUniformLocation(hiZBuildID, "level"), level);
+            glBindImageTexture(0, hiZTextureID, level > 0 ? level - 1 : 0, GL_FALSE, 0, GL_READ_ONLY, GL_R32F);
+            glBindImageTexture(1, hiZTextureID, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+            glDispatchCompute((levelWidth + 7) / 8, (levelHeight + 7) / 8, 1);
+            glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+        }
+
+        glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glUseProgram(0);
+    }
+
+    // The shader gets the transform from world space to the texture coordinates of
+    // the field, and back for the normals. Uniform scale is assumed.
+    void HairRenderer::SetDistanceFieldUniforms(const HairInstance* instance, uint32_t programID) const
+    {
+        auto field = instance->distanceField;
+        glUniform1i(glGetUniformLocation(programID, "distanceFieldEnabled"), field != nullptr);
+        if (field == nullptr) {
+            return;
+        }
+
+        auto fieldToWorld = instance->config.modelMatrix * instance->distanceFieldTransform;
+        float scale = fieldToWorld.m[0].XYZ().Length();
+
+        Matrix4 volume;
+        volume.SetIdentity();
+        for (int i = 0; i < 3; i++) {
+            float size = (std::max)(field->boundsMax[i] - field->boundsMin[i], 1e-6f);
+            volume.m[i][i] = 1.0f / size;
+            volume.m[3][i] = -field->boundsMin[i] / size;
+        }
+        auto worldToVolume = volume * fieldToWorld.Inversed();
+
+        float normalMatrix[9];
+        for (int i = 0; i < 3; i++) {
+            for (int j = 0; j < 3; j++) {
+                normalMatrix[i * 3 + j] = fieldToWorld.m[i][j] / (std::max)(scale, 1e-6f);
+            }
+        }
+
+        glUniformMatrix4fv(glGetUniformLocation(programID, "distanceFieldMatrix"), 1, false, (float*)worldToVolume.m);
+        glUniformMatrix3fv(glGetUniformLocation(programID, "distanceFieldNormalMatrix"), 1, false, normalMatrix);
+        glUniform1f(glGetUniformLocation(programID, "distanceFieldScale"), scale);
+
+        glActiveTexture(GL_TEXTURE0 + DISTANCE_FIELD_TEXTURE_UNIT);
+        glBindTexture(GL_TEXTURE_3D, field->textureID);
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    void HairRenderer::UpdateHairGrid(HairInstance* instance, const Vector3& gridMin, const Vector3& gridScale, float timeStep) const
+    {
+        auto model = instance->model;
+        size_t cellsCount = HAIR_GRID_SIZE * HAIR_GRID_SIZE * HAIR_GRID_SIZE;
+
+        if (instance->hairGridBuffID == 0) {
+            glGenBuffers(1, &instance->hairGridAccumulationBuffID);
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, instance->hairGridAccumulationBuffID);
+            glBufferData(GL_SHADER_STORAGE_BUFFER, cellsCount * 4 * sizeof(int32_t), nullptr, GL_DYNAMIC_DRAW);
+
+            glGenBuffers(1, &instance->hairGridBuffID);
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, instance->hairGridBuffID);
+            glBufferData(GL_SHADER_STORAGE_BUFFER, cellsCount * 2 * sizeof(Vector4), nullptr, GL_DYNAMIC_DRAW);
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+            memoryTracker->Add(&instance->memoryUsage, &HairMemoryUsage::dynamicData, HairGridBytes);
+        }
+
+        int32_t zero = 0;
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, instance->hairGridAccumulationBuffID);
+        glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32I, GL_RED_INTEGER, GL_INT, &zero);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+        BindBufferRange(POSITIONS_BUFFER_BINDING, instance->posBuffer);
+        BindBufferRange(PREVIOUS_POSITIONS_BUFFER_BINDING, instance->prevPosBuffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, HAIR_GRID_ACCUMULATION_BINDING, instance->hairGridAccumulationBuffID);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, HAIR_GRID_BINDING, instance->hairGridBuffID);
+
+        uint32_t verticesCount = model->strandCount * (model->segCount + 1);
+        glUseProgram(hairGridScatterID);
+        glUniform1i(glGetUniformLocation(hairGridScatterID, "verticesCount"), verticesCount);
+        glUniform1f(glGetUniformLocation(hairGridScatterID, "timeStep"), timeStep);
+        glUniform3fv(glGetUniformLocation(hairGridScatterID, "gridMin"), 1, (float*)&gridMin);
+        glUniform3fv(glGetUniformLocation(hairGridScatterID, "gridScale"), 1, (float*)&gridScale);
+        glDispatchCompute((verticesCount + 63) / 64, 1, 1);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+        glUseProgram(hairGridSmoothID);
+        glDispatchCompute(HAIR_GRID_SIZE / 4, HAIR_GRID_SIZE / 4, HAIR_GRID_SIZE / 4);
+        glUseProgram(0);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    }
+
+    // Rotation part of a transform, scale is divided out of the axes.
+    Quaternion HairRenderer::GetMatrixRotation(const Matrix4& matrix) const
+    {
+        Matrix3 rotationMatrix;
+        for (int i = 0; i < 3; i++) {
+            float scale = (std::max)(matrix.m[i].XYZ().Length(), 1e-6f);
+            for (int j = 0; j < 3; j++) {
+                rotationMatrix.m[j][i] = matrix.m[i][j] / scale;
+            }
         }
+        return Quaternion::FromMatrix(rotationMatrix);
+    }
+
+    // Places every strand root on its deformed scalp triangle, the simulation and
+    // the followers read the root positions and rotations from the output buffer.
+    void HairRenderer::SkinRoots(HairInstance* instance) const
+    {
+        auto model = instance->model;
+
+        if (instance->rootTransformsBuffID == 0) {
+            glGenBuffers(1, &instance->rootTransformsBuffID);
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, instance->rootTransformsBuffID);
+            glBufferData(GL_SHADER_STORAGE_BUFFER, model->strandCount * 2 * sizeof(Vector4), nullptr, GL_DYNAMIC_DRAW);
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+            memoryTracker->Add(&instance->memoryUsage, &HairMemoryUsage::dynamicData, model->strandCount * 2 * sizeof(Vector4));
+        }
+
+        glUseProgram(hairRootSkinningID);
+
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, SCALP_VERTICES_BINDING, instance->scalpVerticesBuffID);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, SCALP_INDICES_BINDING, model->scalpIndicesBuffID);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, ROOT_ATTACHMENTS_BINDING, model->rootAttachmentsBuffID);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, ROOT_TRANSFORMS_BINDING, instance->rootTransformsBuffID);
+
+        glUniform1i(glGetUniformLocation(hairRootSkinningID, "strandsCount"), model->strandCount);
+        glUniformMatrix4fv(glGetUniformLocation(hairRootSkinningID, "modelMatrix"), 1, false, (float*)instance->config.modelMatrix.m);
+
+        glDispatchCompute((model->strandCount + 63) / 64, 1, 1);
+        glUseProgram(0);
+
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    }
+
+    // Colliders are kept in model space on the instance and moved to world space
+    // every step, so they follow both their transforms and the model matrix.
+    void HairRenderer::UploadColliders(const HairInstance* instance) const
+    {
+        auto& modelMatrix = instance->config.modelMatrix;
+        float modelScale = GetMaxScale(modelMatrix);
+
+        size_t collidersCount = instance->colliders.size();
+        Vector4 points[MAX_COLLIDERS * 2];
+        for (size_t i = 0; i < collidersCount; i++) {
+            auto& collider = instance->colliders[i];
+            auto start = TransformPoint(collider.transform, collider.start);
+            auto end = collider.type == HairColliderType::Capsule ? TransformPoint(collider.transform, collider.end) : start;
+            points[i * 2] = Vector4(start.x, start.y, start.z, 1.0f);
+            points[i * 2 + 1] = Vector4(end.x, end.y, end.z, 1.0f);
+        }
+        TransformPoints(modelMatrix, points, points, collidersCount * 2);
+
+        Collider colliders[MAX_COLLIDERS];
+        for (size_t i = 0; i < collidersCount; i++) {
+            auto& collider = instance->colliders[i];
+            colliders[i].start = points[i * 2].XYZ();
+            colliders[i].end = points[i * 2 + 1].XYZ();
+            colliders[i].radius = collider.radius * GetMaxScale(collider.transform) * modelScale;
+            colliders[i]._padding = 0.0f;
+        }
+
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, instance->collidersBuffID);
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, collidersCount * sizeof(Collider), colliders);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    }
+
+    // Fills the positions of a new instance of a compact model from its packed rest
+    // data on the GPU, nothing is read back.
+    void HairRenderer::UnpackRestPositions(const HairInstance* instance) const
+    {
+        auto model = instance->model;
+        int verticesCount = model->strandCount * (model->segCount + 1);
+
+        glUseProgram(compactRestUnpackID);
+
+        BindBufferRange(REST_POSITIONS_BUFFER_BINDING, model->restBuffer);
+        BindBufferRange(MOVABILITY_BINDING, model->movabilityBuffer);
+        BindBufferRange(POSITIONS_BUFFER_BINDING, instance->posBuffer);
+        BindBufferRange(PREVIOUS_POSITIONS_BUFFER_BINDING, instance->prevPosBuffer);
+
+        glUniform1i(glGetUniformLocation(compactRestUnpackID, "verticesCount"), verticesCount);
+
+        glDispatchCompute((verticesCount + 63) / 64, 1, 1);
+        glUseProgram(0);
+
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    }
+
+    // Marks per strand the colliders its reach sphere overlaps at their current
+    // transforms, so animated colliders and skinned roots never miss a candidate.
+    void HairRenderer::UpdateColliderMasks(const HairInstance* instance, bool rootSkinning) const
+    {
+        auto model = instance->model;
+        auto& modelMatrix = instance->config.modelMatrix;
+
+        glUseProgram(colliderMasksID);
+
+        BindBufferRange(STRAND_REACH_BINDING, model->strandReachBuffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, ROOT_TRANSFORMS_BINDING, rootSkinning ? instance->rootTransformsBuffID : 0);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, COLLIDERS_BINDING, instance->collidersBuffID);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, COLLIDER_MASKS_BINDING, instance->colliderMasksBuffID);
+
+        glUniform1i(glGetUniformLocation(colliderMasksID, "strandsCount"), model->strandCount);
+        glUniform1i(glGetUniformLocation(colliderMasksID, "collidersCount"), (int)instance->colliders.size());
+        glUniformMatrix4fv(glGetUniformLocation(colliderMasksID, "modelMatrix"), 1, false, (float*)modelMatrix.m);
+        glUniform1f(glGetUniformLocation(colliderMasksID, "modelScale"), GetMaxScale(modelMatrix));
+        glUniform1f(glGetUniformLocation(colliderMasksID, "collisionMargin"), instance->config.collisionMargin);
+        glUniform1i(glGetUniformLocation(colliderMasksID, "rootSkinning"), rootSkinning);
+
+        glDispatchCompute((model->strandCount + 63) / 64, 1, 1);
+        glUseProgram(0);
+
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
     }
 
     void HairRenderer::Simulate(HairInstance* instance, float timeStep) const
     {
         auto model = instance->model;
 
-        glUseProgram(hairSimulationID);
+        instance->simulationTimer.Begin();
+
+        Vector3 gridMin, gridScale;
+        GetInstanceVolume(instance, gridMin, gridScale);
+
+        bool hairInteraction = instance->config.hairInteraction && (instance->hairGridBuffID != 0 || memoryTracker->Fits(HairGridBytes));
+        if (hairInteraction) {
+            UpdateHairGrid(instance, gridMin, gridScale, timeStep);
+        }
+
+        bool rootSkinning = instance->scalpVerticesBuffID != 0;
+        if (rootSkinning) {
+            SkinRoots(instance);
+        }
+        auto modelRotation = GetMatrixRotation(instance->config.modelMatrix);
+
+        int collidersCount = (int)instance->colliders.size();
+        if (collidersCount > 0) {
+            UploadColliders(instance);
+            UpdateColliderMasks(instance, rootSkinning);
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, COLLIDERS_BINDING, instance->collidersBuffID);
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, COLLIDER_MASKS_BINDING, instance->colliderMasksBuffID);
+        }
+
+        uint32_t simulationID = model->compactStorage ? hairSimulationCompactID : hairSimulationID;
+        uint32_t followersID = model->compactStorage ? hairFollowersCompactID : hairFollowersID;
+        glUseProgram(simulationID);
 
-        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, REF_VECTORS_BINDING, model->refVecsBufferID);
-        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, POSITIONS_BUFFER_BINDING, instance->posBuffID);
-        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, PREVIOUS_POSITIONS_BUFFER_BINDING, instance->prevPosBuffID);
-        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, REST_POSITIONS_BUFFER_BINDING, model->restBuffID);
-        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, TANGENTS_DISTANCES_BINDING, model->tangentsBuffID);
-		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, GLOBAL_ROTATIONS_BINDING, model->globalRotBuffID);
-		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, DEBUG_BUFFER_BINDING, model->debugBuffID);
+        BindBufferRange(REF_VECTORS_BINDING, model->refVecsBuffer);
+        BindBufferRange(POSITIONS_BUFFER_BINDING, instance->posBuffer);
+        BindBufferRange(PREVIOUS_POSITIONS_BUFFER_BINDING, instance->prevPosBuffer);
+        BindBufferRange(REST_POSITIONS_BUFFER_BINDING, model->restBuffer);
+        BindBufferRange(TANGENTS_DISTANCES_BINDING, model->tangentsBuffer);
+        BindBufferRange(GLOBAL_ROTATIONS_BINDING, model->globalRotBuffer);
+        BindBufferRange(DEBUG_BUFFER_BINDING, model->debugBuffer);
+        BindBufferRange(MOVABILITY_BINDING, model->movabilityBuffer);
 
         
 
-        glUniform3f(glGetUniformLocation(hairSimulationID, "gravityForce"), 0.0f, -9.8f, 0.0f);
-        glUniform1f(glGetUniformLocation(hairSimulationID, "friction"), instance->config.friction);
-        glUniform1i(glGetUniformLocation(hairSimulationID, "lenConstraintIter"), 5);
-        glUniform1i(glGetUniformLocation(hairSimulationID, "localConstraintIter"), 10);
-        glUniform1f(glGetUniformLocation(hairSimulationID, "localConstraint"), (std::min)(instance->config.localConstraint, 0.95f) * 0.5f);
-        glUniform1f(glGetUniformLocation(hairSimulationID, "globalConstraint"), instance->config.globalConstraint);
+        glUniform3f(glGetUniformLocation(simulationID, "gravityForce"), 0.0f, -9.8f, 0.0f);
+        glUniform1f(glGetUniformLocation(simulationID, "friction"), instance->config.friction);
+        glUniform1i(glGetUniformLocation(simulationID, "lenConstraintIter"), 5);
+        glUniform1i(glGetUniformLocation(simulationID, "localConstraintIter"), 10);
+        glUniform1f(glGetUniformLocation(simulationID, "localConstraint"), (std::min)(instance->config.localConstraint, 0.95f) * 0.5f);
+        glUniform1f(glGetUniformLocation(simulationID, "globalConstraint"), instance->config.globalConstraint);
 
         int verticesPerStrand = model->segCount + 1;
-        glUniform1i(glGetUniformLocation(hairSimulationID, "verticesPerStrand"), verticesPerStrand);
+        glUniform1i(glGetUniformLocation(simulationID, "verticesPerStrand"), verticesPerStrand);
+
+        int lodLevel = GetSimulationLODLevel(instance->config.guideRatio);
+        int strandStride = 1 << lodLevel;
+        glUniform1i(glGetUniformLocation(simulationID, "strandStride"), strandStride);
 
-        glUniform1f(glGetUniformLocation(hairSimulationID, "timeStep"), timeStep);
+        glUniform1f(glGetUniformLocation(simulationID, "timeStep"), timeStep);
+
+        glUniform1i(glGetUniformLocation(simulationID, "hairInteraction"), hairInteraction);
+        glUniform1f(glGetUniformLocation(simulationID, "interactionFriction"), instance->config.interactionFriction);
+        glUniform1f(glGetUniformLocation(simulationID, "volumePreservation"), instance->config.volumePreservation);
+        glUniform3fv(glGetUniformLocation(simulationID, "gridMin"), 1, (float*)&gridMin);
+        glUniform3fv(glGetUniformLocation(simulationID, "gridScale"), 1, (float*)&gridScale);
+        glUniform1i(glGetUniformLocation(simulationID, "collidersCount"), collidersCount);
+        glUniform1f(glGetUniformLocation(simulationID, "collisionMargin"), instance->config.collisionMargin);
+        glUniform1i(glGetUniformLocation(simulationID, "rootSkinning"), rootSkinning);
+        glUniform4fv(glGetUniformLocation(simulationID, "modelRotation"), 1, (float*)&modelRotation);
+        SetDistanceFieldUniforms(instance, simulationID);
 
         
         auto windVecs = CalculateWindVecs(instance->config.windVecs, instance->frame);
 
-		glUniformMatrix4fv(glGetUniformLocation(hairSimulationID, "windVecs"), 1, false, (float*)windVecs.m);
+		glUniformMatrix4fv(glGetUniformLocation(simulationID, "windVecs"), 1, false, (float*)windVecs.m);
 
-        glUniformMatrix4fv(glGetUniformLocation(hairSimulationID, "modelMatrix"), 1, false, (float*)instance->config.modelMatrix.m);
+        glUniformMatrix4fv(glGetUniformLocation(simulationID, "modelMatrix"), 1, false, (float*)instance->config.modelMatrix.m);
 
-        glDispatchCompute(instance->model->strandCount, 1, 1);
+        glDispatchCompute((model->strandCount + strandStride - 1) / strandStride, 1, 1);
         glUseProgram(0);
 
         glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
 
+        if (lodLevel > 0) {
+            glUseProgram(followersID);
+
+            BindBufferRange(FOLLOWERS_BINDING, model->followersBuffer);
+
+            glUniform1i(glGetUniformLocation(followersID, "verticesPerStrand"), verticesPerStrand);
+            glUniform1i(glGetUniformLocation(followersID, "strandsCount"), model->strandCount);
+            glUniform1i(glGetUniformLocation(followersID, "strandStride"), strandStride);
+            glUniform1i(glGetUniformLocation(followersID, "followersOffset"), (lodLevel - 1) * model->strandCount);
+            glUniform1i(glGetUniformLocation(followersID, "rootSkinning"), rootSkinning);
+            glUniform4fv(glGetUniformLocation(followersID, "modelRotation"), 1, (float*)&modelRotation);
+
+            uint32_t verticesCount = model->strandCount * verticesPerStrand;
+            glDispatchCompute((verticesCount + 63) / 64, 1, 1);
+            glUseProgram(0);
+
+            glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+        }
+
+        instance->simulationTimer.End();
+
 		instance->frame++;
     }
 
+    float HairRenderer::EstimateScreenCoverage(const HairInstance* instance, const Matrix4& viewProjectionMatrix, const Matrix4& projectionMatrix) const
+    {
+        auto asset = instance->model;
+        auto& modelMatrix = instance->config.modelMatrix;
+
+        // the bounding sphere in world space, a non uniform scale is covered by the largest axis
+        float maxScale = GetMaxScale(modelMatrix);
+        auto center = TransformPoint(modelMatrix, (asset->boundsMin + asset->boundsMax) * 0.5f);
+        float radius = (asset->boundsMax - asset->boundsMin).Length() * 0.5f * maxScale;
+
+        float w = viewProjectionMatrix.m[0][3] * center.x + viewProjectionMatrix.m[1][3] * center.y +
+            viewProjectionMatrix.m[2][3] * center.z + viewProjectionMatrix.m[3][3];
+
+        if (w <= radius) {
+            return 1.0f;
+        }
+
+        // fraction of the viewport height covered by the bounding sphere
+        return radius * fabsf(projectionMatrix.m[1][1]) / w;
+    }
+
+    int HairRenderer::GetSimulationLODLevel(float guideRatio) const
+    {
+        if (guideRatio >= 1.0f) {
+            return 0;
+        }
+
+        int level = (int)roundf(-log2f((std::max)(guideRatio, 1e-3f)));
+        return (std::min)(level, SIMULATION_LOD_LEVELS - 1);
+    }
+
 	Vector4 GetWindVecCorner(const Quaternion& rotationFromXToWind, const Vector3& axis, float angle, float magnitude)
 	{
 		Vector3 xAxis(1.0f, 0.0f, 0.0f);
@@ -246,8 +1481,33 @@ namespace HairSimulation
         glFinish();
 
         glDeleteProgram(strandVisualizationID);
+        glDeleteProgram(rootVisualizationID);
         glDeleteProgram(hairRenderID);
+        glDeleteProgram(hairMultiViewRenderID);
         glDeleteProgram(hairSimulationID);
+        glDeleteProgram(hairFollowersID);
+        glDeleteProgram(hairSimulationCompactID);
+        glDeleteProgram(hairFollowersCompactID);
+        glDeleteProgram(hairRootSkinningID);
+        glDeleteProgram(colliderMasksID);
+        glDeleteProgram(compactRestUnpackID);
+        glDeleteProgram(hairCullingID);
+        glDeleteProgram(hairExpandID);
+        glDeleteProgram(hairStripRenderID);
+        glDeleteProgram(hairFollowerCacheID);
+        glDeleteProgram(lightCullingID);
+        glDeleteProgram(densitySplatID);
+        glDeleteProgram(densityResolveID);
+        glDeleteProgram(hairGridScatterID);
+        glDeleteProgram(hairGridSmoothID);
+        glDeleteProgram(hiZBuildID);
+        glDeleteTextures(1, &hiZTextureID);
+        glDeleteBuffers(1, &hairBuffID);
+        glDeleteBuffers(1, &sceneBuffID);
+        glDeleteBuffers(1, &lightBuffID);
+        glDeleteBuffers(1, &multiViewBuffID);
+        glDeleteBuffers(1, &clusterBuffID);
+        glDeleteBuffers(1, &clusterLightsBuffID);
         glDeleteVertexArrays(1, &emptyVertexArrID);
     }
 }
\ No newline at end of file
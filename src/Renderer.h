@@ -4,32 +4,95 @@
 #include <stdint.h>
 #include <hairsimulation/Math.h>
 #include "Common.h"
+#include "MemoryTracker.h"
+
+struct HairRenderData;
+struct SceneRenderData;
 
 namespace HairSimulation
 {
     class HairRenderer
     {
     public:
-        HairRenderer();
+        HairRenderer(MemoryTracker* memoryTracker, const char* programCachePath);
         HairRenderer(const HairRenderer&) = delete;
         void Render(const HairInstance* instance, const Matrix4& viewMatrix, const Matrix4& projectionMatrix) const;
+        void Render(const HairInstance* instance, const HairRenderPass* passes, uint32_t passesCount) const;
+        void RenderMultiView(const HairInstance* instance, const HairRenderPass* views, uint32_t viewsCount) const;
         void Simulate(HairInstance* instance, float timeStep) const;
+        void UnpackRestPositions(const HairInstance* instance) const;
+        void BuildOcclusionPyramid(uint32_t depthTextureID, uint32_t width, uint32_t height);
+        void SetLights(const HairLight* lights, uint32_t lightsCount);
         ~HairRenderer();
 
     private:
         uint32_t hairBuffID;
         uint32_t sceneBuffID;
         uint32_t lightBuffID;
+        uint32_t multiViewBuffID;
+        uint32_t clusterBuffID;
+        uint32_t clusterLightsBuffID;
         uint32_t emptyVertexArrID;
+        MemoryTracker* memoryTracker;
 
         uint32_t hairSimulationID;
+        uint32_t hairFollowersID;
+        uint32_t hairSimulationCompactID;
+        uint32_t hairFollowersCompactID;
+        uint32_t hairRootSkinningID;
+        uint32_t colliderMasksID;
+        uint32_t compactRestUnpackID;
+        uint32_t hairCullingID;
+        uint32_t hiZBuildID;
+        uint32_t hairExpandID;
+        uint32_t hairStripRenderID;
+        uint32_t hairFollowerCacheID;
+        uint32_t lightCullingID;
+        uint32_t densitySplatID;
+        uint32_t densityResolveID;
+        uint32_t hairGridScatterID;
+        uint32_t hairGridSmoothID;
+
+        uint32_t hiZTextureID;
+        uint32_t hiZWidth;
+        uint32_t hiZHeight;
+        uint32_t hiZLevels;
         uint32_t hairRenderID;
+        uint32_t hairMultiViewRenderID;
         uint32_t rootVisualizationID;
         uint32_t strandVisualizationID;
 
 		Matrix4 CalculateWindVecs(const Vector3& wind, int frame) const;
+        int GetSimulationLODLevel(float guideRatio) const;
+        void CullTriangles(const HairInstance* instance, const Matrix4* viewProjectionMatrices, int viewsCount, float maxHairWidth, int stripVerticesPerTriangle) const;
+        void UpdateFollowerCache(const HairInstance* instance, int hairsPerTriangle, bool cullingEnabled) const;
+        void DrawTessellatedHair(const HairInstance* instance, bool cullingEnabled, bool multiView) const;
+        void ExpandHair(const HairInstance* instance, int hairsPerTriangle, int pointsPerSegment, bool cullingEnabled) const;
+        void DrawHairStrips(const HairInstance* instance, int pointsPerHair, int verticesCount, bool cullingEnabled) const;
+        void BindInstanceBuffers(const HairInstance* instance) const;
+        void DrawDebugGeometry(const HairInstance* instance, const Matrix4& viewProjectionMatrix) const;
+        float GetRenderDetail(const HairInstance* instance, const Matrix4& viewProjectionMatrix, const Matrix4& projectionMatrix) const;
+        HairRenderData PrepareHairRenderData(const HairInstance* instance, float detail, bool cullingEnabled, HairRenderPipeline pipeline) const;
+        float LimitRenderCacheDensity(const HairInstance* instance, float density, float tesselationFactor, HairRenderPipeline pipeline) const;
+        void GetInstanceVolume(const HairInstance* instance, Vector3& volumeMin, Vector3& volumeScale) const;
+        Quaternion GetMatrixRotation(const Matrix4& matrix) const;
+        void SkinRoots(HairInstance* instance) const;
+        void UploadColliders(const HairInstance* instance) const;
+        void UpdateColliderMasks(const HairInstance* instance, bool rootSkinning) const;
+        void SetDistanceFieldUniforms(const HairInstance* instance, uint32_t programID) const;
+        void UpdateHairGrid(HairInstance* instance, const Vector3& gridMin, const Vector3& gridScale, float timeStep) const;
+        int GetPointsPerSegment(const HairRenderData& hairRenderData) const;
+        void UploadRenderData(const HairRenderData& hairRenderData) const;
+        SceneRenderData GetSceneRenderData(const Matrix4& viewMatrix, const Matrix4& projectionMatrix, int viewportWidth, int viewportHeight) const;
+        void UploadSceneData(const Matrix4& viewMatrix, const Matrix4& projectionMatrix) const;
+        void UpdateDensityVolume(const HairInstance* instance, const HairRenderData& hairRenderData) const;
+        void CullLights(const HairRenderPass* views, uint32_t viewsCount) const;
+        float EstimateScreenCoverage(const HairInstance* instance, const Matrix4& viewProjectionMatrix, const Matrix4& projectionMatrix) const;
+        bool LoadPrograms(const char* programCachePath);
+        void CompilePrograms();
 
-        std::string shaderIncludeSrc;
+        static constexpr uint32_t ProgramsCount = 21;
+        static uint32_t HairRenderer::* const Programs[ProgramsCount];
     };
 }
 
@@ -0,0 +1,348 @@
+#include "SimulationCache.h"
+#include <stdexcept>
+#include <algorithm>
+#include <string.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace HairSimulation
+{
+    constexpr uint32_t CacheMagic = 0x43435348;
+    constexpr uint32_t CacheVersion = 2;
+
+    CacheWriter::CacheWriter(const char* path, uint32_t strandsCount, uint32_t verticesPerStrand, const HairCodecSettings* codecSettings) :
+        file(nullptr),
+        header(),
+        codec(nullptr),
+        fileOffset(sizeof(CacheHeader)),
+        finishing(false),
+        failed(false)
+    {
+        file = fopen(path, "wb");
+        if (file == nullptr) {
+            throw std::runtime_error(std::string("Cannot write file ") + path);
+        }
+
+        header.magic = CacheMagic;
+        header.version = CacheVersion;
+        header.strandsCount = strandsCount;
+        header.verticesPerStrand = verticesPerStrand;
+        if (codecSettings != nullptr) {
+            codec = new HairCodec(strandsCount, verticesPerStrand, *codecSettings);
+            header.flags = CacheCompressed;
+            header.quantizationStep = codecSettings->quantizationStep;
+            header.keyframeInterval = (std::max)(codecSettings->keyframeInterval, 1u);
+        }
+        fwrite(&header, sizeof(header), 1, file);
+
+        thread = std::thread(&CacheWriter::Run, this);
+    }
+
+    CacheWriter::~CacheWriter()
+    {
+        try {
+            Finish();
+        }
+        catch (...) {
+        }
+        delete codec;
+    }
+
+    void CacheWriter::Push(std::vector<uint8_t>&& frame)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        queueChanged.wait(lock, [this]() { return queue.size() < MaxQueuedFrames; });
+        queue.push_back(std::move(frame));
+        queueChanged.notify_all();
+    }
+
+    // Writes the queued frames and the final header, throws if any write failed.
+    void CacheWriter::Finish()
+    {
+        if (file == nullptr) {
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            finishing = true;
+        }
+        queueChanged.notify_all();
+        thread.join();
+
+        if (codec != nullptr) {
+            uint64_t padding = 0;
+            failed |= fwrite(&padding, 1, (size_t)(-fileOffset & 7), file) != (size_t)(-fileOffset & 7);
+            failed |= fwrite(frameOffsets.data(), sizeof(uint64_t), frameOffsets.size(), file) != frameOffsets.size();
+        }
+
+        fseek(file, 0, SEEK_SET);
+        failed |= fwrite(&header, sizeof(header), 1, file) != 1;
+        failed |= fclose(file) != 0;
+        file = nullptr;
+
+        if (failed) {
+            throw std::runtime_error("Cannot write the hair simulation cache");
+        }
+    }
+
+    void CacheWriter::Run()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            queueChanged.wait(lock, [this]() { return !queue.empty() || finishing; });
+            if (queue.empty()) {
+                return;
+            }
+
+            auto frame = std::move(queue.front());
+            queue.pop_front();
+            queueChanged.notify_all();
+
+            lock.unlock();
+            bool written = false;
+            try {
+                if (codec != nullptr) {
+                    codec->Encode((const Vector4*)frame.data(), header.framesCount % header.keyframeInterval == 0, encodedFrame);
+                    frame.swap(encodedFrame);
+                }
+                written = fwrite(frame.data(), 1, frame.size(), file) == frame.size();
+            }
+            catch (...) {
+            }
+            lock.lock();
+
+            if (written) {
+                if (codec != nullptr) {
+                    frameOffsets.push_back(fileOffset);
+                }
+                fileOffset += frame.size();
+                header.framesCount++;
+            } else {
+                failed = true;
+            }
+        }
+    }
+
+    CacheRecorder::CacheRecorder(const char* path, const HairModel* model, const HairCodecSettings* codecSettings) :
+        writer(path, model->strandCount, model->segCount + 1, codecSettings),
+        frameSize(model->strandCount * (model->segCount + 1) * sizeof(Vector4)),
+        fences(),
+        next(0)
+    {
+        glGenBuffers(ReadbackBuffersCount, readbackBuffIDs);
+        for (int i = 0; i < ReadbackBuffersCount; i++) {
+            glBindBuffer(GL_COPY_WRITE_BUFFER, readbackBuffIDs[i]);
+            glBufferData(GL_COPY_WRITE_BUFFER, frameSize, nullptr, GL_STREAM_READ);
+        }
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    }
+
+    CacheRecorder::~CacheRecorder()
+    {
+        for (int i = 0; i < ReadbackBuffersCount; i++) {
+            glDeleteSync(fences[i]);
+        }
+        glDeleteBuffers(ReadbackBuffersCount, readbackBuffIDs);
+    }
+
+    // The oldest copy is collected before its buffer is reused, with three
+    // buffers in flight it has normally finished by then.
+    void CacheRecorder::Capture(const BufferRange& positions)
+    {
+        if (fences[next] != nullptr) {
+            Collect(next);
+        }
+
+        // the positions were just written by the simulation shader
+        glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+        glBindBuffer(GL_COPY_READ_BUFFER, positions.buffID);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, readbackBuffIDs[next]);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, positions.offset, 0, frameSize);
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+        fences[next] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        next = (next + 1) % ReadbackBuffersCount;
+    }
+
+    void CacheRecorder::Finish()
+    {
+        for (int i = 0; i < ReadbackBuffersCount; i++) {
+            int index = (next + i) % ReadbackBuffersCount;
+            if (fences[index] != nullptr) {
+                Collect(index);
+            }
+        }
+        writer.Finish();
+    }
+
+    // A frame whose fence cannot be waited on is dropped, its copy may not have
+    // been executed.
+    void CacheRecorder::Collect(int index)
+    {
+        GLenum result;
+        do {
+            result = glClientWaitSync(fences[index], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+        } while (result == GL_TIMEOUT_EXPIRED);
+
+        glDeleteSync(fences[index]);
+        fences[index] = nullptr;
+        if (result == GL_WAIT_FAILED) {
+            return;
+        }
+
+        glBindBuffer(GL_COPY_READ_BUFFER, readbackBuffIDs[index]);
+        auto positions = (const uint8_t*)glMapBufferRange(GL_COPY_READ_BUFFER, 0, frameSize, GL_MAP_READ_BIT);
+        std::vector<uint8_t> frame(positions, positions + frameSize);
+        glUnmapBuffer(GL_COPY_READ_BUFFER);
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+
+        writer.Push(std::move(frame));
+    }
+
+    HairCache::HairCache(const char* path) :
+        data(nullptr),
+        size(0),
+        frameOffsets(nullptr),
+        keyframeInterval(1),
+        codec(nullptr),
+        decodedFrameIndex(UINT32_MAX)
+    {
+#ifdef _WIN32
+        fileHandle = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, nullptr);
+        if (fileHandle == INVALID_HANDLE_VALUE) {
+            throw std::runtime_error(std::string("Cannot open file ") + path);
+        }
+
+        LARGE_INTEGER fileSize;
+        GetFileSizeEx(fileHandle, &fileSize);
+        size = (size_t)fileSize.QuadPart;
+
+        mappingHandle = CreateFileMappingA(fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mappingHandle != nullptr) {
+            data = (const uint8_t*)MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0);
+        }
+#else
+        fileDescriptor = open(path, O_RDONLY);
+        if (fileDescriptor < 0) {
+            throw std::runtime_error(std::string("Cannot open file ") + path);
+        }
+
+        struct stat fileStat;
+        fstat(fileDescriptor, &fileStat);
+        size = (size_t)fileStat.st_size;
+
+        void* mapping = size > 0 ? mmap(nullptr, size, PROT_READ, MAP_SHARED, fileDescriptor, 0) : MAP_FAILED;
+        if (mapping != MAP_FAILED) {
+            data = (const uint8_t*)mapping;
+        }
+#endif
+
+        CacheHeader header = {};
+        if (data != nullptr && size >= sizeof(header)) {
+            memcpy(&header, data, sizeof(header));
+        }
+
+        strandsCount = header.strandsCount;
+        verticesPerStrand = header.verticesPerStrand;
+        framesCount = header.framesCount;
+        frameSize = (size_t)strandsCount * verticesPerStrand * sizeof(Vector4);
+
+        bool valid = header.magic == CacheMagic && header.version >= 1 && header.version <= CacheVersion;
+        if (valid && header.version >= 2 && (header.flags & CacheCompressed) != 0) {
+            size_t tableSize = (size_t)framesCount * sizeof(uint64_t);
+            valid = sizeof(header) + tableSize <= size && (size - tableSize) % sizeof(uint64_t) == 0;
+            if (valid) {
+                frameOffsets = (const uint64_t*)(data + size - tableSize);
+                for (uint32_t i = 0; valid && i < framesCount; i++) {
+                    valid = frameOffsets[i] >= sizeof(header) && frameOffsets[i] <= size - tableSize &&
+                        (i == 0 || frameOffsets[i] >= frameOffsets[i - 1]);
+                }
+            }
+            if (valid) {
+                try {
+                    HairCodecSettings codecSettings;
+                    codecSettings.quantizationStep = header.quantizationStep;
+                    codec = new HairCodec(strandsCount, verticesPerStrand, codecSettings);
+                    keyframeInterval = (std::max)(header.keyframeInterval, 1u);
+                    decodedFrame.resize((size_t)strandsCount * verticesPerStrand);
+                }
+                catch (...) {
+                    valid = false;
+                }
+            }
+        } else {
+            valid = valid && sizeof(header) + framesCount * frameSize <= size;
+        }
+
+        if (!valid) {
+            Close();
+            throw std::runtime_error(std::string("Invalid hair simulation cache ") + path);
+        }
+    }
+
+    HairCache::~HairCache()
+    {
+        Close();
+        delete codec;
+    }
+
+    void HairCache::Close()
+    {
+#ifdef _WIN32
+        if (data != nullptr) {
+            UnmapViewOfFile(data);
+        }
+        if (mappingHandle != nullptr) {
+            CloseHandle(mappingHandle);
+        }
+        if (fileHandle != INVALID_HANDLE_VALUE) {
+            CloseHandle(fileHandle);
+        }
+        mappingHandle = nullptr;
+        fileHandle = INVALID_HANDLE_VALUE;
+#else
+        if (data != nullptr) {
+            munmap((void*)data, size);
+        }
+        if (fileDescriptor >= 0) {
+            close(fileDescriptor);
+        }
+        fileDescriptor = -1;
+#endif
+        data = nullptr;
+    }
+
+    const Vector4* HairCache::GetFrame(uint32_t frame) const
+    {
+        if (codec == nullptr) {
+            return (const Vector4*)(data + sizeof(CacheHeader) + (size_t)frame * frameSize);
+        }
+        if (frame == decodedFrameIndex) {
+            return decodedFrame.data();
+        }
+
+        uint32_t first = frame - frame % keyframeInterval;
+        if (decodedFrameIndex != UINT32_MAX && decodedFrameIndex >= first && decodedFrameIndex < frame) {
+            first = decodedFrameIndex + 1;
+        }
+
+        size_t tableOffset = size - (size_t)framesCount * sizeof(uint64_t);
+        decodedFrameIndex = UINT32_MAX;
+        for (uint32_t i = first; i <= frame; i++) {
+            size_t end = i + 1 < framesCount ? (size_t)frameOffsets[i + 1] : tableOffset;
+            codec->Decode(data + frameOffsets[i], end - (size_t)frameOffsets[i], decodedFrame.data());
+        }
+        decodedFrameIndex = frame;
+        return decodedFrame.data();
+    }
+}
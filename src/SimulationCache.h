@@ -0,0 +1,120 @@
+#ifndef SIMULATION_CACHE_H
+#define SIMULATION_CACHE_H
+
+#include "Common.h"
+#include <hairsimulation/HairCodec.h>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <stdio.h>
+
+namespace HairSimulation
+{
+    struct CacheHeader
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t strandsCount;
+        uint32_t verticesPerStrand;
+        uint32_t framesCount;
+        uint32_t flags;
+        float quantizationStep;
+        uint32_t keyframeInterval;
+    };
+
+    // Compressed caches hold HairCodec frames followed by a table with the file
+    // offset of every frame.
+    constexpr uint32_t CacheCompressed = 1;
+
+    // Appends frames to a cache file from a background thread, so the render
+    // thread never waits for the disk unless the queue is full. Frames are
+    // compressed on that thread too when codec settings are given.
+    class CacheWriter
+    {
+    public:
+        CacheWriter(const char* path, uint32_t strandsCount, uint32_t verticesPerStrand, const HairCodecSettings* codecSettings);
+        CacheWriter(const CacheWriter&) = delete;
+        ~CacheWriter();
+        void Push(std::vector<uint8_t>&& frame);
+        void Finish();
+
+        static constexpr size_t MaxQueuedFrames = 8;
+
+    private:
+        FILE* file;
+        CacheHeader header;
+        HairCodec* codec;
+        std::vector<uint8_t> encodedFrame;
+        std::vector<uint64_t> frameOffsets;
+        uint64_t fileOffset;
+        std::deque<std::vector<uint8_t>> queue;
+        std::mutex mutex;
+        std::condition_variable queueChanged;
+        std::thread thread;
+        bool finishing;
+        bool failed;
+
+        void Run();
+    };
+
+    // Copies the positions of every simulated frame into a ring of read back
+    // buffers and hands them to the writer once their fences have passed.
+    class CacheRecorder
+    {
+    public:
+        CacheRecorder(const char* path, const HairModel* model, const HairCodecSettings* codecSettings);
+        CacheRecorder(const CacheRecorder&) = delete;
+        ~CacheRecorder();
+        void Capture(const BufferRange& positions);
+        void Finish();
+
+        static constexpr int ReadbackBuffersCount = 3;
+
+    private:
+        CacheWriter writer;
+        size_t frameSize;
+        uint32_t readbackBuffIDs[ReadbackBuffersCount];
+        GLsync fences[ReadbackBuffersCount];
+        int next;
+
+        void Collect(int index);
+    };
+
+    // Memory mapped cache file, uncompressed frames are uploaded straight from the
+    // mapping. Compressed frames are decoded from the preceding keyframe, or from
+    // the last decoded frame when frames are played in order.
+    class HairCache
+    {
+    public:
+        HairCache(const char* path);
+        HairCache(const HairCache&) = delete;
+        ~HairCache();
+        const Vector4* GetFrame(uint32_t frame) const;
+
+        uint32_t strandsCount;
+        uint32_t verticesPerStrand;
+        uint32_t framesCount;
+        size_t frameSize;
+
+    private:
+        const uint8_t* data;
+        size_t size;
+        const uint64_t* frameOffsets;
+        uint32_t keyframeInterval;
+        HairCodec* codec;
+        mutable std::vector<Vector4> decodedFrame;
+        mutable uint32_t decodedFrameIndex;
+#ifdef _WIN32
+        void* fileHandle;
+        void* mappingHandle;
+#else
+        int fileDescriptor;
+#endif
+
+        void Close();
+    };
+}
+
+#endif
@@ -0,0 +1,104 @@
+#include "SpatialGrid.h"
+#include <algorithm>
+#include <math.h>
+
+namespace HairSimulation
+{
+    constexpr int MaxGridDimension = 64;
+
+    SpatialGrid::SpatialGrid(const std::vector<Vector3>& points, const Vector3& boundsMin, const Vector3& boundsMax) :
+        points(points),
+        origin(boundsMin),
+        cellSize(1.0f)
+    {
+        auto size = boundsMax - boundsMin;
+        float volume = (std::max)(size.x, 1e-4f) * (std::max)(size.y, 1e-4f) * (std::max)(size.z, 1e-4f);
+        cellSize = cbrtf(volume / (std::max)((int)points.size(), 1)) * 2.0f;
+        cellSize = (std::max)(cellSize, (std::max)(size.x, (std::max)(size.y, size.z)) / MaxGridDimension);
+        cellSize = (std::max)(cellSize, 1e-4f);
+
+        for (int i = 0; i < 3; i++) {
+            dims[i] = (std::min)((int)(size[i] / cellSize) + 1, MaxGridDimension);
+        }
+
+        std::vector<int> pointCells(points.size());
+        cellStart.assign(dims[0] * dims[1] * dims[2] + 1, 0);
+        for (size_t i = 0; i < points.size(); i++) {
+            pointCells[i] = GetCellIndex(GetCellCoord(points[i], 0), GetCellCoord(points[i], 1), GetCellCoord(points[i], 2));
+            cellStart[pointCells[i] + 1]++;
+        }
+
+        for (size_t i = 1; i < cellStart.size(); i++) {
+            cellStart[i] += cellStart[i - 1];
+        }
+
+        std::vector<int> cellFill(cellStart.begin(), cellStart.end() - 1);
+        cellPoints.resize(points.size());
+        for (size_t i = 0; i < points.size(); i++) {
+            cellPoints[cellFill[pointCells[i]]++] = (int)i;
+        }
+    }
+
+    int SpatialGrid::FindNearest(const Vector3& position, int* nearest, int count) const
+    {
+        count = (std::min)(count, MaxNearest);
+        float distances[MaxNearest];
+        int found = 0;
+
+        int cx = GetCellCoord(position, 0);
+        int cy = GetCellCoord(position, 1);
+        int cz = GetCellCoord(position, 2);
+        int maxRing = (std::max)(dims[0], (std::max)(dims[1], dims[2]));
+
+        for (int ring = 0; ring <= maxRing; ring++) {
+            for (int z = cz - ring; z <= cz + ring; z++) {
+                for (int y = cy - ring; y <= cy + ring; y++) {
+                    for (int x = cx - ring; x <= cx + ring; x++) {
+                        bool onShell = abs(x - cx) == ring || abs(y - cy) == ring || abs(z - cz) == ring;
+                        bool inside = x >= 0 && y >= 0 && z >= 0 && x < dims[0] && y < dims[1] && z < dims[2];
+                        if (!onShell || !inside) {
+                            continue;
+                        }
+
+                        int cell = GetCellIndex(x, y, z);
+                        for (int i = cellStart[cell]; i < cellStart[cell + 1]; i++) {
+                            int pointIndex = cellPoints[i];
+                            float distance = (points[pointIndex] - position).Length2();
+                            if (found == count && distance >= distances[count - 1]) {
+                                continue;
+                            }
+
+                            int slot = found < count ? found++ : count - 1;
+                            while (slot > 0 && distances[slot - 1] > distance) {
+                                distances[slot] = distances[slot - 1];
+                                nearest[slot] = nearest[slot - 1];
+                                slot--;
+                            }
+                            distances[slot] = distance;
+                            nearest[slot] = pointIndex;
+                        }
+                    }
+                }
+            }
+
+            // points outside of the scanned rings are at least ring * cellSize away
+            float searchedRadius = ring * cellSize;
+            if (found == count && distances[count - 1] <= searchedRadius * searchedRadius) {
+                break;
+            }
+        }
+
+        return found;
+    }
+
+    int SpatialGrid::GetCellCoord(const Vector3& position, int axis) const
+    {
+        int coord = (int)floorf((position[axis] - origin[axis]) / cellSize);
+        return (std::min)((std::max)(coord, 0), dims[axis] - 1);
+    }
+
+    int SpatialGrid::GetCellIndex(int x, int y, int z) const
+    {
+        return (z * dims[1] + y) * dims[0] + x;
+    }
+}
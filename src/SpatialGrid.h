@@ -0,0 +1,32 @@
+#ifndef SPATIAL_GRID_H
+#define SPATIAL_GRID_H
+
+#include <hairsimulation/Math.h>
+#include <vector>
+
+namespace HairSimulation
+{
+    // Uniform grid over a point set, used for nearest neighbour queries while
+    // preparing model data.
+    class SpatialGrid
+    {
+    public:
+        SpatialGrid(const std::vector<Vector3>& points, const Vector3& boundsMin, const Vector3& boundsMax);
+        int FindNearest(const Vector3& position, int* nearest, int count) const;
+
+        static constexpr int MaxNearest = 4;
+
+    private:
+        std::vector<Vector3> points;
+        std::vector<int> cellStart;
+        std::vector<int> cellPoints;
+        Vector3 origin;
+        float cellSize;
+        int dims[3];
+
+        int GetCellCoord(const Vector3& position, int axis) const;
+        int GetCellIndex(int x, int y, int z) const;
+    };
+}
+
+#endif
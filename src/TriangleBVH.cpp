@@ -0,0 +1,272 @@
+#include "TriangleBVH.h"
+#include <algorithm>
+#include <math.h>
+#include <float.h>
+
+namespace HairSimulation
+{
+    namespace
+    {
+        constexpr int MaxLeafTriangles = 4;
+
+        // Closest point on a triangle, Ericson's region tests. The feature the point
+        // lies on selects the pseudo normal used for the sign.
+        Vector3 ClosestPointOnTriangle(const Vector3& p, const Vector3& a, const Vector3& b, const Vector3& c, int& feature)
+        {
+            auto ab = b - a;
+            auto ac = c - a;
+            auto ap = p - a;
+            float d1 = Vector3::Dot(ab, ap);
+            float d2 = Vector3::Dot(ac, ap);
+            if (d1 <= 0.0f && d2 <= 0.0f) {
+                feature = VertexA;
+                return a;
+            }
+
+            auto bp = p - b;
+            float d3 = Vector3::Dot(ab, bp);
+            float d4 = Vector3::Dot(ac, bp);
+            if (d3 >= 0.0f && d4 <= d3) {
+                feature = VertexB;
+                return b;
+            }
+
+            float vc = d1 * d4 - d3 * d2;
+            if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f) {
+                feature = EdgeAB;
+                return a + ab * (d1 / (d1 - d3));
+            }
+
+            auto cp = p - c;
+            float d5 = Vector3::Dot(ab, cp);
+            float d6 = Vector3::Dot(ac, cp);
+            if (d6 >= 0.0f && d5 <= d6) {
+                feature = VertexC;
+                return c;
+            }
+
+            float vb = d5 * d2 - d1 * d6;
+            if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f) {
+                feature = EdgeCA;
+                return a + ac * (d2 / (d2 - d6));
+            }
+
+            float va = d3 * d6 - d5 * d4;
+            if (va <= 0.0f && (d4 - d3) >= 0.0f && (d5 - d6) >= 0.0f) {
+                feature = EdgeBC;
+                return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+            }
+
+            float denominator = 1.0f / (va + vb + vc);
+            feature = Face;
+            return a + ab * (vb * denominator) + ac * (vc * denominator);
+        }
+
+        float GetBoxDistance2(const Vector3& p, const Vector3& boundsMin, const Vector3& boundsMax)
+        {
+            float distance2 = 0.0f;
+            for (int i = 0; i < 3; i++) {
+                float offset = (std::max)((std::max)(boundsMin[i] - p[i], p[i] - boundsMax[i]), 0.0f);
+                distance2 += offset * offset;
+            }
+            return distance2;
+        }
+
+        bool IntersectsBox(const Vector3& origin, const Vector3& inverseDirection, const Vector3& boundsMin, const Vector3& boundsMax)
+        {
+            float tMin = 0.0f;
+            float tMax = FLT_MAX;
+            for (int i = 0; i < 3; i++) {
+                float t0 = (boundsMin[i] - origin[i]) * inverseDirection[i];
+                float t1 = (boundsMax[i] - origin[i]) * inverseDirection[i];
+                tMin = (std::max)(tMin, (std::min)(t0, t1));
+                tMax = (std::min)(tMax, (std::max)(t0, t1));
+            }
+            return tMin <= tMax;
+        }
+
+        bool IntersectsTriangle(const Vector3& origin, const Vector3& direction, const Vector3& a, const Vector3& b, const Vector3& c)
+        {
+            auto ab = b - a;
+            auto ac = c - a;
+            auto p = Vector3::Cross(direction, ac);
+            float determinant = Vector3::Dot(ab, p);
+            if (fabsf(determinant) < 1e-12f) {
+                return false;
+            }
+
+            float inverseDeterminant = 1.0f / determinant;
+            auto s = origin - a;
+            float u = Vector3::Dot(s, p) * inverseDeterminant;
+            if (u < 0.0f || u > 1.0f) {
+                return false;
+            }
+
+            auto q = Vector3::Cross(s, ab);
+            float v = Vector3::Dot(direction, q) * inverseDeterminant;
+            if (v < 0.0f || u + v > 1.0f) {
+                return false;
+            }
+
+            return Vector3::Dot(ac, q) * inverseDeterminant > 0.0f;
+        }
+    }
+
+    TriangleBVH::TriangleBVH(const HairMeshDescriptor& mesh) :
+        mesh(mesh)
+    {
+        std::vector<Vector3> centroids(mesh.trianglesCount);
+        triangles.resize(mesh.trianglesCount);
+        for (uint32_t i = 0; i < mesh.trianglesCount; i++) {
+            centroids[i] = (GetVertex(i, 0) + GetVertex(i, 1) + GetVertex(i, 2)) * (1.0f / 3.0f);
+            triangles[i] = (int)i;
+        }
+
+        nodes.reserve(mesh.trianglesCount * 2 / MaxLeafTriangles + 1);
+        nodes.push_back(Node());
+        Build(0, 0, (int)mesh.trianglesCount, centroids);
+    }
+
+    Vector3 TriangleBVH::GetVertex(int triangle, int corner) const
+    {
+        return mesh.vertices[mesh.indices[triangle * 3 + corner]];
+    }
+
+    bool TriangleBVH::FindNearest(const Vector3& position, float maxDistance, NearestTriangle& result) const
+    {
+        result.triangle = -1;
+        result.distance2 = maxDistance * maxDistance;
+
+        int stack[64];
+        int stackSize = 0;
+        stack[stackSize++] = 0;
+
+        while (stackSize > 0) {
+            auto& node = nodes[stack[--stackSize]];
+            if (GetBoxDistance2(position, node.boundsMin, node.boundsMax) > result.distance2) {
+                continue;
+            }
+
+            if (node.count == 0) {
+                auto& left = nodes[node.start];
+                auto& right = nodes[node.start + 1];
+                bool leftFirst = GetBoxDistance2(position, left.boundsMin, left.boundsMax) <
+                    GetBoxDistance2(position, right.boundsMin, right.boundsMax);
+                stack[stackSize++] = leftFirst ? node.start + 1 : node.start;
+                stack[stackSize++] = leftFirst ? node.start : node.start + 1;
+                continue;
+            }
+
+            for (int i = node.start; i < node.start + node.count; i++) {
+                int feature;
+                auto point = ClosestPointOnTriangle(position, GetVertex(triangles[i], 0), GetVertex(triangles[i], 1), GetVertex(triangles[i], 2), feature);
+                float distance2 = (position - point).Length2();
+                if (distance2 <= result.distance2) {
+                    result.triangle = triangles[i];
+                    result.feature = feature;
+                    result.distance2 = distance2;
+                    result.point = point;
+                }
+            }
+        }
+
+        return result.triangle >= 0;
+    }
+
+    int TriangleBVH::CountCrossings(const Vector3& origin, const Vector3& direction) const
+    {
+        Vector3 inverseDirection(1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z);
+        int crossings = 0;
+
+        int stack[64];
+        int stackSize = 0;
+        stack[stackSize++] = 0;
+
+        while (stackSize > 0) {
+            auto& node = nodes[stack[--stackSize]];
+            if (!IntersectsBox(origin, inverseDirection, node.boundsMin, node.boundsMax)) {
+                continue;
+            }
+
+            if (node.count == 0) {
+                stack[stackSize++] = node.start;
+                stack[stackSize++] = node.start + 1;
+                continue;
+            }
+
+            for (int i = node.start; i < node.start + node.count; i++) {
+                if (IntersectsTriangle(origin, direction, GetVertex(triangles[i], 0), GetVertex(triangles[i], 1), GetVertex(triangles[i], 2))) {
+                    crossings++;
+                }
+            }
+        }
+
+        return crossings;
+    }
+
+    void TriangleBVH::Build(int nodeIndex, int start, int count, const std::vector<Vector3>& centroids)
+    {
+        Vector3 boundsMin(FLT_MAX, FLT_MAX, FLT_MAX);
+        Vector3 boundsMax(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+        Vector3 centroidsMin = boundsMin;
+        Vector3 centroidsMax = boundsMax;
+
+        for (int i = start; i < start + count; i++) {
+            for (int j = 0; j < 3; j++) {
+                auto vertex = GetVertex(triangles[i], j);
+                for (int k = 0; k < 3; k++) {
+                    boundsMin[k] = (std::min)(boundsMin[k], vertex[k]);
+                    boundsMax[k] = (std::max)(boundsMax[k], vertex[k]);
+                }
+            }
+            for (int k = 0; k < 3; k++) {
+                centroidsMin[k] = (std::min)(centroidsMin[k], centroids[triangles[i]][k]);
+                centroidsMax[k] = (std::max)(centroidsMax[k], centroids[triangles[i]][k]);
+            }
+        }
+
+        nodes[nodeIndex].boundsMin = boundsMin;
+        nodes[nodeIndex].boundsMax = boundsMax;
+
+        if (count <= MaxLeafTriangles) {
+            nodes[nodeIndex].start = start;
+            nodes[nodeIndex].count = count;
+            return;
+        }
+
+        auto extent = centroidsMax - centroidsMin;
+        int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+        int half = count / 2;
+        std::nth_element(triangles.begin() + start, triangles.begin() + start + half, triangles.begin() + start + count,
+            [&centroids, axis](int a, int b) { return centroids[a][axis] < centroids[b][axis]; });
+
+        int childIndex = (int)nodes.size();
+        nodes.push_back(Node());
+        nodes.push_back(Node());
+        nodes[nodeIndex].start = childIndex;
+        nodes[nodeIndex].count = 0;
+
+        Build(childIndex, start, half, centroids);
+        Build(childIndex + 1, start + half, count - half, centroids);
+    }
+
+    Vector3 TriangleBVH::GetBarycentrics(const Vector3& point, const Vector3& a, const Vector3& b, const Vector3& c)
+    {
+        auto ab = b - a;
+        auto ac = c - a;
+        auto ap = point - a;
+        float d00 = Vector3::Dot(ab, ab);
+        float d01 = Vector3::Dot(ab, ac);
+        float d11 = Vector3::Dot(ac, ac);
+        float d20 = Vector3::Dot(ap, ab);
+        float d21 = Vector3::Dot(ap, ac);
+        float denominator = d00 * d11 - d01 * d01;
+        if (denominator == 0.0f) {
+            return Vector3(1.0f, 0.0f, 0.0f);
+        }
+
+        float v = (d11 * d20 - d01 * d21) / denominator;
+        float w = (d00 * d21 - d01 * d20) / denominator;
+        return Vector3(1.0f - v - w, v, w);
+    }
+}
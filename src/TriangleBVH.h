@@ -0,0 +1,57 @@
+#ifndef TRIANGLE_BVH_H
+#define TRIANGLE_BVH_H
+
+#include <hairsimulation/HairTypes.h>
+#include <vector>
+
+namespace HairSimulation
+{
+    enum TriangleFeature
+    {
+        VertexA,
+        VertexB,
+        VertexC,
+        EdgeAB,
+        EdgeBC,
+        EdgeCA,
+        Face
+    };
+
+    struct NearestTriangle
+    {
+        int triangle;
+        int feature;
+        float distance2;
+        Vector3 point;
+    };
+
+    // Median split bounding volume hierarchy over the triangles of a mesh, the
+    // mesh data is referenced, not copied.
+    class TriangleBVH
+    {
+    public:
+        TriangleBVH(const HairMeshDescriptor& mesh);
+        Vector3 GetVertex(int triangle, int corner) const;
+        bool FindNearest(const Vector3& position, float maxDistance, NearestTriangle& result) const;
+        int CountCrossings(const Vector3& origin, const Vector3& direction) const;
+
+        static Vector3 GetBarycentrics(const Vector3& point, const Vector3& a, const Vector3& b, const Vector3& c);
+
+    private:
+        struct Node
+        {
+            Vector3 boundsMin;
+            Vector3 boundsMax;
+            int start;
+            int count;
+        };
+
+        const HairMeshDescriptor& mesh;
+        std::vector<Node> nodes;
+        std::vector<int> triangles;
+
+        void Build(int nodeIndex, int start, int count, const std::vector<Vector3>& centroids);
+    };
+}
+
+#endif
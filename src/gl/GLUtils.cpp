@@ -6,6 +6,8 @@
 namespace HairSimulation
 {
     constexpr uint32_t MaxLogSize = 1024;
+    constexpr uint32_t ProgramCacheMagic = 0x42505348;
+    constexpr uint32_t ProgramCacheVersion = 1;
 
     bool InitGL()
     {
@@ -60,6 +62,7 @@ namespace HairSimulation
         for (int i = 0; i < stagesCount; i++) {
             glAttachShader(programID, shaderIDs[i]);
         } 
+        glProgramParameteri(programID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
         glLinkProgram(programID);
 
         int linkStatus;
@@ -93,4 +96,174 @@ namespace HairSimulation
     {
         return LinkProgram(&computeShaderID, 1);
     }
+
+    bool LoadProgramBinaries(const char* path, uint64_t key, uint32_t* programIDs, uint32_t programsCount)
+    {
+        auto file = fopen(path, "rb");
+        if (file == nullptr) {
+            return false;
+        }
+
+        uint32_t magic = 0;
+        uint32_t version = 0;
+        uint64_t fileKey = 0;
+        uint32_t fileProgramsCount = 0;
+        bool valid = fread(&magic, sizeof(magic), 1, file) == 1 && magic == ProgramCacheMagic &&
+            fread(&version, sizeof(version), 1, file) == 1 && version == ProgramCacheVersion &&
+            fread(&fileKey, sizeof(fileKey), 1, file) == 1 && fileKey == key &&
+            fread(&fileProgramsCount, sizeof(fileProgramsCount), 1, file) == 1 && fileProgramsCount == programsCount;
+
+        std::vector<uint8_t> binary;
+        uint32_t loadedCount = 0;
+        while (valid && loadedCount < programsCount) {
+            uint32_t format = 0;
+            uint32_t size = 0;
+            valid = fread(&format, sizeof(format), 1, file) == 1 &&
+                fread(&size, sizeof(size), 1, file) == 1 && size > 0 && size <= 64 * 1024 * 1024;
+            if (valid) {
+                binary.resize(size);
+                valid = fread(binary.data(), 1, size, file) == size;
+            }
+            if (!valid) {
+                break;
+            }
+
+            // a driver update can invalidate the binaries without changing the key
+            uint32_t programID = glCreateProgram();
+            glProgramBinary(programID, format, binary.data(), size);
+            int linkStatus;
+            glGetProgramiv(programID, GL_LINK_STATUS, &linkStatus);
+            if (linkStatus == GL_FALSE) {
+                glDeleteProgram(programID);
+                valid = false;
+                break;
+            }
+            programIDs[loadedCount++] = programID;
+        }
+
+        fclose(file);
+        if (!valid) {
+            for (uint32_t i = 0; i < loadedCount; i++) {
+                glDeleteProgram(programIDs[i]);
+                programIDs[i] = 0;
+            }
+        }
+        return valid;
+    }
+
+    bool SaveProgramBinaries(const char* path, uint64_t key, const uint32_t* programIDs, uint32_t programsCount)
+    {
+        GLint formatsCount = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formatsCount);
+        if (formatsCount == 0) {
+            return false;
+        }
+
+        // written next to the cache and renamed at the end, so a failed write
+        // never leaves a truncated cache behind
+        std::string tempPath = std::string(path) + ".tmp";
+        auto file = fopen(tempPath.c_str(), "wb");
+        if (file == nullptr) {
+            return false;
+        }
+
+        bool written =
+            fwrite(&ProgramCacheMagic, sizeof(ProgramCacheMagic), 1, file) == 1 &&
+            fwrite(&ProgramCacheVersion, sizeof(ProgramCacheVersion), 1, file) == 1 &&
+            fwrite(&key, sizeof(key), 1, file) == 1 &&
+            fwrite(&programsCount, sizeof(programsCount), 1, file) == 1;
+
+        std::vector<uint8_t> binary;
+        for (uint32_t i = 0; written && i < programsCount; i++) {
+            GLint length = 0;
+            glGetProgramiv(programIDs[i], GL_PROGRAM_BINARY_LENGTH, &length);
+            binary.resize(length);
+
+            GLenum format = 0;
+            GLsizei size = 0;
+            glGetProgramBinary(programIDs[i], length, &size, &format, binary.data());
+
+            uint32_t fileFormat = format;
+            uint32_t fileSize = size;
+            written =
+                size > 0 &&
+                fwrite(&fileFormat, sizeof(fileFormat), 1, file) == 1 &&
+                fwrite(&fileSize, sizeof(fileSize), 1, file) == 1 &&
+                fwrite(binary.data(), 1, size, file) == (size_t)size;
+        }
+        written = fclose(file) == 0 && written;
+
+        if (written) {
+            // rename doesn't replace an existing file on Windows
+            remove(path);
+            written = rename(tempPath.c_str(), path) == 0;
+        }
+        if (!written) {
+            remove(tempPath.c_str());
+        }
+        return written;
+    }
+
+    GPUTimer::GPUTimer() :
+        queryIDs{ 0, 0 },
+        pending{ false, false },
+        current(0),
+        active(false),
+        time(0.0f)
+    {
+    }
+
+    void GPUTimer::Begin()
+    {
+        if (queryIDs[0] == 0) {
+            glGenQueries(2, queryIDs);
+        }
+
+        Poll(current);
+        Poll((current + 1) % 2);
+
+        active = !pending[current];
+        if (active) {
+            glBeginQuery(GL_TIME_ELAPSED, queryIDs[current]);
+        }
+    }
+
+    void GPUTimer::End()
+    {
+        if (active) {
+            glEndQuery(GL_TIME_ELAPSED);
+            pending[current] = true;
+            current = (current + 1) % 2;
+            active = false;
+        }
+    }
+
+    void GPUTimer::Release()
+    {
+        if (queryIDs[0] != 0) {
+            glDeleteQueries(2, queryIDs);
+            queryIDs[0] = queryIDs[1] = 0;
+        }
+    }
+
+    float GPUTimer::GetTime() const
+    {
+        return time;
+    }
+
+    void GPUTimer::Poll(uint32_t index)
+    {
+        if (!pending[index]) {
+            return;
+        }
+
+        GLuint available = 0;
+        glGetQueryObjectuiv(queryIDs[index], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (available) {
+            GLuint64 elapsed = 0;
+            glGetQueryObjectui64v(queryIDs[index], GL_QUERY_RESULT, &elapsed);
+            time = elapsed / 1000000.0f;
+            pending[index] = false;
+        }
+    }
 }
\ No newline at end of file
@@ -12,6 +12,34 @@ namespace HairSimulation
     uint32_t LinkProgram(uint32_t vertexShaderID, uint32_t tessControlShaderID, uint32_t tessEvaluationShaderID, uint32_t geometryShaderID, uint32_t fragmentShaderID);
     uint32_t LinkProgram(uint32_t vertexShaderID, uint32_t fragmentShaderID);
     uint32_t LinkProgram(uint32_t computeShaderID);
+
+    // Linked programs stored with glGetProgramBinary, the key has to change with
+    // the driver and the shader sources. Loading fails as a whole when the file is
+    // missing, stale or the driver rejects one of the binaries. Saving is best
+    // effort and returns false when the cache could not be written.
+    bool LoadProgramBinaries(const char* path, uint64_t key, uint32_t* programIDs, uint32_t programsCount);
+    bool SaveProgramBinaries(const char* path, uint64_t key, const uint32_t* programIDs, uint32_t programsCount);
+
+    // Double buffered GL_TIME_ELAPSED query. Results are picked up once they
+    // are available, so measuring never waits for the GPU.
+    class GPUTimer
+    {
+    public:
+        GPUTimer();
+        void Begin();
+        void End();
+        void Release();
+        float GetTime() const;
+
+    private:
+        uint32_t queryIDs[2];
+        bool pending[2];
+        uint32_t current;
+        bool active;
+        float time;
+
+        void Poll(uint32_t index);
+    };
 }
 
 #endif
\ No newline at end of file
@@ -0,0 +1,75 @@
+#!/usr/bin/env python3
+# Writes EmbeddedShaders.h with the sources of every shader in this directory,
+# run it after editing a shader so the library picks up the change.
+
+import os
+import sys
+
+ShaderExtensions = ('.vert', '.tesc', '.tese', '.geom', '.frag', '.comp')
+IncludeFiles = ('ShaderTypes.h', 'ShaderFunctions.glsl')
+
+# stays below the string literal limit of MSVC
+MaxLiteralSize = 8000
+
+
+def split_source(source):
+    chunks = []
+    chunk = ''
+    for line in source.splitlines(keepends=True):
+        if chunk and len(chunk) + len(line) > MaxLiteralSize:
+            chunks.append(chunk)
+            chunk = ''
+        chunk += line
+    chunks.append(chunk)
+    return chunks
+
+
+def main():
+    directory = os.path.dirname(os.path.abspath(__file__))
+    output = os.path.join(directory, 'EmbeddedShaders.h')
+
+    names = sorted(name for name in os.listdir(directory) if name.endswith(ShaderExtensions) or name in IncludeFiles)
+
+    lines = [
+        '// Generated by EmbedShaders.py from the shaders in this directory, do not edit.',
+        '#ifndef EMBEDDED_SHADERS_H',
+        '#define EMBEDDED_SHADERS_H',
+        '',
+        'namespace HairSimulation',
+        '{',
+        '    struct EmbeddedShader',
+        '    {',
+        '        const char* name;',
+        '        const char* source;',
+        '    };',
+        '',
+        '    static const EmbeddedShader EmbeddedShaders[] =',
+        '    {',
+    ]
+
+    for name in names:
+        with open(os.path.join(directory, name), 'r', newline='') as file:
+            source = file.read().replace('\r\n', '\n')
+        if ')glsl"' in source:
+            sys.exit(name + ' contains the raw string delimiter')
+
+        lines.append('        {')
+        lines.append('            "%s",' % name)
+        for chunk in split_source(source):
+            lines.append('R"glsl(' + chunk + ')glsl"')
+        lines.append('        },')
+
+    lines += [
+        '    };',
+        '}',
+        '',
+        '#endif',
+        '',
+    ]
+
+    with open(output, 'w', newline='\n') as file:
+        file.write('\n'.join(lines))
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,2171 @@
+// Generated by EmbedShaders.py from the shaders in this directory, do not edit.
+#ifndef EMBEDDED_SHADERS_H
+#define EMBEDDED_SHADERS_H
+
+namespace HairSimulation
+{
+    struct EmbeddedShader
+    {
+        const char* name;
+        const char* source;
+    };
+
+    static const EmbeddedShader EmbeddedShaders[] =
+    {
+        {
+            "ColliderMasks.comp",
+R"glsl(precision highp float;
+
+uniform int strandsCount;
+uniform int collidersCount;
+uniform mat4 modelMatrix;
+uniform float modelScale;
+uniform float collisionMargin;
+uniform bool rootSkinning;
+
+layout(local_size_x = 64, local_size_y = 1, local_size_z = 1) in;
+
+// rest root and length of every strand in model space
+layout(std430, binding = STRAND_REACH_BINDING) buffer StrandReach
+{
+    vec4 data[];
+} strandReach;
+
+layout(std430, binding = ROOT_TRANSFORMS_BINDING) buffer RootTransforms
+{
+    vec4 data[];
+} rootTransforms;
+
+layout(std430, binding = COLLIDERS_BINDING) buffer Colliders
+{
+    Collider data[];
+} colliders;
+
+layout(std430, binding = COLLIDER_MASKS_BINDING) buffer ColliderMasks
+{
+    uint data[];
+} colliderMasks;
+
+float segmentDistance(vec3 point, vec3 start, vec3 end)
+{
+    vec3 segment = end - start;
+    float t = clamp(dot(point - start, segment) / max(dot(segment, segment), 1e-12), 0.0, 1.0);
+    return length(point - (start + segment * t));
+}
+
+// marks the colliders the reach sphere of the strand overlaps in world space,
+// a skinned root is taken from where the scalp currently is
+void main()
+{
+    int strandIndex = int(gl_GlobalInvocationID.x);
+    if(strandIndex >= strandsCount) {
+        return;
+    }
+
+    vec4 reach = strandReach.data[strandIndex];
+    vec3 root = rootSkinning ? rootTransforms.data[strandIndex * 2].xyz : (modelMatrix * vec4(reach.xyz, 1.0)).xyz;
+    float reachLength = reach.w * modelScale + collisionMargin;
+
+    uint masks[2] = uint[2](0u, 0u);
+    for(int i = 0; i < collidersCount; i++) {
+        Collider collider = colliders.data[i];
+        if(segmentDistance(root, collider.start, collider.end) <= reachLength + collider.radius) {
+            masks[i / 32] |= 1u << uint(i % 32);
+        }
+    }
+
+    colliderMasks.data[strandIndex * 2] = masks[0];
+    colliderMasks.data[strandIndex * 2 + 1] = masks[1];
+}
+)glsl"
+        },
+        {
+            "CompactRestUnpack.comp",
+R"glsl(precision highp float;
+
+uniform int verticesCount;
+
+layout(local_size_x = 64, local_size_y = 1, local_size_z = 1) in;
+
+layout(std430, binding = REST_POSITIONS_BUFFER_BINDING) buffer RestPositions
+{
+    float data[];
+} restPos;
+
+layout(std430, binding = MOVABILITY_BINDING) buffer Movability
+{
+    uint data[];
+} movability;
+
+layout(std430, binding = POSITIONS_BUFFER_BINDING) buffer Positions
+{
+    vec4 data[];
+} pos;
+
+layout(std430, binding = PREVIOUS_POSITIONS_BUFFER_BINDING) buffer PrevPositions
+{
+    vec4 data[];
+} prevPos;
+
+// instances of compact models still simulate vec4 positions, they start from the unpacked rest pose
+void main()
+{
+    int index = int(gl_GlobalInvocationID.x);
+    if(index >= verticesCount) {
+        return;
+    }
+
+    bool movable = (movability.data[index >> 5] & (1u << (index & 31))) != 0u;
+    vec4 position = vec4(restPos.data[index * 3], restPos.data[index * 3 + 1], restPos.data[index * 3 + 2], movable ? 1.0 : 0.0);
+    pos.data[index] = position;
+    prevPos.data[index] = position;
+}
+)glsl"
+        },
+        {
+            "DensityResolve.comp",
+R"glsl(precision highp float;
+
+layout(local_size_x = 4, local_size_y = 4, local_size_z = 4) in;
+
+layout(std430, binding = DENSITY_GRID_BINDING) buffer DensityGrid {
+    uint data[];
+} densityGrid;
+
+layout(r16f, binding = 0) uniform writeonly image3D densityVolume;
+
+
+void main()
+{
+    ivec3 cell = ivec3(gl_GlobalInvocationID);
+    int cellIndex = (cell.z * DENSITY_VOLUME_SIZE + cell.y) * DENSITY_VOLUME_SIZE + cell.x;
+
+    // strand vertices per cell
+    float density = float(densityGrid.data[cellIndex]) / DENSITY_FIXED_POINT_SCALE;
+    imageStore(densityVolume, cell, vec4(density, 0.0, 0.0, 0.0));
+}
+)glsl"
+        },
+        {
+            "DensitySplat.comp",
+R"glsl(precision highp float;
+
+uniform int verticesCount;
+uniform vec3 volumeMin;
+uniform vec3 volumeScale;
+
+layout(local_size_x = 64, local_size_y = 1, local_size_z = 1) in;
+
+layout(std430, binding = POSITIONS_BUFFER_BINDING) buffer Positions {
+    vec4 data[];
+} positions;
+
+layout(std430, binding = DENSITY_GRID_BINDING) buffer DensityGrid {
+    uint data[];
+} densityGrid;
+
+
+void main()
+{
+    int vertexIndex = int(gl_GlobalInvocationID.x);
+    if(vertexIndex >= verticesCount) {
+        return;
+    }
+
+    // cell centers sit at half texel offsets like the texture the grid resolves to
+    vec3 gridPosition = (positions.data[vertexIndex].xyz - volumeMin) * volumeScale * DENSITY_VOLUME_SIZE - 0.5;
+    ivec3 baseCell = ivec3(floor(gridPosition));
+    vec3 fraction = gridPosition - vec3(baseCell);
+
+    // trilinear splat keeps the volume smooth while the strands move
+    for(int i = 0; i < 8; i++) {
+        ivec3 offset = ivec3(i & 1, (i >> 1) & 1, (i >> 2) & 1);
+        ivec3 cell = baseCell + offset;
+        if(any(lessThan(cell, ivec3(0))) || any(greaterThanEqual(cell, ivec3(DENSITY_VOLUME_SIZE)))) {
+            continue;
+        }
+
+        vec3 weights = mix(1.0 - fraction, fraction, vec3(offset));
+        uint amount = uint(weights.x * weights.y * weights.z * DENSITY_FIXED_POINT_SCALE + 0.5);
+        int cellIndex = (cell.z * DENSITY_VOLUME_SIZE + cell.y) * DENSITY_VOLUME_SIZE + cell.x;
+        atomicAdd(densityGrid.data[cellIndex], amount);
+    }
+}
+)glsl"
+        },
+        {
+            "HairCulling.comp",
+R"glsl(precision highp float;
+
+uniform int verticesPerStrand;
+uniform int trianglesCount;
+uniform float maxHairWidth;
+uniform int stripVerticesPerTriangle;
+uniform int viewsCount;
+uniform vec4 frustumPlanes[6 * MAX_VIEWS];
+uniform mat4 viewProjectionMatrix;
+
+uniform int occlusionCulling;
+uniform int hiZLevels;
+uniform vec2 hiZSize;
+layout(binding = 0) uniform sampler2D hiZTexture;
+
+layout(local_size_x = 64, local_size_y = 1, local_size_z = 1) in;
+
+layout(std430, binding = POSITIONS_BUFFER_BINDING) buffer Positions
+{
+    vec4 data[];
+} positions;
+
+layout(std430, binding = HAIR_INDICES_BUFFER_BINDING) buffer HairIndices
+{
+    ivec4 data[];
+} hairIndices;
+
+layout(std430, binding = CULLING_COMMANDS_BINDING) buffer Commands
+{
+    CullingCommands commands;
+};
+
+layout(std430, binding = VISIBLE_TRIANGLES_BINDING) buffer VisibleTriangles
+{
+    int data[];
+} visibleTriangles;
+
+layout (std140, binding = HAIR_DATA_BINDING) uniform HairDataBlock {
+    HairRenderData hairData;
+};
+
+
+bool isInsideFrustum(int view, vec3 boundsMin, vec3 boundsMax)
+{
+    for(int i = 0; i < 6; i++) {
+        vec4 plane = frustumPlanes[view * 6 + i];
+        vec3 farthest = mix(boundsMin, boundsMax, greaterThan(plane.xyz, vec3(0.0)));
+        if(dot(plane.xyz, farthest) + plane.w < 0.0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool isOccluded(vec3 boundsMin, vec3 boundsMax)
+{
+    vec2 screenMin = vec2(1.0);
+    vec2 screenMax = vec2(0.0);
+    float closestDepth = 1.0;
+
+    for(int i = 0; i < 8; i++) {
+        vec3 corner = mix(boundsMin, boundsMax, vec3(i & 1, (i >> 1) & 1, (i >> 2) & 1));
+        vec4 clip = viewProjectionMatrix * vec4(corner, 1.0);
+
+        // bounds crossing the near plane are never occluded
+        if(clip.w <= 0.0) {
+            return false;
+        }
+
+        vec3 ndc = clip.xyz / clip.w;
+        screenMin = min(screenMin, ndc.xy * 0.5 + 0.5);
+        screenMax = max(screenMax, ndc.xy * 0.5 + 0.5);
+        closestDepth = min(closestDepth, ndc.z * 0.5 + 0.5);
+    }
+
+    screenMin = clamp(screenMin, 0.0, 1.0);
+    screenMax = clamp(screenMax, 0.0, 1.0);
+
+    // pick the level on which the bounds span at most 2x2 texels
+    vec2 extent = (screenMax - screenMin) * hiZSize;
+    int level = clamp(int(ceil(log2(max(max(extent.x, extent.y), 1.0)))), 0, hiZLevels - 1);
+
+    ivec2 levelSize = textureSize(hiZTexture, level);
+    ivec2 texelMin = clamp(ivec2(screenMin * vec2(levelSize)), ivec2(0), levelSize - 1);
+    ivec2 texelMax = clamp(ivec2(screenMax * vec2(levelSize)), ivec2(0), levelSize - 1);
+
+    float occluderDepth = texelFetch(hiZTexture, texelMin, level).r;
+    occluderDepth = max(occluderDepth, texelFetch(hiZTexture, ivec2(texelMax.x, texelMin.y), level).r);
+    occluderDepth = max(occluderDepth, texelFetch(hiZTexture, ivec2(texelMin.x, texelMax.y), level).r);
+    occluderDepth = max(occluderDepth, texelFetch(hiZTexture, texelMax, level).r);
+
+    return closestDepth > occluderDepth;
+}
+
+void main()
+{
+    int triangleIndex = int(gl_GlobalInvocationID.x);
+    if(triangleIndex >= trianglesCount) {
+        return;
+    }
+
+    // interpolated hairs are B-splines over the guide vertices, so they stay
+    // inside the bounds of the three guide strands
+    ivec3 guides = hairIndices.data[triangleIndex].xyz;
+    vec3 boundsMin = vec3(1e30);
+    vec3 boundsMax = vec3(-1e30);
+
+    for(int i = 0; i < 3; i++) {
+        int rootIndex = guides[i] * verticesPerStrand;
+        for(int j = 0; j < verticesPerStrand; j++) {
+            vec3 position = positions.data[rootIndex + j].xyz;
+            boundsMin = min(boundsMin, position);
+            boundsMax = max(boundsMax, position);
+        }
+    }
+
+    boundsMin -= vec3(maxHairWidth);
+    boundsMax += vec3(maxHairWidth);
+
+    // with several views a triangle is kept when any of them sees it
+    bool insideFrustum = false;
+    for(int i = 0; i < viewsCount && !insideFrustum; i++) {
+        insideFrustum = isInsideFrustum(i, boundsMin, boundsMax);
+    }
+
+    if(!insideFrustum) {
+        return;
+    }
+
+    if(occlusionCulling != 0 && isOccluded(boundsMin, boundsMax)) {
+        return;
+    }
+
+    int visibleIndex = atomicAdd(commands.visibleTriangles, 1);
+    atomicAdd(commands.count, hairData.segmentsCount);
+    atomicAdd(commands.stripCount, stripVerticesPerTriangle);
+    atomicAdd(commands.groupsX, 1);
+    visibleTriangles.data[visibleIndex] = triangleIndex;
+}
+)glsl"
+        },
+        {
+            "HairExpand.comp",
+R"glsl(precision highp float;
+
+uniform int hairsPerTriangle;
+uniform int pointsPerSegment;
+
+layout(local_size_x = MAX_HAIRS_PER_TRIANGLE, local_size_y = 1, local_size_z = 1) in;
+
+layout (std140, binding = HAIR_DATA_BINDING) uniform HairDataBlock {
+    HairRenderData hairData;
+};
+
+layout(std430, binding = POSITIONS_BUFFER_BINDING) buffer Positions {
+    vec4 data[];
+} positions;
+
+layout(std430, binding = HAIR_INDICES_BUFFER_BINDING) buffer HairIndices {
+    ivec4 data[];
+} hairIndices;
+
+layout(std430, binding = VISIBLE_TRIANGLES_BINDING) buffer VisibleTriangles {
+    int data[];
+} visibleTriangles;
+
+layout(std430, binding = FOLLOWER_COORDS_BINDING) buffer FollowerCoords {
+    vec4 data[];
+} followerCoords;
+
+layout(std430, binding = STRAND_VERTICES_BINDING) buffer StrandVertices {
+    StrandVertex data[];
+} strandVertices;
+
+const mat4 coefficientMatrix = mat4(
+    vec4(-1, 3, -3, 1),
+    vec4(3, -6, 0, 4),
+    vec4(-3, 3, 3, 1),
+    vec4(1, 0, 0, 0));
+
+void main()
+{
+    int slot = int(gl_WorkGroupID.x);
+    int hairIndex = int(gl_LocalInvocationID.x);
+    if(hairIndex >= hairsPerTriangle) {
+        return;
+    }
+
+    int triangleIndex = hairData.cullingEnabled != 0 ? visibleTriangles.data[slot] : slot;
+    ivec3 guides = hairIndices.data[triangleIndex].xyz;
+    vec3 weights = followerCoords.data[hairIndex].xyz;
+
+    int segmentsCount = hairData.segmentsCount;
+    int verticesPerStrand = segmentsCount + 1;
+    int pointsPerHair = segmentsCount * pointsPerSegment + 1;
+    int outputIndex = (slot * hairsPerTriangle + hairIndex) * pointsPerHair;
+
+    // unused slots of smaller triangles become zero width strips
+    if(hairIndex >= getTriangleHairsCount(hairData, hairIndices.data[triangleIndex])) {
+        for(int point = 0; point < pointsPerHair; point++) {
+            strandVertices.data[outputIndex + point].position = vec4(0.0);
+            strandVertices.data[outputIndex + point].tangent = vec4(0.0);
+        }
+        return;
+    }
+
+    // control points of the interpolated hair, evaluated once instead of per output vertex
+    vec3 controlPoints[MAX_VERTICES_PER_STRAND];
+    for(int i = 0; i < verticesPerStrand; i++) {
+        controlPoints[i] = positions.data[guides[0] * verticesPerStrand + i].xyz * weights[0] +
+            positions.data[guides[1] * verticesPerStrand + i].xyz * weights[1] +
+            positions.data[guides[2] * verticesPerStrand + i].xyz * weights[2];
+    }
+
+    for(int point = 0; point < pointsPerHair; point++) {
+        int segmentIndex = min(point / pointsPerSegment, segmentsCount - 1);
+        float t = float(point - segmentIndex * pointsPerSegment) / float(pointsPerSegment);
+
+        vec3 p0 = controlPoints[max(segmentIndex - 1, 0)];
+        vec3 p1 = controlPoints[segmentIndex];
+        vec3 p2 = controlPoints[min(segmentIndex + 1, segmentsCount)];
+        vec3 p3 = controlPoints[min(segmentIndex + 2, segmentsCount)];
+
+        vec4 tVector = vec4(t * t * t, t * t, t, 1) / 6.0;
+        vec4 bSpline = tVector * coefficientMatrix;
+        vec3 position = p0 * bSpline[0] + p1 * bSpline[1] + p2 * bSpline[2] + p3 * bSpline[3];
+
+        float hairCoord = (segmentIndex + t) / segmentsCount;
+        float thinning = (hairCoord - hairData.thinningStart) / max(1.0 - hairData.thinningStart, 1e-4);
+        float width = mix(hairData.rootWidth, hairData.tipWidth, clamp(thinning, 0.0, 1.0));
+
+        vec3 tangent = normalize(p2 - p1);
+        if(length(p3 - p2) > 0) {
+            tangent = mix(tangent, normalize(p3 - p2), t);
+        }
+
+        strandVertices.data[outputIndex + point].position = vec4(position, width);
+        strandVertices.data[outputIndex + point].tangent = vec4(tangent, 0.0);
+    }
+}
+)glsl"
+        },
+        {
+            "HairFollowerCache.comp",
+R"glsl(precision highp float;
+
+uniform int hairsPerTriangle;
+
+layout(local_size_x = MAX_HAIRS_PER_TRIANGLE, local_size_y = 1, local_size_z = 1) in;
+
+layout (std140, binding = HAIR_DATA_BINDING) uniform HairDataBlock {
+    HairRenderData hairData;
+};
+
+layout(std430, binding = POSITIONS_BUFFER_BINDING) buffer Positions {
+    vec4 data[];
+} positions;
+
+layout(std430, binding = HAIR_INDICES_BUFFER_BINDING) buffer HairIndices {
+    ivec4 data[];
+} hairIndices;
+
+layout(std430, binding = VISIBLE_TRIANGLES_BINDING) buffer VisibleTriangles {
+    int data[];
+} visibleTriangles;
+
+layout(std430, binding = FOLLOWER_COORDS_BINDING) buffer FollowerCoords {
+    vec4 data[];
+} followerCoords;
+
+layout(std430, binding = FOLLOWER_CACHE_BINDING) buffer FollowerCache {
+    vec4 data[];
+} followerCache;
+
+void main()
+{
+    int slot = int(gl_WorkGroupID.x);
+    int hairIndex = int(gl_LocalInvocationID.x);
+    if(hairIndex >= hairsPerTriangle) {
+        return;
+    }
+
+    int triangleIndex = hairData.cullingEnabled != 0 ? visibleTriangles.data[slot] : slot;
+    if(hairIndex >= getTriangleHairsCount(hairData, hairIndices.data[triangleIndex])) {
+        return;
+    }
+
+    ivec3 guides = hairIndices.data[triangleIndex].xyz;
+    vec3 weights = followerCoords.data[hairIndex].xyz;
+
+    int verticesPerStrand = hairData.segmentsCount + 1;
+    int outputIndex = (slot * hairsPerTriangle + hairIndex) * verticesPerStrand;
+
+    for(int i = 0; i < verticesPerStrand; i++) {
+        vec3 position = positions.data[guides[0] * verticesPerStrand + i].xyz * weights[0] +
+            positions.data[guides[1] * verticesPerStrand + i].xyz * weights[1] +
+            positions.data[guides[2] * verticesPerStrand + i].xyz * weights[2];
+
+        followerCache.data[outputIndex + i] = vec4(position, 1.0);
+    }
+}
+)glsl"
+        },
+        {
+            "HairFollowers.comp",
+R"glsl(precision highp float;
+
+uniform int verticesPerStrand;
+uniform int strandsCount;
+uniform int strandStride;
+uniform int followersOffset;
+uniform int rootSkinning;
+uniform vec4 modelRotation;
+
+layout(local_size_x = 64, local_size_y = 1, local_size_z = 1) in;
+
+#ifdef COMPACT_STORAGE
+layout(std430, binding = REST_POSITIONS_BUFFER_BINDING) buffer RestPositions
+{
+    float data[];
+} restPos;
+
+layout(std430, binding = MOVABILITY_BINDING) buffer Movability
+{
+    uint data[];
+} movability;
+
+vec4 getRestPosition(int index)
+{
+    bool movable = (movability.data[index >> 5] & (1u << (index & 31))) != 0u;
+    return vec4(restPos.data[index * 3], restPos.data[index * 3 + 1], restPos.data[index * 3 + 2], movable ? 1.0 : 0.0);
+}
+#else
+layout(std430, binding = REST_POSITIONS_BUFFER_BINDING) buffer RestPositions
+{
+    vec4 data[];
+} restPos;
+
+vec4 getRestPosition(int index)
+{
+    return restPos.data[index];
+}
+#endif
+
+layout(std430, binding = POSITIONS_BUFFER_BINDING) buffer Positions
+{
+    vec4 data[];
+} pos;
+
+layout(std430, binding = PREVIOUS_POSITIONS_BUFFER_BINDING) buffer PreviousPositions
+{
+    vec4 data[];
+} prevPos;
+
+layout(std430, binding = FOLLOWERS_BINDING) buffer Followers
+{
+    FollowerData data[];
+} followers;
+
+layout(std430, binding = ROOT_TRANSFORMS_BINDING) buffer RootTransforms
+{
+    vec4 data[];
+} rootTransforms;
+
+void main()
+{
+    int globalVertexIndex = int(gl_GlobalInvocationID.x);
+    int strandIndex = globalVertexIndex / verticesPerStrand;
+    int localID = globalVertexIndex % verticesPerStrand;
+
+    // guide strands were simulated by the solver
+    if(strandIndex >= strandsCount || strandIndex % strandStride == 0) {
+        return;
+    }
+
+    FollowerData follower = followers.data[followersOffset + strandIndex];
+    vec4 restPosition = getRestPosition(globalVertexIndex);
+    vec4 rootRotation = rootSkinning != 0 ? rootTransforms.data[strandIndex * 2 + 1] : modelRotation;
+
+    vec3 position = vec3(0.0, 0.0, 0.0);
+    vec3 previousPosition = vec3(0.0, 0.0, 0.0);
+
+    for(int i = 0; i < 3; i++) {
+        int guideVertexIndex = follower.guideIndices[i] * verticesPerStrand + localID;
+        vec3 restOffset = multQuaternionAndVector(rootRotation, restPosition.xyz - getRestPosition(guideVertexIndex).xyz);
+
+        position += follower.weights[i] * (pos.data[guideVertexIndex].xyz + restOffset);
+        previousPosition += follower.weights[i] * (prevPos.data[guideVertexIndex].xyz + restOffset);
+    }
+
+    pos.data[globalVertexIndex] = vec4(position, restPosition.w);
+    prevPos.data[globalVertexIndex] = vec4(previousPosition, restPosition.w);
+}
+)glsl"
+        },
+        {
+            "HairGridScatter.comp",
+R"glsl(precision highp float;
+
+uniform int verticesCount;
+uniform float timeStep;
+uniform vec3 gridMin;
+uniform vec3 gridScale;
+
+layout(local_size_x = 64, local_size_y = 1, local_size_z = 1) in;
+
+layout(std430, binding = POSITIONS_BUFFER_BINDING) buffer Positions {
+    vec4 data[];
+} pos;
+
+layout(std430, binding = PREVIOUS_POSITIONS_BUFFER_BINDING) buffer PreviousPositions {
+    vec4 data[];
+} prevPos;
+
+// density and density weighted velocity per cell in fixed point, so plain
+// integer atomics can accumulate them. With the velocity clamped to
+// HAIR_GRID_MAX_VELOCITY a cell holds the weight of about 2^31 / (1024 * 16),
+// 131072 vertices, before the velocity sums overflow.
+layout(std430, binding = HAIR_GRID_ACCUMULATION_BINDING) buffer HairGridAccumulation {
+    ivec4 data[];
+} gridAccumulation;
+
+
+void main()
+{
+    int vertexIndex = int(gl_GlobalInvocationID.x);
+    if(vertexIndex >= verticesCount) {
+        return;
+    }
+
+    vec3 position = pos.data[vertexIndex].xyz;
+    vec3 velocity = (position - prevPos.data[vertexIndex].xyz) / timeStep;
+    float speed = length(velocity);
+    if(speed > HAIR_GRID_MAX_VELOCITY) {
+        velocity *= HAIR_GRID_MAX_VELOCITY / speed;
+    }
+
+    vec3 gridPosition = (position - gridMin) * gridScale * HAIR_GRID_SIZE - 0.5;
+    ivec3 baseCell = ivec3(floor(gridPosition));
+    vec3 fraction = gridPosition - vec3(baseCell);
+
+    for(int i = 0; i < 8; i++) {
+        ivec3 offset = ivec3(i & 1, (i >> 1) & 1, (i >> 2) & 1);
+        ivec3 cell = baseCell + offset;
+        if(any(lessThan(cell, ivec3(0))) || any(greaterThanEqual(cell, ivec3(HAIR_GRID_SIZE)))) {
+            continue;
+        }
+
+        vec3 weights = mix(1.0 - fraction, fraction, vec3(offset));
+        float weight = weights.x * weights.y * weights.z;
+        ivec4 amount = ivec4(round(vec4(velocity * weight, weight) * HAIR_GRID_FIXED_POINT_SCALE));
+
+        int cellIndex = (cell.z * HAIR_GRID_SIZE + cell.y) * HAIR_GRID_SIZE + cell.x;
+        atomicAdd(gridAccumulation.data[cellIndex].x, amount.x);
+        atomicAdd(gridAccumulation.data[cellIndex].y, amount.y);
+        atomicAdd(gridAccumulation.data[cellIndex].z, amount.z);
+        atomicAdd(gridAccumulation.data[cellIndex].w, amount.w);
+    }
+}
+)glsl"
+        },
+        {
+            "HairGridSmooth.comp",
+R"glsl(precision highp float;
+
+layout(local_size_x = 4, local_size_y = 4, local_size_z = 4) in;
+
+layout(std430, binding = HAIR_GRID_ACCUMULATION_BINDING) buffer HairGridAccumulation {
+    ivec4 data[];
+} gridAccumulation;
+
+// two entries per cell, the smoothed velocity with density and the density gradient
+layout(std430, binding = HAIR_GRID_BINDING) buffer HairGrid {
+    vec4 data[];
+} grid;
+
+
+void main()
+{
+    ivec3 cell = ivec3(gl_GlobalInvocationID);
+
+    vec4 sum = vec4(0.0);
+    vec3 gradient = vec3(0.0);
+    float totalWeight = 0.0;
+
+    // 3x3x3 tent filter, its derivative gives the gradient of the smoothed density
+    for(int z = -1; z <= 1; z++) {
+        for(int y = -1; y <= 1; y++) {
+            for(int x = -1; x <= 1; x++) {
+                ivec3 neighbour = cell + ivec3(x, y, z);
+                if(any(lessThan(neighbour, ivec3(0))) || any(greaterThanEqual(neighbour, ivec3(HAIR_GRID_SIZE)))) {
+                    continue;
+                }
+
+                int neighbourIndex = (neighbour.z * HAIR_GRID_SIZE + neighbour.y) * HAIR_GRID_SIZE + neighbour.x;
+                vec4 value = vec4(gridAccumulation.data[neighbourIndex]) / HAIR_GRID_FIXED_POINT_SCALE;
+
+                vec3 tent = vec3(2 - abs(x), 2 - abs(y), 2 - abs(z));
+                float weight = tent.x * tent.y * tent.z;
+                sum += value * weight;
+                gradient += value.w * vec3(x * tent.y * tent.z, y * tent.x * tent.z, z * tent.x * tent.y);
+                totalWeight += weight;
+            }
+        }
+    }
+
+    float density = sum.w / totalWeight;
+    vec3 velocity = sum.w > 0.0 ? sum.xyz / sum.w : vec3(0.0);
+
+    int cellIndex = (cell.z * HAIR_GRID_SIZE + cell.y) * HAIR_GRID_SIZE + cell.x;
+    grid.data[cellIndex * 2] = vec4(velocity, density);
+    // a linear density field sums to half its slope with these weights
+    grid.data[cellIndex * 2 + 1] = vec4(gradient * 2.0 / totalWeight, 0.0);
+}
+)glsl"
+        },
+        {
+            "HairRootSkinning.comp",
+R"glsl(precision highp float;
+
+uniform int strandsCount;
+uniform mat4 modelMatrix;
+
+layout(local_size_x = 64, local_size_y = 1, local_size_z = 1) in;
+
+layout(std430, binding = SCALP_VERTICES_BINDING) buffer ScalpVertices
+{
+    vec4 data[];
+} scalpVertices;
+
+layout(std430, binding = SCALP_INDICES_BINDING) buffer ScalpIndices
+{
+    int data[];
+} scalpIndices;
+
+layout(std430, binding = ROOT_ATTACHMENTS_BINDING) buffer RootAttachments
+{
+    RootAttachment data[];
+} rootAttachments;
+
+layout(std430, binding = ROOT_TRANSFORMS_BINDING) buffer RootTransforms
+{
+    vec4 data[];
+} rootTransforms;
+
+// same as Quaternion::FromMatrix on the CPU, the frame axes are the matrix columns
+vec4 quaternionFromFrame(vec3 axisX, vec3 axisY, vec3 axisZ)
+{
+    mat3 m = mat3(axisX, axisY, axisZ);
+    vec4 q;
+
+    float trace = m[0][0] + m[1][1] + m[2][2];
+    if(trace > 0.0) {
+        q.w = 0.5 * sqrt(trace + 1.0);
+        float d = 1.0 / (4.0 * q.w);
+        q.x = (m[1][2] - m[2][1]) * d;
+        q.y = (m[2][0] - m[0][2]) * d;
+        q.z = (m[0][1] - m[1][0]) * d;
+        return q;
+    }
+
+    int i = 0;
+    if(m[1][1] > m[i][i]) {
+        i = 1;
+    }
+    if(m[2][2] > m[i][i]) {
+        i = 2;
+    }
+
+    int j = (i + 1) % 3;
+    int k = (j + 1) % 3;
+    float root = sqrt(m[i][i] - m[j][j] - m[k][k] + 1.0);
+    q[i] = 0.5 * root;
+    root = 0.5 / root;
+    q.w = (m[j][k] - m[k][j]) * root;
+    q[j] = (m[i][j] + m[j][i]) * root;
+    q[k] = (m[i][k] + m[k][i]) * root;
+    return q;
+}
+
+vec3 getScalpVertex(int index)
+{
+    return (modelMatrix * vec4(scalpVertices.data[scalpIndices.data[index]].xyz, 1.0)).xyz;
+}
+
+void main()
+{
+    int strandIndex = int(gl_GlobalInvocationID.x);
+    if(strandIndex >= strandsCount) {
+        return;
+    }
+
+    RootAttachment attachment = rootAttachments.data[strandIndex];
+    vec3 a = getScalpVertex(attachment.triangle * 3);
+    vec3 b = getScalpVertex(attachment.triangle * 3 + 1);
+    vec3 c = getScalpVertex(attachment.triangle * 3 + 2);
+
+    vec3 surfacePoint = a * (1.0 - attachment.u - attachment.v) + b * attachment.u + c * attachment.v;
+
+    vec3 axisX = normalize(b - a);
+    vec3 axisZ = normalize(cross(b - a, c - a));
+    vec3 axisY = cross(axisZ, axisX);
+    vec4 frame = quaternionFromFrame(axisX, axisY, axisZ);
+
+    rootTransforms.data[strandIndex * 2] = vec4(surfacePoint + multQuaternionAndVector(frame, attachment.offset.xyz), 0.0);
+    rootTransforms.data[strandIndex * 2 + 1] = multQuaternionAndQuaternion(frame, attachment.restFrameInverse);
+}
+)glsl"
+        },
+        {
+            "HairSimulation.comp",
+R"glsl(precision highp float;
+
+uniform mat4 modelMatrix;
+uniform int verticesPerStrand;
+uniform int strandStride;
+uniform float timeStep;
+uniform float globalConstraint;
+uniform float localConstraint;
+uniform float friction;
+uniform vec3 gravityForce;
+uniform int lenConstraintIter;
+uniform int localConstraintIter;
+uniform mat4 windVecs;
+uniform int hairInteraction;
+uniform float interactionFriction;
+uniform float volumePreservation;
+uniform vec3 gridMin;
+uniform vec3 gridScale;
+uniform int collidersCount;
+uniform float collisionMargin;
+uniform int distanceFieldEnabled;
+uniform mat4 distanceFieldMatrix;
+uniform mat3 distanceFieldNormalMatrix;
+uniform float distanceFieldScale;
+uniform int rootSkinning;
+uniform vec4 modelRotation;
+
+shared vec4 sharedPositions[MAX_VERTICES_PER_STRAND];
+
+layout(local_size_x = 1, local_size_y = MAX_VERTICES_PER_STRAND, local_size_z = 1) in;
+
+
+#ifdef COMPACT_STORAGE
+layout(std430, binding = REST_POSITIONS_BUFFER_BINDING) buffer RestPositions
+{
+    float data[];
+} restPos;
+
+layout(std430, binding = TANGENTS_DISTANCES_BINDING) buffer RestLengths
+{
+    float data[];
+} restLengths;
+
+layout(std430, binding = REF_VECTORS_BINDING) buffer RefVectors
+{
+    uvec2 data[];
+} refVectors;
+
+layout(std430, binding = GLOBAL_ROTATIONS_BINDING) buffer GlobalRotations
+{
+    uvec2 data[];
+} globalRotations;
+
+layout(std430, binding = MOVABILITY_BINDING) buffer Movability
+{
+    uint data[];
+} movability;
+#else
+layout(std430, binding = REST_POSITIONS_BUFFER_BINDING) buffer RestPositions
+{
+    vec4 data[];
+} restPos;
+
+layout(std430, binding = TANGENTS_DISTANCES_BINDING) buffer TangentsDistances
+{
+    vec4 data[];
+} tangents;
+
+layout(std430, binding = REF_VECTORS_BINDING) buffer RefVectors
+{
+    vec4 data[];
+} refVectors;
+
+layout(std430, binding = GLOBAL_ROTATIONS_BINDING) buffer GlobalRotations
+{
+    vec4 data[];
+} globalRotations;
+#endif
+
+layout(std430, binding = POSITIONS_BUFFER_BINDING) buffer Positions
+{
+    vec4 data[];
+} pos;
+
+layout(std430, binding = PREVIOUS_POSITIONS_BUFFER_BINDING) buffer PreviousPositions
+{
+    vec4 data[];
+} prevPos;
+
+layout(std430, binding = HAIR_GRID_BINDING) buffer HairGrid
+{
+    vec4 data[];
+} hairGrid;
+
+layout(std430, binding = COLLIDERS_BINDING) buffer Colliders
+{
+    Collider data[];
+} colliders;
+
+layout(std430, binding = COLLIDER_MASKS_BINDING) buffer ColliderMasks
+{
+    uint data[];
+} colliderMasks;
+
+layout(std430, binding = ROOT_TRANSFORMS_BINDING) buffer RootTransforms
+{
+    vec4 data[];
+} rootTransforms;
+
+layout(binding = DISTANCE_FIELD_TEXTURE_UNIT) uniform sampler3D distanceField;
+
+
+// the compact layout packs positions into three floats, movability into bits
+// and the rotation data into halfs
+#ifdef COMPACT_STORAGE
+vec4 getRestPosition(int index)
+{
+    bool movable = (movability.data[index >> 5] & (1u << (index & 31))) != 0u;
+    return vec4(restPos.data[index * 3], restPos.data[index * 3 + 1], restPos.data[index * 3 + 2], movable ? 1.0 : 0.0);
+}
+
+float getRestLength(int index)
+{
+    return restLengths.data[index];
+}
+
+vec3 getRefVector(int index)
+{
+    uvec2 halfs = refVectors.data[index];
+    return vec3(unpackHalf2x16(halfs.x), unpackHalf2x16(halfs.y).x);
+}
+
+vec4 getGlobalRotation(int index)
+{
+    uvec2 halfs = globalRotations.data[index];
+    return vec4(unpackHalf2x16(halfs.x), unpackHalf2x16(halfs.y));
+}
+#else
+vec4 getRestPosition(int index)
+{
+    return restPos.data[index];
+}
+
+float getRestLength(int index)
+{
+    return tangents.data[index].w;
+}
+
+vec3 getRefVector(int index)
+{
+    return refVectors.data[index].xyz;
+}
+
+vec4 getGlobalRotation(int index)
+{
+    return globalRotations.data[index];
+}
+#endif
+
+vec3 windForce(int localID, int globalID) {
+    vec3 wind0 = windVecs[0].xyz;
+	if(length(wind0) == 0 || localID < 2 || localID >= verticesPerStrand - 1) {
+	    return vec3(0.0, 0.0, 0.0);
+	}
+	float a = (globalID % 20) / 20.0f;
+	vec3 w = a * wind0 + (1.0 - a) * windVecs[1].xyz + a * windVecs[2].xyz + (1.0 - a) * windVecs[3].xyz;
+	vec3 tangent = normalize(sharedPositions[localID].xyz - sharedPositions[localID + 1].xyz);
+	vec3 windForce = cross(cross(tangent, w), tangent);
+	return windForce;
+}
+
+
+bool canMove(vec4 position)
+{
+    return position.w > 0;
+}
+
+
+vec2 checkMove(vec4 p0, vec4 p1)
+{
+    if(canMove(p0)) {
+	    return canMove(p1) ? vec2(0.5, 0.5) : vec2(1.0, 0.0);
+	}
+	else {
+	    return canMove(p1) ? vec2(0.0, 1.0) : vec2(0.0, 0.0);
+	}
+}
+
+vec4 inverseQuaternion(vec4 quaternion)
+{
+    float lengthSqr = quaternion.x * quaternion.x + quaternion.y * quaternion.y + quaternion.z * quaternion.z + quaternion.w * quaternion.w;
+	if(lengthSqr < 0.001) {
+	    return vec4(0, 0, 0, 1.0f);
+	}
+
+	quaternion.x = -quaternion.x / lengthSqr;
+	quaternion.y = -quaternion.y / lengthSqr;
+	quaternion.z = -quaternion.z / lengthSqr;
+	quaternion.w = quaternion.w / lengthSqr;
+
+	return quaternion;
+}
+
+vec4 makeQuaternion(float angle, vec3 axis)
+{
+    vec4 quaternion = vec4(0.0, 0.0, 0.0, 0.0);
+	float halfAngle = angle * 0.5f;
+	quaternion.w = cos(halfAngle);
+	quaternion.xyz = axis * sin(halfAngle);
+	return quaternion;
+}
+
+// roots follow the skinned scalp when one is bound and the model matrix otherwise
+void getRootTransform(int strandIndex, vec3 restRoot, out vec3 rootPosition, out vec4 rootRotation)
+{
+    if(rootSkinning != 0) {
+        rootPosition = rootTransforms.data[strandIndex * 2].xyz;
+        rootRotation = rootTransforms.data[strandIndex * 2 + 1];
+    } else {
+        rootPosition = (modelMatrix * vec4(restRoot, 1.0)).xyz;
+        rootRotation = modelRotation;
+    }
+}
+
+// trilinear lookup of the smoothed grid, x holds velocity and density, y the density gradient
+mat2x4 sampleHairGrid(vec3 position)
+{
+    vec3 gridPosition = clamp((position - gridMin) * gridScale * HAIR_GRID_SIZE - 0.5, vec3(0.0), vec3(HAIR_GRID_SIZE - 1));
+    ivec3 baseCell = min(ivec3(gridPosition), ivec3(HAIR_GRID_SIZE - 2));
+    vec3 fraction = gridPosition - vec3(baseCell);
+
+    mat2x4 result = mat2x4(0.0);
+    for(int i = 0; i < 8; i++) {
+        ivec3 offset = ivec3(i & 1, (i >> 1) & 1, (i >> 2) & 1);
+        ivec3 cell = baseCell + offset;
+        vec3 weights = mix(1.0 - fraction, fraction, vec3(offset));
+        float weight = weights.x * weights.y * weights.z;
+
+        int cellIndex = (cell.z * HAIR_GRID_SIZE + cell.y) * HAIR_GRID_SIZE + cell.x;
+        result[0] += hairGrid.data[cellIndex * 2] * weight;
+        result[1] += hairGrid.data[cellIndex * 2 + 1] * weight;
+    }
+    return result;
+}
+
+// friction pulls the step towards the local average velocity of the hair, the
+// volume term pushes vertices down the density gradient
+vec3 hairInteractionOffset(vec4 currPos, vec4 prevPosVec)
+{
+    mat2x4 gridSample = sampleHairGrid(currPos.xyz);
+    vec3 velocityStep = currPos.xyz - prevPosVec.xyz;
+    vec3 frictionOffset = interactionFriction * (gridSample[0].xyz * timeStep - velocityStep);
+
+    vec3 cellSize = 1.0 / (gridScale * HAIR_GRID_SIZE);
+    vec3 volumeOffset = -volumePreservation * gridSample[1].xyz / max(gridSample[0].w, 1.0) * cellSize;
+
+    return frictionOffset + volumeOffset;
+}
+
+// pushes the position out of the colliders marked in the strand candidate mask
+vec3 resolveCollisions(vec3 position, int strandIndex)
+{
+    for(int word = 0; word < 2; word++) {
+        uint mask = colliderMasks.data[strandIndex * 2 + word];
+
+        while(mask != 0u) {
+            int bit = findLSB(mask);
+            mask &= mask - 1u;
+
+            Collider collider = colliders.data[word * 32 + bit];
+            vec3 segment = collider.end - collider.start;
+            float t = clamp(dot(position - collider.start, segment) / max(dot(segment, segment), 1e-12), 0.0, 1.0);
+            vec3 offset = position - (collider.start + segment * t);
+            float distance = length(offset);
+
+            float radius = collider.radius + collisionMargin;
+            if(distance < radius && distance > 1e-7) {
+                position += offset * (radius / distance - 1.0);
+            }
+        }
+    }
+    return position;
+}
+
+)glsl"
+R"glsl(// one fetch gives the outward normal and the signed distance in field units
+vec3 resolveDistanceField(vec3 position)
+{
+    vec3 uvw = (distanceFieldMatrix * vec4(position, 1.0)).xyz;
+    if(any(lessThan(uvw, vec3(0.0))) || any(greaterThan(uvw, vec3(1.0)))) {
+        return position;
+    }
+
+    vec4 field = texture(distanceField, uvw);
+    float distance = field.w * distanceFieldScale - collisionMargin;
+    if(distance < 0.0 && dot(field.xyz, field.xyz) > 1e-6) {
+        position -= distance * normalize(distanceFieldNormalMatrix * field.xyz);
+    }
+    return position;
+}
+
+void changePosData(vec4 prevPosVec, vec4 newPosVec, int globalVertexIndex)
+{
+    pos.data[globalVertexIndex] = newPosVec;
+	prevPos.data[globalVertexIndex] = prevPosVec;
+}
+
+vec4 verletIntegration(vec4 currPos, vec4 prevPosVec, vec3 force, float frictionCoef)
+{
+    vec4 outputPos = currPos;
+	outputPos.xyz = currPos.xyz + (1.0 - frictionCoef) * (currPos.xyz - prevPosVec.xyz) + force * timeStep * timeStep;
+	return outputPos;
+}
+
+void distConstraint(int index0, int index1, float targetDistance)
+{
+    vec4 p0 = sharedPositions[index0];
+	vec4 p1 = sharedPositions[index1];
+
+	vec3 deltaVec = p1.xyz - p0.xyz;
+	float distance = max(length(deltaVec), 1e-7);
+	float stretching = 1 - targetDistance / distance;
+	deltaVec = deltaVec * stretching;
+	vec2 multiplier = checkMove(p0, p1);
+
+	sharedPositions[index0].xyz += multiplier[0] * deltaVec;
+	sharedPositions[index1].xyz -= multiplier[1] * deltaVec;
+}
+
+
+
+void main()
+{
+    int globalID = int(gl_GlobalInvocationID.x) * strandStride;
+	int localID = int(gl_LocalInvocationID.y);
+
+	if(localID >= verticesPerStrand) {
+	    return;
+	}
+
+	int globalRootVertexIndex = globalID * (verticesPerStrand);
+	int globalVertexIndex = globalRootVertexIndex + localID;
+
+	float restLength = getRestLength(globalVertexIndex);
+	vec4 prevPosVec = prevPos.data[globalVertexIndex];
+	vec4 currPos = pos.data[globalVertexIndex];
+	vec4 initPos = getRestPosition(globalVertexIndex);
+
+	// the rest pose moves rigidly with the root
+	vec3 restRoot = getRestPosition(globalRootVertexIndex).xyz;
+	vec3 rootPosition;
+	vec4 rootRotation;
+	getRootTransform(globalID, restRoot, rootPosition, rootRotation);
+	initPos.xyz = rootPosition + multQuaternionAndVector(rootRotation, initPos.xyz - restRoot);
+
+	sharedPositions[localID] = currPos;
+	if(!canMove(currPos)) {
+	    sharedPositions[localID].xyz = initPos.xyz;
+	}
+	barrier();
+
+	if(canMove(currPos)) {
+	    vec3 force = gravityForce + windForce(localID, globalID);
+	    sharedPositions[localID] = verletIntegration(currPos, prevPosVec, force, friction);
+
+	    if(hairInteraction != 0) {
+	        sharedPositions[localID].xyz += hairInteractionOffset(currPos, prevPosVec);
+	    }
+	}
+
+	vec3 deltaVec = globalConstraint * (initPos - sharedPositions[localID]).xyz;
+	sharedPositions[localID].xyz += deltaVec;
+	barrier();
+
+	if(localID == 0) {
+	    for(int i = 0; i < localConstraintIter; i++) {
+		    vec4 position = sharedPositions[1];
+			vec4 globalRotation = multQuaternionAndQuaternion(rootRotation, getGlobalRotation(globalRootVertexIndex));
+
+			for(int localVertexIndex = 1; localVertexIndex < verticesPerStrand - 1; localVertexIndex++) {
+			    vec4 posNext = sharedPositions[localVertexIndex + 1];
+				vec3 localPosNext = getRefVector(globalRootVertexIndex + localVertexIndex + 1);
+				vec3 originalPosNext = multQuaternionAndVector(globalRotation, localPosNext) + position.xyz;
+
+				vec3 localDelta = localConstraint * (originalPosNext - posNext.xyz);
+
+				if(canMove(position)) {
+				    position.xyz -= localDelta;
+				}
+
+				if(canMove(posNext)) {
+				    posNext.xyz += localDelta;
+				}
+
+				vec4 globalRotationInv = inverseQuaternion(globalRotation);
+				vec3 tangent = normalize(posNext.xyz - position.xyz);
+				vec3 localTangent = normalize(multQuaternionAndVector(globalRotationInv, tangent));
+				vec3 axisX = vec3(1.0, 0, 0);
+				vec3 rotAxis = cross(axisX, localTangent);
+				float angle = acos(dot(axisX, localTangent));
+
+				if(length(rotAxis) > 0.001 && abs(angle) > 0.001) {
+					rotAxis = normalize(rotAxis);
+					vec4 localRotation = makeQuaternion(angle, rotAxis);
+					globalRotation = multQuaternionAndQuaternion(globalRotation, localRotation);
+				}
+
+				sharedPositions[localVertexIndex].xyz = position.xyz;
+				sharedPositions[localVertexIndex + 1].xyz = posNext.xyz;
+				position = posNext;
+			}
+	    } 
+	}
+	barrier();
+
+	for(int i = 0; i < lenConstraintIter; i++) {
+
+	    if(localID % 2 == 0 && localID < verticesPerStrand - 1) {
+		    distConstraint(localID, localID + 1, restLength);
+		}
+
+		barrier();
+
+		if(localID % 2 == 1 && localID < verticesPerStrand - 1) {
+		    distConstraint(localID, localID + 1, restLength);
+		}
+
+		barrier();
+	}
+
+	if(collidersCount > 0 && canMove(currPos)) {
+	    sharedPositions[localID].xyz = resolveCollisions(sharedPositions[localID].xyz, globalID);
+	}
+
+	if(distanceFieldEnabled != 0 && canMove(currPos)) {
+	    sharedPositions[localID].xyz = resolveDistanceField(sharedPositions[localID].xyz);
+	}
+
+	changePosData(currPos, sharedPositions[localID], globalVertexIndex);
+})glsl"
+        },
+        {
+            "HairSimulation.frag",
+R"glsl(layout (std140, binding = HAIR_DATA_BINDING) uniform HairDataBlock {
+    HairRenderData hairData;
+};
+
+layout (std140, binding = LIGHT_DATA_BINDING) uniform LightDataBlock {
+    LightRenderData lightData;
+};
+
+layout (std140, binding = CLUSTER_DATA_BINDING) uniform ClusterDataBlock {
+    ClusterRenderData clusterData;
+};
+
+layout(std430, binding = CLUSTER_LIGHTS_BINDING) buffer ClusterLights {
+    int data[];
+} clusterLights;
+
+layout(binding = DENSITY_VOLUME_TEXTURE_UNIT) uniform sampler3D densityVolume;
+
+#ifdef MULTI_VIEW
+layout (std140, binding = MULTI_VIEW_DATA_BINDING) uniform MultiViewDataBlock {
+    MultiViewRenderData multiViewData;
+};
+#else
+layout (std140, binding = SCENE_DATA_BINDING) uniform SceneDataBlock {
+    SceneRenderData sceneData;
+};
+#endif
+
+layout(location = 0) in vec3 in_pos;
+layout(location = 1) in vec3 in_normal;
+layout(location = 2) in vec2 in_uv;
+#ifdef MULTI_VIEW
+layout(location = 3) flat in int in_view;
+#endif
+
+out vec4 out_color;
+
+int getClusterIndex(int viewIndex)
+{
+    ClusterView view = clusterData.views[viewIndex];
+
+    vec2 tile = (gl_FragCoord.xy - view.viewport.xy) / view.viewport.zw * vec2(CLUSTER_TILES_X, CLUSTER_TILES_Y);
+    float depth = -(view.viewMatrix * vec4(in_pos, 1.0)).z;
+    float slice = log(max(depth, view.depthRange.x) / view.depthRange.x) * view.depthRange.z;
+
+    int tileX = clamp(int(tile.x), 0, CLUSTER_TILES_X - 1);
+    int tileY = clamp(int(tile.y), 0, CLUSTER_TILES_Y - 1);
+    int sliceIndex = clamp(int(slice), 0, CLUSTER_SLICES - 1);
+
+    return ((viewIndex * CLUSTER_SLICES + sliceIndex) * CLUSTER_TILES_Y + tileY) * CLUSTER_TILES_X + tileX;
+}
+
+const int SHADOW_STEPS = 12;
+const float SHADOW_STEP_CELLS = 1.5;
+
+// marches the strand density volume towards the light, the hair itself is skipped
+// by starting one step away from the fragment
+float getTransmittance(vec3 lightPosition)
+{
+    vec3 position = (in_pos - hairData.densityVolumeMin) * hairData.densityVolumeScale;
+    vec3 direction = (lightPosition - in_pos) * hairData.densityVolumeScale;
+    float lightDistance = length(direction);
+    if(lightDistance <= 0.0) {
+        return 1.0;
+    }
+
+    float stepLength = SHADOW_STEP_CELLS / DENSITY_VOLUME_SIZE;
+    vec3 stepVector = direction / lightDistance * stepLength;
+    float opticalDepth = 0.0;
+
+    for(int i = 1; i <= SHADOW_STEPS && i * stepLength < lightDistance; i++) {
+        vec3 samplePosition = position + stepVector * i;
+        if(any(lessThan(samplePosition, vec3(0.0))) || any(greaterThan(samplePosition, vec3(1.0)))) {
+            break;
+        }
+        opticalDepth += texture(densityVolume, samplePosition).r;
+    }
+
+    return exp(-opticalDepth * hairData.selfShadowStrength * SHADOW_STEP_CELLS);
+}
+
+void main() {
+#ifdef MULTI_VIEW
+	int viewIndex = in_view;
+	vec3 eyePosition = multiViewData.views[in_view].eyePosition;
+#else
+	int viewIndex = 0;
+	vec3 eyePosition = sceneData.eyePosition;
+#endif
+	vec3 eyeVec = normalize(in_pos - eyePosition);
+	vec3 result = hairData.ambient * hairData.color.xyz;
+
+	// only the lights the culling pass assigned to this cluster are shaded
+	int clusterOffset = getClusterIndex(viewIndex) * (MAX_LIGHTS_PER_CLUSTER + 1);
+	int lightsCount = clusterLights.data[clusterOffset];
+
+	for(int i = 1; i <= lightsCount; i++) {
+		Light light = lightData.lights[clusterLights.data[clusterOffset + i]];
+		vec3 lightOffset = light.position - in_pos;
+		vec3 lightVec = normalize(lightOffset);
+
+		float attenuation = 1.0;
+		if(light.radius > 0.0) {
+			float falloff = clamp(1.0 - dot(lightOffset, lightOffset) / (light.radius * light.radius), 0.0, 1.0);
+			attenuation = falloff * falloff;
+		}
+
+		if(hairData.selfShadowing != 0) {
+			attenuation *= getTransmittance(light.position);
+		}
+
+		float diff = max(dot(in_normal, lightVec), 0.0);
+		vec3 diffuse = hairData.diffuse * diff * hairData.color.xyz;
+		vec3 reflectedVec = reflect(lightVec, in_normal);
+		float spec = pow(max(dot(eyeVec, reflectedVec), 0.0), hairData.specularPower);
+		vec3 specular = hairData.specular * spec * hairData.color.xyz;
+		result += (diffuse + specular) * light.color.xyz * attenuation;
+	}
+
+	out_color = vec4(result.x, result.y, result.z, hairData.color.w);
+}
+)glsl"
+        },
+        {
+            "HairSimulation.geom",
+R"glsl(#ifdef MULTI_VIEW
+// one invocation per view, each routed to its own viewport and layer
+layout(lines, invocations = MAX_VIEWS) in;
+
+layout (std140, binding = MULTI_VIEW_DATA_BINDING) uniform MultiViewDataBlock {
+    MultiViewRenderData multiViewData;
+};
+#else
+layout(lines) in;
+
+layout (std140, binding = SCENE_DATA_BINDING) uniform SceneDataBlock {
+    SceneRenderData sceneData;
+};
+#endif
+layout(triangle_strip, max_vertices = 4) out;
+
+layout(location = 0) in vec3 in_pos[];
+layout(location = 1) in vec3 in_tangent[];
+layout(location = 2) in float in_width[];
+
+layout(location = 0) out vec3 out_pos;
+layout(location = 1) out vec3 out_normal;
+layout(location = 2) out vec2 out_uv;
+#ifdef MULTI_VIEW
+layout(location = 3) flat out int out_view;
+
+SceneRenderData sceneData;
+#endif
+
+void calculateVertex(vec3 position, vec3 offset)
+{
+    vec3 offsetPos = position + offset;
+	gl_Position = sceneData.viewProjectionMatrix * vec4(offsetPos, 1.0);
+
+	out_normal = normalize(offset);
+	out_uv = vec2(0.0, 0.0);
+	out_pos = offsetPos;
+#ifdef MULTI_VIEW
+	out_view = gl_InvocationID;
+	gl_ViewportIndex = gl_InvocationID;
+	gl_Layer = gl_InvocationID;
+#endif
+
+	EmitVertex();
+}
+
+void main() {
+#ifdef MULTI_VIEW
+    if(gl_InvocationID >= multiViewData.viewsCount) {
+        return;
+    }
+    sceneData = multiViewData.views[gl_InvocationID];
+#endif
+
+    vec3 eyeVec0 = normalize(sceneData.eyePosition - in_pos[0]);
+	vec3 eyeVec1 = normalize(sceneData.eyePosition - in_pos[1]);
+	vec3 sideVec0 = normalize(cross(eyeVec0, in_tangent[0])) * in_width[0] / 2.0;
+	vec3 sideVec1 = normalize(cross(eyeVec1, in_tangent[1])) * in_width[1] / 2.0;
+
+	calculateVertex(in_pos[0], sideVec0);
+	calculateVertex(in_pos[1], sideVec1);
+	calculateVertex(in_pos[0], -sideVec0);
+	calculateVertex(in_pos[1], -sideVec1);
+})glsl"
+        },
+        {
+            "HairSimulation.tesc",
+R"glsl(layout (vertices = 2) out;
+
+layout (std140, binding = HAIR_DATA_BINDING) uniform HairDataBlock {
+    HairRenderData hairData;
+};
+
+#ifdef MULTI_VIEW
+layout (std140, binding = MULTI_VIEW_DATA_BINDING) uniform MultiViewDataBlock {
+    MultiViewRenderData multiViewData;
+};
+#else
+layout (std140, binding = SCENE_DATA_BINDING) uniform SceneDataBlock {
+    SceneRenderData sceneData;
+};
+#endif
+
+layout(std430, binding = POSITIONS_BUFFER_BINDING) buffer Positions {
+    vec4 data[];
+} positions;
+
+layout(std430, binding = HAIR_INDICES_BUFFER_BINDING) buffer HairIndices {
+    ivec4 data[];
+} hairIndices;
+
+layout(std430, binding = VISIBLE_TRIANGLES_BINDING) buffer VisibleTriangles {
+    int data[];
+} visibleTriangles;
+
+patch out int triangleIndex;
+patch out int slotIndex;
+patch out int segmentIndex;
+patch out int hairsCount;
+
+vec3 getGuidesCenter(ivec3 guides, int vertexIndex)
+{
+    int verticesPerStrand = hairData.segmentsCount + 1;
+    vertexIndex = clamp(vertexIndex, 0, hairData.segmentsCount);
+
+    return (positions.data[guides[0] * verticesPerStrand + vertexIndex].xyz +
+        positions.data[guides[1] * verticesPerStrand + vertexIndex].xyz +
+        positions.data[guides[2] * verticesPerStrand + vertexIndex].xyz) / 3.0;
+}
+
+float getBendAngle(vec3 a, vec3 b)
+{
+    float lengths = length(a) * length(b);
+    if(lengths <= 0.0) {
+        return 0.0;
+    }
+    return acos(clamp(dot(a, b) / lengths, -1.0, 1.0));
+}
+
+float getScreenLength(SceneRenderData view, vec3 p1, vec3 p2)
+{
+    vec4 clip1 = view.viewProjectionMatrix * vec4(p1, 1.0);
+    vec4 clip2 = view.viewProjectionMatrix * vec4(p2, 1.0);
+    if(clip1.w <= 0.0 || clip2.w <= 0.0) {
+        return 1e30;
+    }
+
+    vec2 viewportSize = vec2(view.viewportWidth, view.viewportHeight);
+    vec2 screenOffset = (clip2.xy / clip2.w - clip1.xy / clip1.w) * 0.5 * viewportSize;
+    return length(screenOffset);
+}
+
+// A curve piece of screen length L bending by angle A deviates from its chord by
+// about L * A / 8, splitting it into n pieces divides that by n^2.
+float getAdaptiveLevel()
+{
+    ivec3 guides = hairIndices.data[triangleIndex].xyz;
+    vec3 p0 = getGuidesCenter(guides, segmentIndex - 1);
+    vec3 p1 = getGuidesCenter(guides, segmentIndex);
+    vec3 p2 = getGuidesCenter(guides, segmentIndex + 1);
+    vec3 p3 = getGuidesCenter(guides, segmentIndex + 2);
+
+#ifdef MULTI_VIEW
+    float screenLength = 0.0;
+    for(int i = 0; i < multiViewData.viewsCount; i++) {
+        screenLength = max(screenLength, getScreenLength(multiViewData.views[i], p1, p2));
+    }
+#else
+    float screenLength = getScreenLength(sceneData, p1, p2);
+#endif
+
+    float bend = max(getBendAngle(p1 - p0, p2 - p1), getBendAngle(p2 - p1, p3 - p2));
+    float level = sqrt(screenLength * bend / (8.0 * hairData.tessellationPixelError));
+
+    return clamp(level, 1.0, hairData.tesselationFactor);
+}
+
+void main()
+{
+	if(gl_InvocationID == 0) {
+		triangleIndex = gl_PrimitiveID / hairData.segmentsCount;
+		slotIndex = triangleIndex;
+	    segmentIndex = gl_PrimitiveID % hairData.segmentsCount;
+
+        if(hairData.cullingEnabled != 0) {
+            triangleIndex = visibleTriangles.data[triangleIndex];
+        }
+
+        hairsCount = getTriangleHairsCount(hairData, hairIndices.data[triangleIndex]);
+        gl_TessLevelOuter[0] = float(hairsCount);
+        gl_TessLevelOuter[1] = hairData.adaptiveTessellation != 0 ? getAdaptiveLevel() : hairData.tesselationFactor;
+    }
+}
+)glsl"
+        },
+        {
+            "HairSimulation.tese",
+R"glsl(layout(isolines) in;
+
+layout (std140, binding = HAIR_DATA_BINDING) uniform HairDataBlock {
+    HairRenderData hairData;
+};
+
+layout(std430, binding = POSITIONS_BUFFER_BINDING) buffer Positions {
+    vec4 data[];
+} positions;
+
+layout(std430, binding = HAIR_INDICES_BUFFER_BINDING) buffer HairIndices {
+    ivec4 data[];
+} hairIndices;
+
+layout(std430, binding = FOLLOWER_COORDS_BINDING) buffer FollowerCoords {
+    vec4 data[];
+} followerCoords;
+
+layout(std430, binding = FOLLOWER_CACHE_BINDING) buffer FollowerCache {
+    vec4 data[];
+} followerCache;
+
+patch in int triangleIndex;
+patch in int slotIndex;
+patch in int segmentIndex;
+patch in int hairsCount;
+
+layout(location = 0) out vec3 out_pos;
+layout(location = 1) out vec3 out_tangent;
+layout(location = 2) out float out_width;
+
+const mat4 coefficientMatrix = mat4(
+    vec4(-1, 3, -3, 1),
+    vec4(3, -6, 0, 4),
+    vec4(-3, 3, 3, 1),
+    vec4(1, 0, 0, 0));
+
+int getFollowerIndex()
+{
+    return min(int(round(gl_TessCoord.y * hairsCount)), hairsCount - 1);
+}
+
+float getHairCoords()
+{
+    return (segmentIndex + gl_TessCoord.x) / hairData.segmentsCount;
+}
+
+vec3 getVertexPos(int hairIndex, int vertexIndex)
+{
+    int index = hairIndex * (hairData.segmentsCount + 1) + clamp(vertexIndex, 0, hairData.segmentsCount);
+	return positions.data[index].xyz;
+}
+
+vec3 getInterpolatedPosition(ivec3 hairIndices, int vertexIndex, vec3 bSplineWeights)
+{
+    vec3 position = vec3(0, 0, 0);
+	position += getVertexPos(hairIndices[0], vertexIndex) * bSplineWeights[0];
+	position += getVertexPos(hairIndices[1], vertexIndex) * bSplineWeights[1];
+	position += getVertexPos(hairIndices[2], vertexIndex) * bSplineWeights[2];
+	return position;
+}
+
+vec3 getCachedPosition(int followerIndex, int vertexIndex)
+{
+    int verticesPerStrand = hairData.segmentsCount + 1;
+    int hairIndex = slotIndex * hairData.hairsPerTriangle + followerIndex;
+    return followerCache.data[hairIndex * verticesPerStrand + clamp(vertexIndex, 0, hairData.segmentsCount)].xyz;
+}
+
+ivec3 getHairIndex(int triangleIndex)
+{
+	return hairIndices.data[triangleIndex].xyz;
+}
+
+void main()
+{
+    int followerIndex = getFollowerIndex();
+    vec3 p0, p1, p2, p3;
+
+    if(hairData.followerCacheEnabled != 0) {
+        p0 = getCachedPosition(followerIndex, segmentIndex - 1);
+        p1 = getCachedPosition(followerIndex, segmentIndex);
+        p2 = getCachedPosition(followerIndex, segmentIndex + 1);
+        p3 = getCachedPosition(followerIndex, segmentIndex + 2);
+    }
+    else {
+        ivec3 hairIndex = getHairIndex(triangleIndex);
+        vec3 bSplineWeights = followerCoords.data[followerIndex].xyz;
+
+        p0 = getInterpolatedPosition(hairIndex, segmentIndex - 1, bSplineWeights);
+        p1 = getInterpolatedPosition(hairIndex, segmentIndex, bSplineWeights);
+        p2 = getInterpolatedPosition(hairIndex, segmentIndex + 1, bSplineWeights);
+        p3 = getInterpolatedPosition(hairIndex, segmentIndex + 2, bSplineWeights);
+    }
+
+	float t = gl_TessCoord.x;
+	float t2 = t * t;
+	float t3 = t2 * t;
+	vec4 tVector = vec4(t3, t2, t, 1) / 6.0;
+	vec4 bSpline = tVector * coefficientMatrix;
+
+	out_pos = p0 * bSpline[0] + p1 * bSpline[1] + p2 * bSpline[2] + p3 * bSpline[3];
+
+	float thinning = (getHairCoords() - hairData.thinningStart) / max(1.0 - hairData.thinningStart, 1e-4);
+	thinning = clamp(thinning, 0.0, 1.0);
+	out_width = mix(hairData.rootWidth, hairData.tipWidth, thinning);
+
+	vec3 tangentBottom = normalize(p2 - p1);
+	vec3 tangentTop = p3 - p2;
+	if(length(tangentTop) == 0)
+	{
+	    out_tangent = tangentBottom;
+	}
+	else 
+	{
+	    tangentTop = normalize(tangentTop);
+	    out_tangent = mix(tangentBottom, tangentTop, t);
+	}
+}
+)glsl"
+        },
+        {
+            "HairSimulation.vert",
+R"glsl(uniform vec4 color;
+
+void main()
+{
+    gl_Position = color;
+})glsl"
+        },
+        {
+            "HairStrip.vert",
+R"glsl(layout (std140, binding = SCENE_DATA_BINDING) uniform SceneDataBlock {
+    SceneRenderData sceneData;
+};
+
+layout(std430, binding = STRAND_VERTICES_BINDING) buffer StrandVertices {
+    StrandVertex data[];
+} strandVertices;
+
+uniform int pointsPerHair;
+
+layout(location = 0) out vec3 out_pos;
+layout(location = 1) out vec3 out_normal;
+layout(location = 2) out vec2 out_uv;
+
+// two triangles per segment, corners 0 and 1 lie on one side of the hair
+const int QUAD_CORNERS[6] = int[6](0, 1, 2, 2, 1, 3);
+
+void main()
+{
+    int segmentsPerHair = pointsPerHair - 1;
+    int quadIndex = gl_VertexID / 6;
+    int corner = QUAD_CORNERS[gl_VertexID % 6];
+    int hairIndex = quadIndex / segmentsPerHair;
+    int pointIndex = hairIndex * pointsPerHair + quadIndex % segmentsPerHair + (corner & 1);
+
+    StrandVertex vertex = strandVertices.data[pointIndex];
+    if(vertex.position.w <= 0.0) {
+        gl_Position = vec4(0.0);
+        out_normal = vec3(0.0);
+        out_uv = vec2(0.0);
+        out_pos = vec3(0.0);
+        return;
+    }
+
+    vec3 eyeVec = normalize(sceneData.eyePosition - vertex.position.xyz);
+    vec3 sideVec = normalize(cross(eyeVec, vertex.tangent.xyz)) * vertex.position.w / 2.0;
+    if(corner >= 2) {
+        sideVec = -sideVec;
+    }
+
+    vec3 offsetPos = vertex.position.xyz + sideVec;
+    gl_Position = sceneData.viewProjectionMatrix * vec4(offsetPos, 1.0);
+
+    out_normal = normalize(sideVec);
+    out_uv = vec2(0.0, 0.0);
+    out_pos = offsetPos;
+}
+)glsl"
+        },
+        {
+            "HiZBuild.comp",
+R"glsl(precision highp float;
+
+uniform int level;
+layout(binding = 0) uniform sampler2D depthTexture;
+layout(binding = 0, r32f) readonly uniform image2D sourceLevel;
+layout(binding = 1, r32f) writeonly uniform image2D destinationLevel;
+
+layout(local_size_x = 8, local_size_y = 8, local_size_z = 1) in;
+
+
+void main()
+{
+    ivec2 texel = ivec2(gl_GlobalInvocationID.xy);
+    ivec2 size = imageSize(destinationLevel);
+    if(texel.x >= size.x || texel.y >= size.y) {
+        return;
+    }
+
+    if(level == 0) {
+        imageStore(destinationLevel, texel, vec4(texelFetch(depthTexture, texel, 0).r));
+        return;
+    }
+
+    // odd sized source levels fold their last row and column into the last texel
+    ivec2 sourceSize = imageSize(sourceLevel);
+    ivec2 sourceMin = texel * 2;
+    ivec2 sourceMax = min(texel * 2 + 1, sourceSize - 1);
+    if(texel.x == size.x - 1) {
+        sourceMax.x = sourceSize.x - 1;
+    }
+    if(texel.y == size.y - 1) {
+        sourceMax.y = sourceSize.y - 1;
+    }
+
+    float depth = 0.0;
+    for(int y = sourceMin.y; y <= sourceMax.y; y++) {
+        for(int x = sourceMin.x; x <= sourceMax.x; x++) {
+            depth = max(depth, imageLoad(sourceLevel, ivec2(x, y)).r);
+        }
+    }
+
+    imageStore(destinationLevel, texel, vec4(depth));
+}
+)glsl"
+        },
+        {
+            "LightCulling.comp",
+R"glsl(precision highp float;
+
+layout(local_size_x = 64, local_size_y = 1, local_size_z = 1) in;
+
+layout (std140, binding = LIGHT_DATA_BINDING) uniform LightDataBlock {
+    LightRenderData lightData;
+};
+
+layout (std140, binding = CLUSTER_DATA_BINDING) uniform ClusterDataBlock {
+    ClusterRenderData clusterData;
+};
+
+layout(std430, binding = CLUSTER_LIGHTS_BINDING) buffer ClusterLights {
+    int data[];
+} clusterLights;
+
+const int CLUSTERS_PER_VIEW = CLUSTER_TILES_X * CLUSTER_TILES_Y * CLUSTER_SLICES;
+
+// point at the given view space depth on the eye ray through an NDC position
+vec3 getViewPoint(mat4 inverseProjection, vec2 ndc, float depth)
+{
+    vec4 nearPoint = inverseProjection * vec4(ndc, -1.0, 1.0);
+    vec3 direction = nearPoint.xyz / nearPoint.w;
+    return direction * (depth / -direction.z);
+}
+
+void main()
+{
+    int clusterIndex = int(gl_GlobalInvocationID.x);
+    int viewIndex = int(gl_WorkGroupID.y);
+    if(clusterIndex >= CLUSTERS_PER_VIEW) {
+        return;
+    }
+
+    ClusterView view = clusterData.views[viewIndex];
+    mat4 inverseProjection = inverse(view.projectionMatrix);
+
+    int tileX = clusterIndex % CLUSTER_TILES_X;
+    int tileY = (clusterIndex / CLUSTER_TILES_X) % CLUSTER_TILES_Y;
+    int slice = clusterIndex / (CLUSTER_TILES_X * CLUSTER_TILES_Y);
+
+    // slices are spaced exponentially between the near and the far plane
+    float nearDepth = view.depthRange.x * pow(view.depthRange.y / view.depthRange.x, float(slice) / CLUSTER_SLICES);
+    float farDepth = view.depthRange.x * pow(view.depthRange.y / view.depthRange.x, float(slice + 1) / CLUSTER_SLICES);
+
+    vec2 ndcMin = vec2(tileX, tileY) / vec2(CLUSTER_TILES_X, CLUSTER_TILES_Y) * 2.0 - 1.0;
+    vec2 ndcMax = vec2(tileX + 1, tileY + 1) / vec2(CLUSTER_TILES_X, CLUSTER_TILES_Y) * 2.0 - 1.0;
+
+    vec3 boundsMin = vec3(1e30);
+    vec3 boundsMax = vec3(-1e30);
+    for(int i = 0; i < 8; i++) {
+        vec2 ndc = mix(ndcMin, ndcMax, vec2(i & 1, (i >> 1) & 1));
+        vec3 corner = getViewPoint(inverseProjection, ndc, (i & 4) != 0 ? farDepth : nearDepth);
+        boundsMin = min(boundsMin, corner);
+        boundsMax = max(boundsMax, corner);
+    }
+
+    int outputIndex = (viewIndex * CLUSTERS_PER_VIEW + clusterIndex) * (MAX_LIGHTS_PER_CLUSTER + 1);
+    int lightsCount = 0;
+
+    for(int i = 0; i < lightData.lightsCount && lightsCount < MAX_LIGHTS_PER_CLUSTER; i++) {
+        Light light = lightData.lights[i];
+
+        // lights without a radius reach every cluster
+        if(light.radius > 0.0) {
+            vec3 center = (view.viewMatrix * vec4(light.position, 1.0)).xyz;
+            vec3 closest = clamp(center, boundsMin, boundsMax);
+            vec3 offset = center - closest;
+            if(dot(offset, offset) > light.radius * light.radius) {
+                continue;
+            }
+        }
+
+        lightsCount++;
+        clusterLights.data[outputIndex + lightsCount] = i;
+    }
+
+    clusterLights.data[outputIndex] = lightsCount;
+}
+)glsl"
+        },
+        {
+            "RootVisualization.vert",
+R"glsl(#define POSITIONS_BUFFER_BINDING 3
+#define HAIR_INDICES_BUFFER_BINDING 4
+
+layout(std430, binding = POSITIONS_BUFFER_BINDING) buffer Positions
+{
+    vec4 data[];
+} positions;
+
+layout(std430, binding = HAIR_INDICES_BUFFER_BINDING) buffer HairIndices {
+    ivec4 data[];
+} hairIndices;
+
+uniform mat4 viewProjectionMatrix;
+uniform int verticesPerStrand;
+
+const int TRIANGLE_BREAKDOWN[6] = int[6](0, 1, 1, 2, 2, 0);
+
+layout(location = 0) out vec4 out_uv;
+
+void main()
+{
+    int triangleIndex = gl_VertexID / 6;
+	int vertexIndex = TRIANGLE_BREAKDOWN[gl_VertexID % 6];
+	
+	int hairIndex = hairIndices.data[triangleIndex][vertexIndex];
+	vec4 position = positions.data[hairIndex * verticesPerStrand];
+
+	gl_Position = viewProjectionMatrix * vec4(position.xyz, 1.0);
+
+	out_uv = vec4(hairIndices.data[triangleIndex].xyz, float(hairIndex));
+})glsl"
+        },
+        {
+            "ShaderFunctions.glsl",
+R"glsl(// Functions shared by the shaders, prepended after ShaderTypes.h.
+
+// Hairs grown from a triangle, with area weighting its relative area is stored
+// as float bits in the fourth index.
+int getTriangleHairsCount(HairRenderData data, ivec4 triangle)
+{
+    if(data.areaWeightedDensity == 0) {
+        return data.hairsPerTriangle;
+    }
+
+    float areaWeight = intBitsToFloat(triangle.w);
+    return clamp(int(ceil(data.density * areaWeight)), 1, data.hairsPerTriangle);
+}
+
+vec4 multQuaternionAndQuaternion(vec4 qA, vec4 qB)
+{
+    vec4 q;
+
+    q.w = qA.w * qB.w - qA.x * qB.x - qA.y * qB.y - qA.z * qB.z;
+    q.x = qA.w * qB.x + qA.x * qB.w + qA.y * qB.z - qA.z * qB.y;
+    q.y = qA.w * qB.y + qA.y * qB.w + qA.z * qB.x - qA.x * qB.z;
+    q.z = qA.w * qB.z + qA.z * qB.w + qA.x * qB.y - qA.y * qB.x;
+
+    return q;
+}
+
+vec3 multQuaternionAndVector(vec4 q, vec3 v)
+{
+    vec3 qvec = q.xyz;
+    vec3 uv = cross(qvec, v);
+    vec3 uuv = cross(qvec, uv);
+    uv *= (2.0f * q.w);
+    uuv *= 2.0f;
+
+    return v + uv + uuv;
+}
+)glsl"
+        },
+        {
+            "ShaderTypes.h",
+R"glsl(#ifndef SHADER_TYPES_H
+#define SHADER_TYPES_H
+
+#ifdef SHADER_CPP_INCLUDE
+#include <hairsimulation/Math.h>
+#define mat4 HairSimulation::Matrix4
+#define vec4 HairSimulation::Vector4
+#define vec3 HairSimulation::Vector3
+#endif
+
+#define MAX_LIGHTS 256
+#define MAX_LIGHTS_PER_CLUSTER 32
+#define CLUSTER_TILES_X 16
+#define CLUSTER_TILES_Y 9
+#define CLUSTER_SLICES 24
+#define DENSITY_VOLUME_SIZE 32
+#define DENSITY_FIXED_POINT_SCALE 256.0
+#define HAIR_GRID_SIZE 32
+#define HAIR_GRID_FIXED_POINT_SCALE 1024.0
+#define HAIR_GRID_MAX_VELOCITY 16.0
+#define MAX_COLLIDERS 64
+#define MAX_VIEWS 4
+#define HAIR_DATA_BINDING 0
+#define SCENE_DATA_BINDING 1
+#define LIGHT_DATA_BINDING 2
+#define POSITIONS_BUFFER_BINDING 3
+#define HAIR_INDICES_BUFFER_BINDING 4
+#define PREVIOUS_POSITIONS_BUFFER_BINDING 5
+#define REST_POSITIONS_BUFFER_BINDING 6
+#define TANGENTS_DISTANCES_BINDING 7
+#define REF_VECTORS_BINDING 8
+#define GLOBAL_ROTATIONS_BINDING 9
+#define DEBUG_BUFFER_BINDING 10
+#define FOLLOWERS_BINDING 11
+#define CULLING_COMMANDS_BINDING 12
+#define VISIBLE_TRIANGLES_BINDING 13
+#define STRAND_VERTICES_BINDING 14
+#define FOLLOWER_COORDS_BINDING 15
+#define FOLLOWER_CACHE_BINDING 16
+#define MULTI_VIEW_DATA_BINDING 17
+#define CLUSTER_DATA_BINDING 18
+#define CLUSTER_LIGHTS_BINDING 19
+#define DENSITY_GRID_BINDING 20
+#define DENSITY_VOLUME_TEXTURE_UNIT 1
+#define HAIR_GRID_ACCUMULATION_BINDING 21
+#define HAIR_GRID_BINDING 22
+#define COLLIDERS_BINDING 23
+#define COLLIDER_MASKS_BINDING 24
+#define DISTANCE_FIELD_TEXTURE_UNIT 2
+#define SCALP_VERTICES_BINDING 25
+#define SCALP_INDICES_BINDING 26
+#define ROOT_ATTACHMENTS_BINDING 27
+#define ROOT_TRANSFORMS_BINDING 28
+#define MOVABILITY_BINDING 29
+#define STRAND_REACH_BINDING 30
+
+#define SIMULATION_LOD_LEVELS 5
+#define MAX_VERTICES_PER_STRAND 16
+#define MAX_HAIRS_PER_TRIANGLE 64
+#define MAX_POINTS_PER_SEGMENT 64
+
+struct HairRenderData
+{
+    int segmentsCount;
+    float tesselationFactor;
+    float density;
+    int cullingEnabled;
+
+    float rootWidth;
+    float tipWidth;
+    float thinningStart;
+    int followerCacheEnabled;
+
+    int adaptiveTessellation;
+    float tessellationPixelError;
+    int hairsPerTriangle;
+    int areaWeightedDensity;
+
+    vec3 densityVolumeMin;
+    float selfShadowStrength;
+    vec3 densityVolumeScale;
+    int selfShadowing;
+
+    float specular;
+    float diffuse;
+    float ambient;
+    float specularPower;
+    vec4 color;
+};
+
+struct SceneRenderData
+{
+    mat4 viewProjectionMatrix;
+    vec3 eyePosition;
+    float _padding0;
+    float viewportWidth;
+    float viewportHeight;
+    float _padding1;
+    float _padding2;
+};
+
+struct MultiViewRenderData
+{
+    SceneRenderData views[MAX_VIEWS];
+    int viewsCount;
+    int _padding0;
+    int _padding1;
+    int _padding2;
+};
+
+// spheres are capsules with both end points at the center
+struct Collider
+{
+    vec3 start;
+    float radius;
+    vec3 end;
+    float _padding;
+};
+
+struct Light
+{
+    vec4 color;
+    vec3 position;
+    float radius;
+};
+
+struct LightRenderData
+{
+    Light lights[MAX_LIGHTS];
+    int lightsCount;
+    int _padding0;
+    int _padding1;
+    int _padding2;
+};
+
+struct ClusterView
+{
+    mat4 viewMatrix;
+    mat4 projectionMatrix;
+    vec4 viewport;
+    vec4 depthRange;
+};
+
+struct ClusterRenderData
+{
+    ClusterView views[MAX_VIEWS];
+};
+
+struct CullingCommands
+{
+    int count;
+    int instanceCount;
+    int first;
+    int baseInstance;
+
+    int stripCount;
+    int stripInstanceCount;
+    int stripFirst;
+    int stripBaseInstance;
+
+    int groupsX;
+    int groupsY;
+    int groupsZ;
+    int visibleTriangles;
+};
+
+struct StrandVertex
+{
+    vec4 position;
+    vec4 tangent;
+};
+
+// Strand root pinned to a scalp triangle, u and v weight its second and third
+// vertex. The offset and the inverse rest frame are relative to the triangle frame.
+struct RootAttachment
+{
+    int triangle;
+    float u;
+    float v;
+    float _padding;
+    vec4 offset;
+    vec4 restFrameInverse;
+};
+
+struct FollowerData
+{
+    int guideIndices[4];
+    vec4 weights;
+};
+#endif
+)glsl"
+        },
+        {
+            "SimpleColor.frag",
+R"glsl(out vec4 out_color;
+
+uniform vec4 color;
+
+void main()
+{
+    out_color = color;
+})glsl"
+        },
+        {
+            "StrandVisualization.vert",
+R"glsl(#define POSITIONS_BUFFER_BINDING 3
+
+layout(std430, binding = POSITIONS_BUFFER_BINDING) buffer Positions
+{
+    vec4 data[];
+} positions;
+
+uniform mat4 viewProjectionMatrix;
+uniform int doubleSegments;
+uniform int verticesPerStrand;
+
+void main()
+{
+    int strandIndex = gl_VertexID / doubleSegments;
+	int lineIndex = gl_VertexID % doubleSegments;
+	int vertIndex = lineIndex / 2 + lineIndex % 2;
+
+	vec4 position = positions.data[strandIndex * verticesPerStrand + vertIndex];
+
+	gl_Position = viewProjectionMatrix * vec4(position.xyz, 1.0);
+})glsl"
+        },
+    };
+}
+
+#endif
@@ -6,27 +6,116 @@ layout (std140, binding = LIGHT_DATA_BINDING) uniform LightDataBlock {
     LightRenderData lightData;
 };
 
+layout (std140, binding = CLUSTER_DATA_BINDING) uniform ClusterDataBlock {
+    ClusterRenderData clusterData;
+};
+
+layout(std430, binding = CLUSTER_LIGHTS_BINDING) buffer ClusterLights {
+    int data[];
+} clusterLights;
+
+layout(binding = DENSITY_VOLUME_TEXTURE_UNIT) uniform sampler3D densityVolume;
+
+#ifdef MULTI_VIEW
+layout (std140, binding = MULTI_VIEW_DATA_BINDING) uniform MultiViewDataBlock {
+    MultiViewRenderData multiViewData;
+};
+#else
 layout (std140, binding = SCENE_DATA_BINDING) uniform SceneDataBlock {
     SceneRenderData sceneData;
 };
+#endif
 
 layout(location = 0) in vec3 in_pos;
 layout(location = 1) in vec3 in_normal;
 layout(location = 2) in vec2 in_uv;
+#ifdef MULTI_VIEW
+layout(location = 3) flat in int in_view;
+#endif
 
 out vec4 out_color;
 
+int getClusterIndex(int viewIndex)
+{
+    ClusterView view = clusterData.views[viewIndex];
+
+    vec2 tile = (gl_FragCoord.xy - view.viewport.xy) / view.viewport.zw * vec2(CLUSTER_TILES_X, CLUSTER_TILES_Y);
+    float depth = -(view.viewMatrix * vec4(in_pos, 1.0)).z;
+    float slice = log(max(depth, view.depthRange.x) / view.depthRange.x) * view.depthRange.z;
+
+    int tileX = clamp(int(tile.x), 0, CLUSTER_TILES_X - 1);
+    int tileY = clamp(int(tile.y), 0, CLUSTER_TILES_Y - 1);
+    int sliceIndex = clamp(int(slice), 0, CLUSTER_SLICES - 1);
+
+    return ((viewIndex * CLUSTER_SLICES + sliceIndex) * CLUSTER_TILES_Y + tileY) * CLUSTER_TILES_X + tileX;
+}
+
+const int SHADOW_STEPS = 12;
+const float SHADOW_STEP_CELLS = 1.5;
+
+// marches the strand density volume towards the light, the hair itself is skipped
+// by starting one step away from the fragment
+float getTransmittance(vec3 lightPosition)
+{
+    vec3 position = (in_pos - hairData.densityVolumeMin) * hairData.densityVolumeScale;
+    vec3 direction = (lightPosition - in_pos) * hairData.densityVolumeScale;
+    float lightDistance = length(direction);
+    if(lightDistance <= 0.0) {
+        return 1.0;
+    }
+
+    float stepLength = SHADOW_STEP_CELLS / DENSITY_VOLUME_SIZE;
+    vec3 stepVector = direction / lightDistance * stepLength;
+    float opticalDepth = 0.0;
+
+    for(int i = 1; i <= SHADOW_STEPS && i * stepLength < lightDistance; i++) {
+        vec3 samplePosition = position + stepVector * i;
+        if(any(lessThan(samplePosition, vec3(0.0))) || any(greaterThan(samplePosition, vec3(1.0)))) {
+            break;
+        }
+        opticalDepth += texture(densityVolume, samplePosition).r;
+    }
+
+    return exp(-opticalDepth * hairData.selfShadowStrength * SHADOW_STEP_CELLS);
+}
+
 void main() {
+#ifdef MULTI_VIEW
+	int viewIndex = in_view;
+	vec3 eyePosition = multiViewData.views[in_view].eyePosition;
+#else
+	int viewIndex = 0;
+	vec3 eyePosition = sceneData.eyePosition;
+#endif
+	vec3 eyeVec = normalize(in_pos - eyePosition);
+	vec3 result = hairData.ambient * hairData.color.xyz;
+
+	// only the lights the culling pass assigned to this cluster are shaded
+	int clusterOffset = getClusterIndex(viewIndex) * (MAX_LIGHTS_PER_CLUSTER + 1);
+	int lightsCount = clusterLights.data[clusterOffset];
+
+	for(int i = 1; i <= lightsCount; i++) {
+		Light light = lightData.lights[clusterLights.data[clusterOffset + i]];
+		vec3 lightOffset = light.position - in_pos;
+		vec3 lightVec = normalize(lightOffset);
+
+		float attenuation = 1.0;
+		if(light.radius > 0.0) {
+			float falloff = clamp(1.0 - dot(lightOffset, lightOffset) / (light.radius * light.radius), 0.0, 1.0);
+			attenuation = falloff * falloff;
+		}
+
+		if(hairData.selfShadowing != 0) {
+			attenuation *= getTransmittance(light.position);
+		}
+
+		float diff = max(dot(in_normal, lightVec), 0.0);
+		vec3 diffuse = hairData.diffuse * diff * hairData.color.xyz;
+		vec3 reflectedVec = reflect(lightVec, in_normal);
+		float spec = pow(max(dot(eyeVec, reflectedVec), 0.0), hairData.specularPower);
+		vec3 specular = hairData.specular * spec * hairData.color.xyz;
+		result += (diffuse + specular) * light.color.xyz * attenuation;
+	}
 
-	Light light = lightData.lights[0];
-	vec3 ambient = hairData.ambient * hairData.color.xyz;
-	vec3 lightVec = normalize(light.position - in_pos);
-	float diff = max(dot(in_normal, lightVec), 0.0);
-	vec3 diffuse = hairData.diffuse * diff * hairData.color.xyz;
-	vec3 eyeVec = normalize(in_pos - sceneData.eyePosition);
-	vec3 reflectedVec = reflect(lightVec, in_normal);
-	float spec = pow(max(dot(eyeVec, reflectedVec), 0.0), hairData.specularPower);
-	vec3 specular = hairData.specular * spec * hairData.color.xyz;
-	vec3 result = (ambient + diffuse + specular) * light.color.xyz;
 	out_color = vec4(result.x, result.y, result.z, hairData.color.w);
-}
\ No newline at end of file
+}
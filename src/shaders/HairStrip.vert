@@ -0,0 +1,47 @@
+layout (std140, binding = SCENE_DATA_BINDING) uniform SceneDataBlock {
+    SceneRenderData sceneData;
+};
+
+layout(std430, binding = STRAND_VERTICES_BINDING) buffer StrandVertices {
+    StrandVertex data[];
+} strandVertices;
+
+uniform int pointsPerHair;
+
+layout(location = 0) out vec3 out_pos;
+layout(location = 1) out vec3 out_normal;
+layout(location = 2) out vec2 out_uv;
+
+// two triangles per segment, corners 0 and 1 lie on one side of the hair
+const int QUAD_CORNERS[6] = int[6](0, 1, 2, 2, 1, 3);
+
+void main()
+{
+    int segmentsPerHair = pointsPerHair - 1;
+    int quadIndex = gl_VertexID / 6;
+    int corner = QUAD_CORNERS[gl_VertexID % 6];
+    int hairIndex = quadIndex / segmentsPerHair;
+    int pointIndex = hairIndex * pointsPerHair + quadIndex % segmentsPerHair + (corner & 1);
+
+    StrandVertex vertex = strandVertices.data[pointIndex];
+    if(vertex.position.w <= 0.0) {
+        gl_Position = vec4(0.0);
+        out_normal = vec3(0.0);
+        out_uv = vec2(0.0);
+        out_pos = vec3(0.0);
+        return;
+    }
+
+    vec3 eyeVec = normalize(sceneData.eyePosition - vertex.position.xyz);
+    vec3 sideVec = normalize(cross(eyeVec, vertex.tangent.xyz)) * vertex.position.w / 2.0;
+    if(corner >= 2) {
+        sideVec = -sideVec;
+    }
+
+    vec3 offsetPos = vertex.position.xyz + sideVec;
+    gl_Position = sceneData.viewProjectionMatrix * vec4(offsetPos, 1.0);
+
+    out_normal = normalize(sideVec);
+    out_uv = vec2(0.0, 0.0);
+    out_pos = offsetPos;
+}
@@ -0,0 +1,36 @@
+// Functions shared by the shaders, prepended after ShaderTypes.h.
+
+// Hairs grown from a triangle, with area weighting its relative area is stored
+// as float bits in the fourth index.
+int getTriangleHairsCount(HairRenderData data, ivec4 triangle)
+{
+    if(data.areaWeightedDensity == 0) {
+        return data.hairsPerTriangle;
+    }
+
+    float areaWeight = intBitsToFloat(triangle.w);
+    return clamp(int(ceil(data.density * areaWeight)), 1, data.hairsPerTriangle);
+}
+
+vec4 multQuaternionAndQuaternion(vec4 qA, vec4 qB)
+{
+    vec4 q;
+
+    q.w = qA.w * qB.w - qA.x * qB.x - qA.y * qB.y - qA.z * qB.z;
+    q.x = qA.w * qB.x + qA.x * qB.w + qA.y * qB.z - qA.z * qB.y;
+    q.y = qA.w * qB.y + qA.y * qB.w + qA.z * qB.x - qA.x * qB.z;
+    q.z = qA.w * qB.z + qA.z * qB.w + qA.x * qB.y - qA.y * qB.x;
+
+    return q;
+}
+
+vec3 multQuaternionAndVector(vec4 q, vec3 v)
+{
+    vec3 qvec = q.xyz;
+    vec3 uv = cross(qvec, v);
+    vec3 uuv = cross(qvec, uv);
+    uv *= (2.0f * q.w);
+    uuv *= 2.0f;
+
+    return v + uv + uuv;
+}
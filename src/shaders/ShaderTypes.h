@@ -8,7 +8,18 @@
 #define vec3 HairSimulation::Vector3
 #endif
 
-#define MAX_LIGHTS 16
+#define MAX_LIGHTS 256
+#define MAX_LIGHTS_PER_CLUSTER 32
+#define CLUSTER_TILES_X 16
+#define CLUSTER_TILES_Y 9
+#define CLUSTER_SLICES 24
+#define DENSITY_VOLUME_SIZE 32
+#define DENSITY_FIXED_POINT_SCALE 256.0
+#define HAIR_GRID_SIZE 32
+#define HAIR_GRID_FIXED_POINT_SCALE 1024.0
+#define HAIR_GRID_MAX_VELOCITY 16.0
+#define MAX_COLLIDERS 64
+#define MAX_VIEWS 4
 #define HAIR_DATA_BINDING 0
 #define SCENE_DATA_BINDING 1
 #define LIGHT_DATA_BINDING 2
@@ -20,18 +31,55 @@
 #define REF_VECTORS_BINDING 8
 #define GLOBAL_ROTATIONS_BINDING 9
 #define DEBUG_BUFFER_BINDING 10
+#define FOLLOWERS_BINDING 11
+#define CULLING_COMMANDS_BINDING 12
+#define VISIBLE_TRIANGLES_BINDING 13
+#define STRAND_VERTICES_BINDING 14
+#define FOLLOWER_COORDS_BINDING 15
+#define FOLLOWER_CACHE_BINDING 16
+#define MULTI_VIEW_DATA_BINDING 17
+#define CLUSTER_DATA_BINDING 18
+#define CLUSTER_LIGHTS_BINDING 19
+#define DENSITY_GRID_BINDING 20
+#define DENSITY_VOLUME_TEXTURE_UNIT 1
+#define HAIR_GRID_ACCUMULATION_BINDING 21
+#define HAIR_GRID_BINDING 22
+#define COLLIDERS_BINDING 23
+#define COLLIDER_MASKS_BINDING 24
+#define DISTANCE_FIELD_TEXTURE_UNIT 2
+#define SCALP_VERTICES_BINDING 25
+#define SCALP_INDICES_BINDING 26
+#define ROOT_ATTACHMENTS_BINDING 27
+#define ROOT_TRANSFORMS_BINDING 28
+#define MOVABILITY_BINDING 29
+#define STRAND_REACH_BINDING 30
+
+#define SIMULATION_LOD_LEVELS 5
+#define MAX_VERTICES_PER_STRAND 16
+#define MAX_HAIRS_PER_TRIANGLE 64
+#define MAX_POINTS_PER_SEGMENT 64
 
 struct HairRenderData
 {
     int segmentsCount;
     float tesselationFactor;
     float density;
-    float _padding0;
+    int cullingEnabled;
 
     float rootWidth;
     float tipWidth;
     float thinningStart;
-    float _padding1;
+    int followerCacheEnabled;
+
+    int adaptiveTessellation;
+    float tessellationPixelError;
+    int hairsPerTriangle;
+    int areaWeightedDensity;
+
+    vec3 densityVolumeMin;
+    float selfShadowStrength;
+    vec3 densityVolumeScale;
+    int selfShadowing;
 
     float specular;
     float diffuse;
@@ -45,13 +93,35 @@ struct SceneRenderData
     mat4 viewProjectionMatrix;
     vec3 eyePosition;
     float _padding0;
+    float viewportWidth;
+    float viewportHeight;
+    float _padding1;
+    float _padding2;
+};
+
+struct MultiViewRenderData
+{
+    SceneRenderData views[MAX_VIEWS];
+    int viewsCount;
+    int _padding0;
+    int _padding1;
+    int _padding2;
+};
+
+// spheres are capsules with both end points at the center
+struct Collider
+{
+    vec3 start;
+    float radius;
+    vec3 end;
+    float _padding;
 };
 
 struct Light
 {
     vec4 color;
     vec3 position;
-    float _padding;
+    float radius;
 };
 
 struct LightRenderData
@@ -62,4 +132,59 @@ struct LightRenderData
     int _padding1;
     int _padding2;
 };
+
+struct ClusterView
+{
+    mat4 viewMatrix;
+    mat4 projectionMatrix;
+    vec4 viewport;
+    vec4 depthRange;
+};
+
+struct ClusterRenderData
+{
+    ClusterView views[MAX_VIEWS];
+};
+
+struct CullingCommands
+{
+    int count;
+    int instanceCount;
+    int first;
+    int baseInstance;
+
+    int stripCount;
+    int stripInstanceCount;
+    int stripFirst;
+    int stripBaseInstance;
+
+    int groupsX;
+    int groupsY;
+    int groupsZ;
+    int visibleTriangles;
+};
+
+struct StrandVertex
+{
+    vec4 position;
+    vec4 tangent;
+};
+
+// Strand root pinned to a scalp triangle, u and v weight its second and third
+// vertex. The offset and the inverse rest frame are relative to the triangle frame.
+struct RootAttachment
+{
+    int triangle;
+    float u;
+    float v;
+    float _padding;
+    vec4 offset;
+    vec4 restFrameInverse;
+};
+
+struct FollowerData
+{
+    int guideIndices[4];
+    vec4 weights;
+};
 #endif